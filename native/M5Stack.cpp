@@ -0,0 +1,299 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Host stand-in for the M5Stack / Arduino libraries. See M5Stack.h.
+//
+#include <M5Stack.h>
+#include "glyph_width.h"
+#include <chrono>
+#include <deque>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+Sim_M5Stack M5;
+Sim_Wire    Wire;
+Sim_Serial  Serial;
+Sim_ESP     ESP;
+
+static std::deque<char> script;   // Keystrokes not yet consumed by the calculator
+static void (*keyboard_isr)() = nullptr;
+static int  keyboard_level    = HIGH;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  String
+//
+void String::replace(const String& find, const String& with) {
+  if(0 == find.s.length()) return;
+  size_t pos = 0;
+  while(std::string::npos != (pos = s.find(find.s, pos))) {
+    s.replace(pos, find.s.length(), with.s);
+    pos += with.s.length();
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Font metrics
+//  Fonts 2, 4 and 6 use TFT_eSPI's width tables (glyph_width.h), with the 1 pixel
+//  blank it draws for a glyph the font doesn't have. Fonts 1 and 7 only
+//  approximate it: every glyph gets the font's digit width, and a space half that.
+//
+static int16_t advance(char c, uint8_t font) {
+  if(glyph_font_index(font) >= 0) {
+    uint8_t w = glyph_width(c < GLYPH_FIRST || c > GLYPH_LAST ? ' ' : c, font);
+    return w ? w : 1;
+  }
+  int16_t w = 7 == font ? 32 : 6;
+  return ' ' == c ? w / 2 : w;
+}
+
+int16_t TFT_eSPI::fontHeight(uint8_t font) {
+  switch(font) {
+    case 2:  return 16;
+    case 4:  return 26;
+    case 6:  return 48;
+    case 7:  return 48;
+    default: return  8;
+  }
+}
+
+int16_t TFT_eSPI::textWidth(const char* str, uint8_t font) {
+  int16_t w = 0;
+  while(*str) w += advance(*str++, font);
+  return w;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Drawing: count calls and the pixels that would be pushed to the panel
+//
+void TFT_eSPI::count_pixels(int32_t x, int32_t y, int32_t w, int32_t h) {
+  if(x < 0) { w += x; x = 0; }
+  if(y < 0) { h += y; y = 0; }
+  if(x + w > _width)  w = _width  - x;
+  if(y + h > _height) h = _height - y;
+  if(w > 0 && h > 0) stats.pixels += (uint64_t)w * h;
+}
+
+void TFT_eSPI::fillScreen(uint16_t color) {
+  fillRect(0, 0, _width, _height, color);
+}
+
+void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color) {
+  stats.fill_calls++;
+  count_pixels(x, y, w, h);
+}
+
+int16_t TFT_eSPI::drawString(const char* str, int32_t x, int32_t y, uint8_t font) {
+  int16_t w = textWidth(str, font);
+  if(TR_DATUM == text_datum) x -= w;
+  stats.text_calls++;
+  count_pixels(x, y, w, fontHeight(font));
+  return w;
+}
+
+int16_t TFT_eSPI::drawCentreString(const char* str, int32_t x, int32_t y, uint8_t font) {
+  int16_t w = textWidth(str, font);
+  stats.text_calls++;
+  count_pixels(x - w / 2, y, w, fontHeight(font));
+  return w;
+}
+
+size_t TFT_eSPI::print(const char* str) {
+  int16_t w = textWidth(str, text_font);
+  stats.text_calls++;
+  count_pixels(cursor_x, cursor_y, w, fontHeight(text_font));
+  cursor_x += w;
+  return strlen(str);
+}
+
+
+void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data) {
+  stats.push_calls++;
+  count_pixels(x, y, w, h);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Sprites: a RAM buffer of 16 bit pixels
+//
+void* TFT_eSprite::createSprite(int16_t w, int16_t h) {
+  deleteSprite();
+  buffer = (uint16_t*)calloc((size_t)w * h, sizeof(uint16_t));
+  if(buffer) {
+    _width  = w;
+    _height = h;
+  }
+  return buffer;
+}
+
+void TFT_eSprite::deleteSprite() {
+  free(buffer);
+  buffer  = nullptr;
+  _width  = 0;
+  _height = 0;
+}
+
+void TFT_eSprite::pushSprite(int32_t x, int32_t y) {
+  tft->pushImageDMA(x, y, _width, _height, buffer);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Buttons and keyboard: both are fed from the keystroke script
+//
+static bool is_button_key(char c) { return 'a' == c || 'b' == c || 'c' == c; }
+
+// Call the keyboard interrupt handler when the simulated KEYBOARD_INT falls
+static void check_keyboard_interrupt() {
+  int level = digitalRead(0);
+  if(HIGH == keyboard_level && LOW == level && keyboard_isr) {
+    keyboard_level = LOW;
+    keyboard_isr();
+    level = digitalRead(0);
+  }
+  keyboard_level = level;
+}
+
+void Sim_M5Stack::update() {
+  BtnA.released = BtnB.released = BtnC.released = false;
+  if(!script.empty() && is_button_key(script.front())) {
+    char c = script.front();
+    script.pop_front();
+    if('a' == c) BtnA.released = true;
+    if('b' == c) BtnB.released = true;
+    if('c' == c) BtnC.released = true;
+  }
+}
+
+uint8_t Sim_Wire::requestFrom(int address, int quantity) {
+  if(script.empty() || is_button_key(script.front())) return 0;
+  rx_byte  = script.front();
+  has_byte = true;
+  script.pop_front();
+  return 1;
+}
+
+FILE* Sim_Serial::port() {
+  if(nullptr == out) {
+    const char* path = getenv("SIM_SERIAL");
+    out = path ? fopen(path, "wb") : nullptr;
+    if(nullptr == out) out = stderr;
+  }
+  return out;
+}
+
+size_t Sim_Serial::printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int n = pty >= 0 ? vdprintf(pty, format, args) : vfprintf(port(), format, args);
+  va_end(args);
+  return n > 0 ? (size_t)n : 0;
+}
+
+size_t Sim_Serial::write(const uint8_t* data, size_t size) {
+  if(pty < 0) return fwrite(data, 1, size, port());
+  size_t written = 0;
+  while(written < size) {
+    ssize_t n = ::write(pty, data + written, size - written);
+    if(n <= 0) break;
+    written += n;
+  }
+  return written;
+}
+
+int Sim_Serial::available() {
+  if(rx_next == rx_end && pty >= 0) {
+    int waiting = 0;
+    if(ioctl(pty, FIONREAD, &waiting) < 0 || 0 == waiting) return 0;
+    rx_next = 0;
+    rx_end  = (int)::read(pty, rx, std::min(waiting, (int)sizeof(rx)));
+    if(rx_end < 0) rx_end = 0;
+  }
+  return rx_end - rx_next;
+}
+
+int Sim_Serial::read() {
+  return available() > 0 ? rx[rx_next++] : -1;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+int digitalRead(uint8_t pin) {
+  return (!script.empty() && !is_button_key(script.front())) ? LOW : HIGH;
+}
+
+int digitalPinToInterrupt(uint8_t pin) {
+  return pin;
+}
+
+void attachInterrupt(int interrupt, void (*isr)(), int mode) {
+  keyboard_isr = isr;
+  check_keyboard_interrupt();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Time
+//
+static const auto boot_time = std::chrono::steady_clock::now();
+
+uint32_t millis() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - boot_time).count();
+}
+
+uint32_t micros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot_time).count();
+}
+
+uint32_t Sim_ESP::getCycleCount() {
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - boot_time).count();
+  return (uint32_t)(ns * SIM_CPU_MHZ / 1000);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Simulation control
+//
+void sim_push_keys(const char* keys) {
+  while(*keys) script.push_back(*keys++);
+  check_keyboard_interrupt();
+}
+
+size_t sim_pending_keys() {
+  return script.size();
+}
+
+void sim_reset_stats() {
+  M5.Lcd.stats = Lcd_Stats();
+}
+
+const char* sim_serial_pty() {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) return nullptr;
+  const char* path  = ptsname(master);
+  int         slave = path ? open(path, O_RDWR | O_NOCTTY) : -1;
+  if(slave < 0) return nullptr;
+  struct termios raw;                       // No echo, no line editing, no newline translation
+  tcgetattr(slave, &raw);
+  cfmakeraw(&raw);
+  tcsetattr(slave, TCSANOW, &raw);
+  close(slave);
+  Serial.pty = master;
+  return path;
+}
+
+bool sim_serial_hung_up() {
+  struct pollfd p = { Serial.pty, POLLIN, 0 };
+  return Serial.pty < 0 || (poll(&p, 1, 0) > 0 && (p.revents & POLLHUP) && 0 == Serial.available());
+}
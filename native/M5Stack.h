@@ -0,0 +1,313 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Host stand-in for the parts of the M5Stack / Arduino libraries the calculator uses.
+//
+//  This header is only on the include path of the [env:native] PlatformIO environment.
+//  It lets src/main.cpp compile unchanged on Linux:
+//  - M5.Lcd records fill/draw calls and the number of pixels each one pushes.
+//  - Wire and digitalRead(KEYBOARD_INT) play back a keystroke script as if it came
+//    from the Calculator FACE.
+//  - M5.BtnA/B/C are pressed by the lowercase letters 'a', 'b' and 'c' in the same script.
+//  - Serial output goes to stderr, so it doesn't mix with a harness's report on stdout,
+//    or to the file named by SIM_SERIAL in the environment, to capture binary output.
+//    A harness can instead connect Serial to a pseudo-terminal, for a host to talk to.
+//  - ESP.getCycleCount() counts at 240 MHz, from the host's clock.
+//
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Constants borrowed from Arduino, TFT_eSPI and M5Stack
+//
+#define LOW                   0
+#define HIGH                  1
+#define INPUT_PULLUP          0x05
+#define FALLING               0x02
+#define IRAM_ATTR
+
+#define BLACK                 0x0000        // RGB565 colors, as defined by TFT_eSPI
+#define BLUE                  0x001F
+#define DARKGREY              0x7BEF
+#define LIGHTGREY             0xC618
+#define WHITE                 0xFFFF
+
+#define TL_DATUM              0             // Top left text datum
+#define TC_DATUM              1             // Top centre text datum
+#define TR_DATUM              2             // Top right text datum
+
+#define BUTTON_A              0             // Front buttons, as passed to process_button()
+#define BUTTON_B              1
+#define BUTTON_C              2
+
+#define SIM_SCREEN_WIDTH      320           // Physical panel size, used to clip pixel counts
+#define SIM_SCREEN_HEIGHT     240
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Arduino String, implemented just far enough for the calculator.
+//
+class String {
+  public:
+    String(const char* str = "")        : s(str) {}
+    String(const std::string& str)      : s(str) {}
+    String(char c)                      : s(1, c) {}
+    String(unsigned char value)         : s(std::to_string(value)) {}
+    String(int value)                   : s(std::to_string(value)) {}
+
+    unsigned int  length() const        { return (unsigned int)s.length(); }
+    const char*   c_str()  const        { return s.c_str(); }
+    double        toDouble() const      { return atof(s.c_str()); }
+    bool          startsWith(const String& prefix) const { return 0 == s.compare(0, prefix.s.length(), prefix.s); }
+    int           indexOf(char c) const { size_t i = s.find(c); return std::string::npos == i ? -1 : (int)i; }
+    void          remove(unsigned int index)                      { if(index < s.length()) s.erase(index); }
+    void          remove(unsigned int index, unsigned int count)  { if(index < s.length()) s.erase(index, count); }
+    void          replace(char find, char with)                   { for(auto& c : s) if(c == find) c = with; }
+    void          replace(const String& find, const String& with);
+
+    String&       operator+=(const String& rhs)   { s += rhs.s; return *this; }
+    String&       operator+=(const char* rhs)     { s += rhs;   return *this; }
+    String&       operator+=(char rhs)            { s += rhs;   return *this; }
+    bool          operator==(const String& rhs) const { return s == rhs.s; }
+    bool          operator==(const char* rhs)   const { return s == rhs; }
+    bool          operator!=(const String& rhs) const { return s != rhs.s; }
+    bool          operator!=(const char* rhs)   const { return s != rhs; }
+
+    friend String operator+(const String& lhs, const String& rhs) { return String(lhs.s + rhs.s); }
+    friend String operator+(const char* lhs,   const String& rhs) { return String(lhs  + rhs.s); }
+    friend String operator+(const String& lhs, const char* rhs)   { return String(lhs.s + rhs);  }
+
+  private:
+    std::string s;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Display stand-in. Nothing is rendered; every call is counted along with the
+//  number of pixels it would have pushed to the panel.
+//  Text is assumed to be drawn with a background color, so it costs width * height.
+//  TFT_eSPI is the drawing surface shared by the panel (M5Display) and sprites.
+//
+struct Lcd_Stats {
+  uint64_t  fill_calls;       // fillRect() / fillScreen() / drawFastVLine() / drawFastHLine()
+  uint64_t  text_calls;       // drawString() / drawCentreString() / print()
+  uint64_t  push_calls;       // pushSprite() / pushImageDMA()
+  uint64_t  pixels;           // Total pixels pushed by all of the above
+};
+
+class TFT_eSPI {
+  public:
+    Lcd_Stats stats;
+
+    TFT_eSPI(int16_t w, int16_t h) : _width(w), _height(h) {}
+    virtual ~TFT_eSPI() {}
+
+    int16_t   width()  const                          { return _width; }
+    int16_t   height() const                          { return _height; }
+    void      fillScreen(uint16_t color);
+    void      fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color);
+    void      drawFastVLine(int32_t x, int32_t y, int32_t h, uint16_t color) { fillRect(x, y, 1, h, color); }
+    void      drawFastHLine(int32_t x, int32_t y, int32_t w, uint16_t color) { fillRect(x, y, w, 1, color); }
+    void      setTextColor(uint16_t fg, uint16_t bg)  { fg_color = fg; bg_color = bg; }
+    void      setTextDatum(uint8_t datum)             { text_datum = datum; }
+    void      setTextFont(uint8_t font)               { text_font = font; }
+    void      setCursor(int16_t x, int16_t y, uint8_t font) { cursor_x = x; cursor_y = y; text_font = font; }
+    int16_t   textWidth(const String& str)            { return textWidth(str.c_str(), text_font); }
+    int16_t   textWidth(const char* str)              { return textWidth(str, text_font); }
+    int16_t   textWidth(const char* str, uint8_t font);
+    int16_t   fontHeight(uint8_t font);
+    int16_t   drawString(const String& str, int32_t x, int32_t y, uint8_t font) { return drawString(str.c_str(), x, y, font); }
+    int16_t   drawString(const char* str, int32_t x, int32_t y, uint8_t font);
+    int16_t   drawCentreString(const char* str, int32_t x, int32_t y, uint8_t font);
+    size_t    print(const String& str)                { return print(str.c_str()); }
+    size_t    print(const char* str);
+
+    // DMA, as provided by TFT_eSPI 2.2 and later. The stand-in transfers synchronously.
+    bool      initDMA()                               { return true; }
+    void      startWrite()                            {}
+    void      endWrite()                              {}
+    void      dmaWait()                               {}
+    void      setSwapBytes(bool swap)                 { swap_bytes = swap; }
+    bool      getSwapBytes() const                    { return swap_bytes; }
+    void      pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data);
+
+  protected:
+    void      count_pixels(int32_t x, int32_t y, int32_t w, int32_t h);
+
+    int16_t   _width;
+    int16_t   _height;
+    uint16_t  fg_color    = WHITE;
+    uint16_t  bg_color    = BLACK;
+    uint8_t   text_datum  = TL_DATUM;
+    uint8_t   text_font   = 1;
+    int16_t   cursor_x    = 0;
+    int16_t   cursor_y    = 0;
+    bool      swap_bytes  = false;
+};
+
+class M5Display : public TFT_eSPI {
+  public:
+    M5Display() : TFT_eSPI(SIM_SCREEN_WIDTH, SIM_SCREEN_HEIGHT) {}
+
+    void      setBrightness(uint8_t level)            { brightness = level; }
+    uint8_t   brightness = 0;                       // Backlight level
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Sprite stand-in. Drawing into a sprite costs RAM bandwidth only; it is
+//  counted in the sprite's own stats. pushSprite() is counted on the panel.
+//
+class TFT_eSprite : public TFT_eSPI {
+  public:
+    TFT_eSprite(TFT_eSPI* tft) : TFT_eSPI(0, 0), tft(tft) {}
+    ~TFT_eSprite() { deleteSprite(); }
+
+    void*     createSprite(int16_t w, int16_t h);
+    void      deleteSprite();
+    bool      created() const                         { return nullptr != buffer; }
+    void      setColorDepth(int8_t bits)              {}
+    void*     getPointer()                            { return buffer; }
+    void      fillSprite(uint16_t color)              { fillRect(0, 0, _width, _height, color); }
+    void      pushSprite(int32_t x, int32_t y);
+
+  private:
+    TFT_eSPI* tft;
+    uint16_t* buffer = nullptr;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Front button stand-in. wasReleased() is true for one M5.update() after the
+//  button's letter is consumed from the keystroke script.
+//
+class Sim_Button {
+  public:
+    bool  wasReleased() const { return released; }
+    bool  released = false;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The M5 object
+//
+class Sim_M5Stack {
+  public:
+    M5Display   Lcd;
+    Sim_Button  BtnA;
+    Sim_Button  BtnB;
+    Sim_Button  BtnC;
+
+    void  begin(bool lcd = true, bool sd = true, bool serial = true, bool i2c = false) {}
+    void  update();
+};
+
+extern Sim_M5Stack M5;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  I2C stand-in for the Calculator FACE. requestFrom() pops the next keyboard
+//  character from the keystroke script.
+//
+class Sim_Wire {
+  public:
+    void    begin() {}
+    uint8_t requestFrom(int address, int quantity);
+    int     available() { return has_byte ? 1 : 0; }
+    int     read()      { has_byte = false; return rx_byte; }
+
+  private:
+    bool    has_byte = false;
+    char    rx_byte  = 0;
+};
+
+extern Sim_Wire Wire;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Serial port stand-in: output only, to stderr or the SIM_SERIAL file, unless
+//  sim_serial_pty() connects it to a pseudo-terminal, which carries both ways.
+//  It never runs out of room to write.
+//
+class Sim_Serial {
+  public:
+    void    begin(unsigned long baud) {}
+    void    setRxBufferSize(size_t size) {}
+    size_t  printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t  write(const uint8_t* data, size_t size);
+    int     availableForWrite()                       { return 4096; }
+    int     available();                            // Bytes waiting to be read
+    int     read();                                 // The next byte, or -1 if none is waiting
+
+    int     pty     = -1;                           // The pseudo-terminal's master, if connected
+
+  private:
+    FILE*   port();
+    FILE*   out     = nullptr;
+    uint8_t rx[1024];                               // Bytes read from the pty in one call, as the UART driver buffers them
+    int     rx_next = 0;
+    int     rx_end  = 0;
+};
+
+extern Sim_Serial Serial;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  ESP32 system stand-in
+//
+#define SIM_CPU_MHZ           240
+
+class Sim_ESP {
+  public:
+    uint32_t  getCycleCount();
+    uint32_t  getCpuFreqMHz()                         { return SIM_CPU_MHZ; }
+};
+
+extern Sim_ESP ESP;
+
+inline int xPortGetCoreID()                           { return 1; }   // loop() and drawing share one thread, on the input core
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Arduino runtime functions
+//
+void      pinMode(uint8_t pin, uint8_t mode);
+int       digitalRead(uint8_t pin);           // LOW while a keyboard character is waiting in the script
+int       digitalPinToInterrupt(uint8_t pin);
+void      attachInterrupt(int interrupt, void (*isr)(), int mode);  // isr runs when a keyboard character reaches the front of the script
+uint32_t  millis();
+uint32_t  micros();
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Simulation control, used by the host harness in native/
+//
+void      sim_push_keys(const char* keys);    // Queue keystrokes: FACE characters, or 'a', 'b', 'c' for the buttons
+size_t    sim_pending_keys();                 // Number of keystrokes not yet consumed
+void      sim_reset_stats();                  // Zero M5.Lcd.stats
+uint64_t  sim_heap_allocations();             // Number of malloc/calloc/realloc calls (including operator new) since startup
+const char* sim_serial_pty();                 // Connect Serial to a new raw pseudo-terminal. Return the path a host opens, or nullptr.
+bool      sim_serial_hung_up();               // True once no host has the pseudo-terminal open
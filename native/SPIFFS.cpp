@@ -0,0 +1,86 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Host stand-in for SPIFFS. See SPIFFS.h.
+//
+#include <SPIFFS.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+Sim_SPIFFS SPIFFS;
+
+static uint64_t bytes_written = 0;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File
+//
+size_t File::write(const uint8_t* data, size_t size) {
+  if(!f) return 0;
+  size_t n = fwrite(data, 1, size, f.get());
+  bytes_written += n;
+  return n;
+}
+
+size_t File::read(uint8_t* data, size_t size) {
+  return f ? fread(data, 1, size, f.get()) : 0;
+}
+
+bool File::seek(uint32_t position) {
+  return f && 0 == fseek(f.get(), position, SEEK_SET);
+}
+
+size_t File::position() const {
+  return f ? (size_t)ftell(f.get()) : 0;
+}
+
+size_t File::size() const {
+  struct stat st;
+  if(!f) return 0;
+  fflush(f.get());                          // Count bytes still in the stdio buffer
+  return 0 == fstat(fileno(f.get()), &st) ? (size_t)st.st_size : 0;
+}
+
+void File::flush() {
+  if(f) fflush(f.get());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File system: paths are mapped into the host directory
+//
+bool Sim_SPIFFS::begin(bool format_if_failed) {
+  const char* dir = getenv("SIM_FLASH_DIR");
+  root = dir ? dir : "sim_flash";
+  mkdir(root.c_str(), 0755);
+  struct stat st;
+  return 0 == stat(root.c_str(), &st) && S_ISDIR(st.st_mode);
+}
+
+std::string Sim_SPIFFS::host_path(const char* path) {
+  return root + ('/' == path[0] ? "" : "/") + path;
+}
+
+File Sim_SPIFFS::open(const char* path, const char* mode) {
+  FILE* f = fopen(host_path(path).c_str(), mode);
+  return f ? File(f) : File();
+}
+
+bool Sim_SPIFFS::exists(const char* path) {
+  struct stat st;
+  return 0 == stat(host_path(path).c_str(), &st);
+}
+
+bool Sim_SPIFFS::remove(const char* path) {
+  return 0 == ::remove(host_path(path).c_str());
+}
+
+bool Sim_SPIFFS::rename(const char* from, const char* to) {
+  return 0 == ::rename(host_path(from).c_str(), host_path(to).c_str());
+}
+
+
+uint64_t sim_flash_bytes_written() {
+  return bytes_written;
+}
@@ -0,0 +1,59 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Host stand-in for the ESP32 SPIFFS flash file system.
+//
+//  Files are ordinary files in a directory on the host: SIM_FLASH_DIR from the
+//  environment, else sim_flash in the current directory. Only the calls the
+//  calculator uses are provided, with the same names and behavior as
+//  fs::SPIFFSFS and fs::File on the ESP32.
+//  Bytes written to flash are counted, so wear can be measured.
+//
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+#include <string>
+
+#define FILE_READ             "r"
+#define FILE_WRITE            "w"
+#define FILE_APPEND           "a"
+
+
+class File {
+  public:
+    File() {}
+    File(FILE* f) : f(f, fclose) {}
+
+    size_t    write(const uint8_t* data, size_t size);
+    size_t    read(uint8_t* data, size_t size);
+    bool      seek(uint32_t position);
+    size_t    position() const;
+    size_t    size() const;
+    void      flush();
+    void      close()                         { f.reset(); }
+    operator  bool() const                    { return nullptr != f; }
+
+  private:
+    std::shared_ptr<FILE> f;
+};
+
+
+class Sim_SPIFFS {
+  public:
+    bool  begin(bool format_if_failed = false);
+    File  open(const char* path, const char* mode = FILE_READ);
+    bool  exists(const char* path);
+    bool  remove(const char* path);
+    bool  rename(const char* from, const char* to);
+
+  private:
+    std::string host_path(const char* path);
+    std::string root;
+};
+
+extern Sim_SPIFFS SPIFFS;
+
+
+uint64_t  sim_flash_bytes_written();          // Bytes written to the simulated flash since startup
@@ -0,0 +1,194 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Throughput of the serial batch protocol (serial_batch.h), over a pseudo-terminal.
+//
+//  The calculator runs its own setup() and loop(), with Serial connected to a pty.
+//  A forked host process plays the part of a PC on the other end of the USB cable:
+//  it sends random expressions as e requests, keeping BATCH_WINDOW of them in flight
+//  rather than waiting for each reply, and checks every reply against the same
+//  expression worked out with expression.h. It does this once drawing each result
+//  and once with drawing turned off (r 0), and reports requests per second. Then it
+//  does it again in each mode that gives keys other meanings, which e requests
+//  mustn't change, entering the mode and leaving it with k requests. Programmer and
+//  graph modes must show what they showed before the requests.
+//
+#include <M5Stack.h>
+#include "expression.h"
+#include "number.h"
+#include "serial_batch.h"
+#include <chrono>
+#include <deque>
+#include <fcntl.h>
+#include <poll.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BATCH_WINDOW          32            // Requests sent ahead of their replies: well inside SERIAL_BATCH_RX_BUFFER
+
+void setup();
+void loop();
+
+
+static uint32_t next_random(uint32_t& state) {
+  state ^= state << 13;  state ^= state >> 17;  state ^= state << 5;   // xorshift32
+  return state;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  A random request, "e 12.5+7*3\n", and the reply it should get.
+//
+static void make_request(uint32_t& state, std::string& request, std::string& reply) {
+  static const char ops[] = "+-*/";
+  Expression  e;
+  Decimal     value;
+  uint8_t     terms = 2 + next_random(state) % 3;
+  char        text[NUMBER_TEXT_SIZE + 4];
+  expression_clear(e);
+  request = "e ";
+  for(uint8_t i = 0; i < terms; i++) {
+    uint32_t  whole     = next_random(state) % 100000;
+    uint32_t  fraction  = next_random(state) % 100;
+    bool      point     = next_random(state) & 1;
+    value = decimal_make(point ? whole * 100LL + fraction : whole, point ? -2 : 0);
+    snprintf(text, sizeof(text), point ? "%u.%02u" : "%u", whole, fraction);
+    request += text;
+    if(i + 1 == terms) break;
+    char op = ops[next_random(state) % 4];
+    request += op;
+    expression_push(e, value, op);
+  }
+  request += '\n';
+  Decimal result = expression_evaluate(e, value);
+  Number  shown;
+  shown.set_decimal(result);
+  shown.to_text(text, locale_plain);
+  char    expect[SERIAL_BATCH_REPLY_SIZE];
+  serial_batch_reply(expect, text, result.status);
+  reply = expect;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The host: send count requests through the pty, and check the replies.
+//  Lines that aren't replies (the boot message) are skipped. Return 0 if all were right.
+//
+static bool send_all(int fd, const std::string& text) {
+  return (ssize_t)text.size() == write(fd, text.data(), text.size());
+}
+
+static int run_pass(int fd, size_t count, bool render, const char* label, uint32_t& state) {
+  std::deque<std::string> expected;
+  std::string             line, request, reply;
+  size_t                  sent = 0, received = 0;
+  char                    buffer[4096];
+
+  if(!send_all(fd, render ? "r 1\n" : "r 0\n")) return 1;
+  expected.push_back("ok\n");
+  auto start = std::chrono::steady_clock::now();
+  while(received < count + 1) {
+    while(sent < count && expected.size() < BATCH_WINDOW) {
+      make_request(state, request, reply);
+      if(!send_all(fd, request)) return 1;
+      expected.push_back(reply);
+      sent++;
+    }
+    struct pollfd p = { fd, POLLIN, 0 };
+    if(poll(&p, 1, 1000) <= 0) {
+      printf("no reply after %zu of %zu requests\n", received, count);
+      return 1;
+    }
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if(n <= 0) return 1;
+    for(ssize_t i = 0; i < n; i++) {
+      line += buffer[i];
+      if('\n' != buffer[i]) continue;
+      bool is_reply = 0 == line.compare(0, 2, "= ") || "ok\n" == line || 0 == line.compare(0, 6, "error ");
+      if(is_reply) {
+        if(line != expected.front()) {
+          printf("MISMATCH on reply %zu: got \"%.*s\", expected \"%.*s\"\n", received, (int)line.size() - 1, line.c_str(),
+                 (int)expected.front().size() - 1, expected.front().c_str());
+          return 1;
+        }
+        expected.pop_front();
+        received++;
+      }
+      line.clear();
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%-22s %10zu %12.0f\n", label, count, count / seconds);
+  return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Type keys with a k request, and wait for its reply. Return 0 once it has come.
+//
+static int type_keys(int fd, const char* keys, std::string& line) {
+  char c;
+  line.clear();
+  if(!send_all(fd, std::string("k ") + keys + "\n")) return 1;
+  for(;;) {
+    struct pollfd p = { fd, POLLIN, 0 };
+    if(poll(&p, 1, 1000) <= 0 || 1 != read(fd, &c, 1)) {
+      printf("no reply to k %s\n", keys);
+      return 1;
+    }
+    line += c;
+    if('\n' != c) continue;
+    if(0 == line.compare(0, 2, "= ")) return 0;
+    line.clear();
+  }
+}
+
+static int run_host(int fd, size_t count) {
+  static const struct { const char* label; const char* keys; bool kept; } modes[] = {
+    { "in statistics mode", "M.+", false }, { "in programmer mode", "M.-", true }, { "in graph mode", "M.*", true }
+  };
+  uint32_t    state = 2463534242u;
+  std::string before, after;
+  printf("%-22s %10s %12s\n", "results", "requests", "requests/sec");
+  int failed = run_pass(fd, count, true, "drawing", state) || run_pass(fd, count, false, "not drawing", state);
+  for(auto& mode : modes) {
+    if(failed) break;
+    failed = type_keys(fd, mode.keys, before) || run_pass(fd, count / 10 + 1, false, mode.label, state) || type_keys(fd, "", after);
+    if(!failed && mode.kept && before != after) {
+      printf("MISMATCH %s: showed \"%.*s\" before the requests, \"%.*s\" after\n", mode.label,
+             (int)before.size() - 1, before.c_str(), (int)after.size() - 1, after.c_str());
+      failed = 1;
+    }
+    failed = failed || type_keys(fd, mode.keys, after);
+  }
+  printf(failed ? "FAILED\n" : "every reply right\n");
+  fflush(stdout);
+  close(fd);
+  return failed;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Run the calculator until the host hangs up. Return 0 if every reply was right.
+//
+int benchmark_serial_batch(size_t count) {
+  const char* path = sim_serial_pty();
+  int         host = path ? open(path, O_RDWR | O_NOCTTY) : -1;   // Opened here, so the pty isn't hung up before the host starts
+  if(host < 0) {
+    fprintf(stderr, "Cannot open a pseudo-terminal\n");
+    return 1;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if(0 == pid) _exit(run_host(host, count));
+  close(host);
+  setup();
+  while(!sim_serial_hung_up()) loop();
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,539 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Host keystroke-throughput benchmark
+//
+//  Replays a keystroke script through the calculator's own setup() and loop(),
+//  one key per loop(), and reports keys/sec, per-key latency percentiles, the
+//  display traffic and frames each key causes and any heap allocations made while handling keys.
+//
+//  Usage: program [-n keys] [-b burst] [-k "keys" | -s script_file]
+//         program -a [-n operations]
+//         program -f [-n numbers]
+//         program -r trace_file [-n keys] [-v]
+//         program -p capture_file
+//         program -z [-n sequences]
+//         program -m [-n arguments]
+//         program -w [-n values]
+//         program -l [-n requests]
+//         program -i [-n values]
+//         program -g [-n points]
+//         program -d [-n numbers]
+//         program -o [-n keys]
+//    -a  Instead of replaying keys, time the four operations on Decimal against
+//        the double arithmetic they replaced (default 2000000 of each.)
+//    -f  Instead of replaying keys, time formatting results for display against
+//        the snprintf path it replaced (default 2000000 of each.)
+//    -r  Instead of a script, replay a trace the calculator recorded (trace.h): /trace.bin
+//        or /trace.old, from sim_flash or copied off an M5Stack. The calculator is put in
+//        the state the trace started from, the keys are replayed once and the screen is
+//        printed; -v prints it after every key. Then the trace is replayed from its start
+//        state for -n keys, and the latency of each stage of handling them is reported
+//        as a histogram (stage_timer.h.)
+//    -p  Instead of running the calculator, turn a capture of the profiler's serial
+//        stream (profiler.h) into folded stacks for a flame graph, on stdout.
+//    -z  Instead of replaying keys, fuzz the command state machine against the
+//        switch-based command handling it replaced (native/command_fuzz.cpp), with
+//        random sequences of up to 32 keys (default 2000000 sequences.)
+//    -m  Instead of replaying keys, check the accuracy of the scientific functions
+//        against long double libm and time them against double libm
+//        (native/scientific_check.cpp), with -n arguments per range (default 20000.)
+//    -w  Instead of replaying keys, add -n random readings to each of several batches
+//        of statistics (native/statistics_check.cpp), check the results against exact
+//        integer sums and time the additions (default 2000000 readings.)
+//    -l  Instead of a script, serve serial batch requests (serial_batch.h) over a
+//        pseudo-terminal to a forked host, which pipelines -n random expressions
+//        and checks the replies, drawing each result and then not (native/batch_host.cpp,
+//        default 20000 requests each way.)
+//    -i  Instead of replaying keys, check programmer mode's radix text and integer
+//        calculations against snprintf and a recursive-descent evaluator, and time the
+//        text against snprintf (native/programmer_check.cpp, default 2000000 values.)
+//    -g  Instead of replaying keys, plot a set of graph mode formulas at every zoom,
+//        check each point against a double-precision evaluation and time -n points
+//        each way they can be worked out (native/graph_check.cpp, default 2000000.)
+//    -d  Instead of replaying keys, check text widths against TFT_eSPI's, numbers
+//        written in each locale (format.h) against a reference grouping, and the
+//        display's widths for them, and time
+//        writing them (native/locale_check.cpp, default 200000 numbers.)
+//    -o  Instead of a script, type -n random keys, switching workspaces among them and
+//        restarting now and then, and check each workspace comes back as it was left
+//        and the text kept for it is what would be drawn afresh; then time switches
+//        from the kept text against composing and painting the screen afresh
+//        (native/workspace_check.cpp, default 200000 keys.)
+//    -n  Number of keystrokes to replay (default 2000000); the script repeats as needed.
+//    -b  Keys typed between calls to loop() (default 1). Latency is per key, averaged over the burst.
+//    -k  Keystroke script given on the command line.
+//    -s  Keystroke script read from a file. Whitespace is ignored; '#' starts a comment line.
+//  Script characters are the Calculator FACE keys (0-9 . A M % / * - + ` =)
+//  and 'a', 'b', 'c' for the front buttons. After M . a digit is a function key,
+//  + turns statistics mode on or off, - programmer mode and * graph mode.
+//
+#include <M5Stack.h>
+#include <SPIFFS.h>
+#include "key_queue.h"
+#include "format.h"
+#include "number.h"
+#include "region_buffer.h"
+#include "render_schedule.h"
+#include "retained_text.h"
+#include "serial_batch.h"
+#include "stage_timer.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+void setup();
+void loop();
+void publish_state();
+void render();
+bool restore_snapshot(const uint8_t* snapshot, uint16_t size);
+uint8_t perform_batch_request(const char* request, bool overflow, char* reply);
+int  fold_profile(const char* path);
+int  fuzz_commands(size_t count, uint32_t seed);
+int  check_scientific(size_t count);
+int  check_statistics(size_t count);
+int  benchmark_serial_batch(size_t count);
+int  check_programmer(size_t count);
+int  check_graph(size_t count);
+int  check_locales(size_t count);
+int  check_workspaces(size_t count);
+extern Retained_Text ann_memory, ann_status, acc_text;
+
+// A mix of entry, chained operations, percent, sign, memory and backspace.
+static const char* default_script = "AA12.5+7*3=M+123`%a45-6/7=MMM=AA100+7%M*8.25a=MA";
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Read a keystroke script from a file.
+//
+static bool load_script(const char* path, std::string& keys) {
+  FILE* f = fopen(path, "r");
+  if(!f) return false;
+  char line[256];
+  while(fgets(line, sizeof(line), f)) {
+    if('#' == line[0]) continue;
+    for(char* p = line; *p; p++) {
+      if(' ' != *p && '\t' != *p && '\n' != *p && '\r' != *p) keys += *p;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Return the value at the given percentile of a sorted sample.
+//
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double pct) {
+  size_t i = (size_t)(pct / 100.0 * (sorted.size() - 1));
+  return sorted[i];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Convert a Number to a double through its text, the way the calculator once did.
+//
+static double number_to_double(const Number& number) {
+  char text[NUMBER_TEXT_SIZE];
+  if(number.error) return NAN;
+  number.to_text(text, locale_plain);
+  return strtod(text, nullptr);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Set a Number from a double, the way the calculator once did.
+//  Values under 1e15 are typed in with up to six decimal places, trailing zeros trimmed.
+//  Larger values are rounded to 15 significant digits and set as a Decimal.
+//
+static void number_set_double(Number& number, double value) {
+  char  buffer[64];
+  bool  scientific = fabs(value) >= 1e15;
+
+  if(!isfinite(value)) {
+    number.set_decimal(decimal_error(DECIMAL_OVERFLOW));
+    return;
+  }
+  snprintf(buffer, sizeof(buffer), scientific ? "%.14e" : "%.6f", value);
+
+  const char* p         = buffer;
+  bool        negative  = '-' == *p;
+  if(negative) p++;
+  if(scientific) {
+    int64_t mantissa = 0;
+    for(; 'e' != *p; p++) if('.' != *p) mantissa = mantissa * 10 + (*p - '0');
+    number.set_decimal(decimal_make(negative ? -mantissa : mantissa, (int16_t)(atoi(p + 1) - 14)));
+    return;
+  }
+
+  // Trim trailing zeros after the decimal point, then the decimal point itself if nothing follows it
+  char* end = buffer + strlen(buffer);
+  while('0' == end[-1]) end--;
+  if('.' == end[-1]) end--;
+  *end = '\0';
+
+  number.clear();
+  for(; *p; p++) {
+    if('.' == *p) number.append_point();
+    else          number.append_digit(*p - '0');
+  }
+  if(negative && !number.is_clear()) number.negate();     // No "-0"
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Time + - * / on Numbers typed at the keyboard, converting to and from the
+//  number types the way the calculator does: once through Decimal, once through double.
+//
+static void arithmetic_benchmark(size_t count) {
+  static const char* values[] = { "12.5", "7", "0.1", "0.2", "123456789", "3.14159", "1000000", "0.0025", "42", "99.99" };
+  const size_t  n = sizeof(values) / sizeof(values[0]);
+  Number        numbers[n];
+  Number        result;
+
+  for(size_t i = 0; i < n; i++) {
+    numbers[i].clear();
+    for(const char* p = values[i]; *p; p++) {
+      if('.' == *p) numbers[i].append_point();
+      else          numbers[i].append_digit(*p - '0');
+    }
+  }
+
+  uint64_t a0 = sim_heap_allocations();
+  auto t0 = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < count; i++) {
+    Decimal a = numbers[i % n].to_decimal();
+    Decimal b = numbers[(i / n + 1 + i) % n].to_decimal();
+    switch(i & 3) {
+      case 0: result.set_decimal(decimal_add(a, b));      break;
+      case 1: result.set_decimal(decimal_subtract(a, b)); break;
+      case 2: result.set_decimal(decimal_multiply(a, b)); break;
+      case 3: result.set_decimal(decimal_divide(a, b));   break;
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < count; i++) {
+    double a = number_to_double(numbers[i % n]);
+    double b = number_to_double(numbers[(i / n + 1 + i) % n]);
+    switch(i & 3) {
+      case 0: number_set_double(result, a + b); break;
+      case 1: number_set_double(result, a - b); break;
+      case 2: number_set_double(result, a * b); break;
+      case 3: number_set_double(result, a / b); break;
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  uint64_t allocations = sim_heap_allocations() - a0;
+
+  printf("operations      %zu\n", count);
+  printf("decimal ops/sec %.0f\n", count / std::chrono::duration<double>(t1 - t0).count());
+  printf("double ops/sec  %.0f\n", count / std::chrono::duration<double>(t2 - t1).count());
+  printf("heap allocs     %llu\n", (unsigned long long)allocations);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Time turning results into display text: the formatter working on Decimals,
+//  against snprintf("%.6f") and trimming zeros on the same values as doubles.
+//
+static void format_benchmark(size_t count) {
+  static const int64_t mantissas[] = { 125, 7, 3, 333333333333333333LL, -142857142857142857LL, 1, 99999, -25, 123456789, 5 };
+  static const int16_t exponents[] = { -1,  0, -1, -18,                 -6,                    12, 3,   -4,  -2,        30 };
+  const size_t  n = sizeof(mantissas) / sizeof(mantissas[0]);
+  Decimal       decimals[n];
+  double        doubles[n];
+  Number        number;
+  char          text[NUMBER_TEXT_SIZE];
+  size_t        length = 0;                 // Used, so the work isn't optimized away
+
+  for(size_t i = 0; i < n; i++) {
+    decimals[i] = decimal_make(mantissas[i], exponents[i]);
+    number.set_decimal(decimals[i]);
+    doubles[i]  = number_to_double(number);
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < count; i++) {
+    const Decimal& d = decimals[i % n];
+    uint8_t len = format_fixed(text, sizeof(text), d, locale_plain);
+    if(0 == len) len = format_scientific(text, d, DECIMAL_DIGITS, locale_plain);
+    length += len;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < count; i++) {
+    number_set_double(number, doubles[i % n]);
+    number.to_text(text, locale_plain);
+    length += strlen(text);
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  printf("numbers         %zu\n", count);
+  printf("format/sec      %.0f\n", count / std::chrono::duration<double>(t1 - t0).count());
+  printf("snprintf/sec    %.0f\n", count / std::chrono::duration<double>(t2 - t1).count());
+  printf("characters      %zu\n", length);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Read a whole file.
+//
+static bool load_file(const char* path, std::vector<uint8_t>& data) {
+  FILE* f = fopen(path, "rb");
+  if(!f) return false;
+  uint8_t block[4096];
+  size_t  n;
+  while(0 < (n = fread(block, 1, sizeof(block), f))) data.insert(data.end(), block, block + n);
+  fclose(f);
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Type one key, and let loop() handle it and draw the result.
+//
+static void type_key(char key) {
+  char keys[2] = { key, 0 };
+  sim_push_keys(keys);
+  do {
+    loop();
+  } while(sim_pending_keys());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Replay the trace event keys[i]: a key, or an e request traced as 'e', its expression,
+//  then '=' (main.cpp). Return the number of events used.
+//
+static size_t replay_event(const std::string& keys, size_t i) {
+  if('e' != keys[i]) {
+    type_key(keys[i]);
+    return 1;
+  }
+  size_t end = keys.find('=', i);
+  if(std::string::npos == end) return keys.length() - i;    // Torn by a power cut
+  char request[SERIAL_BATCH_LINE_SIZE] = "e ";
+  char reply[SERIAL_BATCH_REPLY_SIZE];
+  keys.copy(request + 2, std::min(end - i - 1, sizeof(request) - 3), i + 1);
+  perform_batch_request(request, false, reply);
+  publish_state();
+  render();
+  return end + 1 - i;
+}
+
+
+static void print_screen(const char* label) {
+  printf("%-14s [%s] [%s] [%s]\n", label, ann_memory.text, ann_status.text, acc_text.text);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Print each stage's latency percentiles, then its histogram.
+//  Percentiles are bucket upper bounds, so they are within a factor of two.
+//
+static void print_stages() {
+  printf("stage                     count     mean      p50      p90      p99      max  (ns)\n");
+  for(uint8_t s = 0; s < STAGE_COUNT; s++) {
+    const Stage_Histogram& h = stage_histogram[s];
+    printf("%-22s %8u %8.0f %8u %8u %8u %8u\n", stage_name[s], h.count, h.count ? (double)h.total_ns / h.count : 0.0,
+           h.percentile(50), h.percentile(90), h.percentile(99), h.max_ns);
+  }
+  for(uint8_t s = 0; s < STAGE_COUNT; s++) {
+    const Stage_Histogram& h = stage_histogram[s];
+    if(0 == h.count) continue;
+    printf("\n%s\n", stage_name[s]);
+    for(uint8_t i = 0; i < STAGE_BUCKETS; i++) {
+      if(0 == h.bucket[i]) continue;
+      double  share = 100.0 * h.bucket[i] / h.count;
+      uint32_t low  = i ? (uint32_t)(1ULL << (i - 1)) : 0;
+      uint32_t high = i ? (uint32_t)((1ULL << i) - 1) : 0;
+      printf("  %10u - %-10u %-40s %6.2f%%\n", low, high, std::string((size_t)(share * 0.4 + 0.5), '#').c_str(), share);
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Replay a recorded trace: once to show what the calculator showed, then repeatedly
+//  to time each stage.
+//
+static int replay_trace(const char* path, size_t count, bool verbose) {
+  std::vector<uint8_t>  data;
+  Trace_Reader          reader;
+  Trace_Event           event   = { 0, 0 };
+  std::string           keys;
+  std::vector<uint32_t> times;
+  if(!load_file(path, data))                    { fprintf(stderr, "Cannot read %s\n", path); return 1; }
+  if(!reader.open(data.data(), data.size()))    { fprintf(stderr, "%s is not a trace\n", path); return 1; }
+  while(reader.next(event)) {
+    keys += event.key;
+    times.push_back(event.ms);
+  }
+
+  setup();                                  // The trace was read first: setup() starts a new one in sim_flash
+  if(!restore_snapshot(reader.snapshot, reader.snapshot_size)) { fprintf(stderr, "%s has no valid start state\n", path); return 1; }
+  publish_state();
+  render();
+  printf("keys            %zu in %.1f s\n", keys.length(), event.ms / 1000.0);
+  print_screen("start");
+  for(size_t i = 0; i < keys.length(); ) {
+    size_t used = replay_event(keys, i);
+    if(verbose) {
+      char label[16];
+      snprintf(label, sizeof(label), "%9.3f  %c", times[i] / 1000.0, keys[i]);
+      print_screen(label);
+    }
+    i += used;
+  }
+  print_screen("end");
+  if(keys.empty() || 0 == count) return 0;
+
+  stage_reset();
+  for(size_t i = 0; i < count; ) {
+    if(0 == i % keys.length()) {
+      stage_timing = false;
+      restore_snapshot(reader.snapshot, reader.snapshot_size);
+      publish_state();
+      render();
+      stage_timing = true;
+    }
+    i += replay_event(keys, i % keys.length());
+  }
+  stage_timing = false;
+  printf("\nkeys replayed   %zu\n", count);
+  print_stages();
+  return 0;
+}
+
+
+int main(int argc, char** argv) {
+  std::string keys  = default_script;
+  size_t      count = 2000000;
+  size_t      burst = 1;
+  bool        arithmetic = false;
+  bool        format     = false;
+  bool        verbose    = false;
+  bool        fuzz       = false;
+  bool        scientific = false;
+  bool        statistics = false;
+  bool        batch      = false;
+  bool        programmer = false;
+  bool        graph      = false;
+  bool        locales    = false;
+  bool        workspaces = false;
+  bool        counted    = false;
+  const char* trace      = nullptr;
+
+  for(int i = 1; i < argc; i++) {
+    if(0 == strcmp("-n", argv[i]) && i + 1 < argc) {
+      count   = strtoul(argv[++i], nullptr, 10);
+      counted = true;
+    }
+    else if(0 == strcmp("-b", argv[i]) && i + 1 < argc) burst = strtoul(argv[++i], nullptr, 10);
+    else if(0 == strcmp("-a", argv[i]))                 arithmetic = true;
+    else if(0 == strcmp("-f", argv[i]))                 format     = true;
+    else if(0 == strcmp("-v", argv[i]))                 verbose    = true;
+    else if(0 == strcmp("-z", argv[i]))                 fuzz       = true;
+    else if(0 == strcmp("-m", argv[i]))                 scientific = true;
+    else if(0 == strcmp("-w", argv[i]))                 statistics = true;
+    else if(0 == strcmp("-l", argv[i]))                 batch      = true;
+    else if(0 == strcmp("-i", argv[i]))                 programmer = true;
+    else if(0 == strcmp("-g", argv[i]))                 graph      = true;
+    else if(0 == strcmp("-d", argv[i]))                 locales    = true;
+    else if(0 == strcmp("-o", argv[i]))                 workspaces = true;
+    else if(0 == strcmp("-r", argv[i]) && i + 1 < argc) trace      = argv[++i];
+    else if(0 == strcmp("-p", argv[i]) && i + 1 < argc) return fold_profile(argv[++i]);
+    else if(0 == strcmp("-k", argv[i]) && i + 1 < argc) keys  = argv[++i];
+    else if(0 == strcmp("-s", argv[i]) && i + 1 < argc) {
+      keys.clear();
+      if(!load_script(argv[++i], keys)) { fprintf(stderr, "Cannot read %s\n", argv[i]); return 1; }
+    }
+    else { fprintf(stderr, "Usage: %s [-n keys] [-b burst] [-k \"keys\" | -s script_file] | -a | -f [-n count] | -r trace_file [-n keys] [-v] | -p capture_file | -z [-n sequences] | -m [-n arguments] | -w [-n values] | -l [-n requests] | -i [-n values] | -g [-n points] | -d [-n numbers] | -o [-n keys]\n", argv[0]); return 1; }
+  }
+  if(trace) return replay_trace(trace, count, verbose);
+  if(fuzz)  return fuzz_commands(count, (uint32_t)time(nullptr));
+  if(scientific) return check_scientific(counted ? count : 20000);
+  if(statistics) return check_statistics(count);
+  if(batch)      return benchmark_serial_batch(counted ? count : 20000);
+  if(programmer) return check_programmer(count);
+  if(graph)      return check_graph(count);
+  if(locales)    return check_locales(counted ? count : 200000);
+  if(workspaces) return check_workspaces(counted ? count : 200000);
+  if(arithmetic) {
+    arithmetic_benchmark(count);
+    return 0;
+  }
+  if(format) {
+    format_benchmark(count);
+    return 0;
+  }
+  if(keys.empty() || 0 == count || 0 == burst) { fprintf(stderr, "Nothing to replay\n"); return 1; }
+
+  auto      booting = std::chrono::steady_clock::now();
+  setup();
+  double    boot_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - booting).count();
+  Lcd_Stats boot    = M5.Lcd.stats;
+  uint64_t  flash = sim_flash_bytes_written();
+  sim_reset_stats();
+  render_counters = Render_Counters();
+
+  std::vector<uint32_t> latency;
+  latency.reserve(count / burst + 1);
+  uint64_t allocations = 0;
+  char key[2] = { 0, 0 };
+  auto start = std::chrono::steady_clock::now();
+  for(size_t i = 0; i < count; ) {
+    size_t typed = 0;
+    for(; typed < burst && i < count; typed++, i++) {
+      key[0] = keys[i % keys.length()];
+      sim_push_keys(key);
+    }
+    uint64_t a0 = sim_heap_allocations();
+    auto t0 = std::chrono::steady_clock::now();
+    do {
+      loop();                               // One front button is handled per loop(), so a burst may take several
+    } while(sim_pending_keys());
+    auto t1 = std::chrono::steady_clock::now();
+    allocations += sim_heap_allocations() - a0;
+    latency.push_back((uint32_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / typed));
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::sort(latency.begin(), latency.end());
+  const Lcd_Stats& s = M5.Lcd.stats;
+  printf("keys            %zu\n", count);
+  printf("keys/sec        %.0f\n", count / seconds);
+  printf("latency ns      p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+         percentile(latency, 50), percentile(latency, 90), percentile(latency, 99),
+         percentile(latency, 99.9), latency.back());
+  printf("pixels/key      %.1f\n", (double)s.pixels / count);
+  printf("fills/key       %.2f\n", (double)s.fill_calls / count);
+  printf("text draws/key  %.2f\n", (double)s.text_calls / count);
+  printf("pushes/key      %.2f\n", (double)s.push_calls / count);
+  printf("frames/key      %.2f  (%u frames, %u keys handled)\n", (double)render_counters.frames / count,
+         render_counters.frames, render_counters.keys);
+  printf("areas/frame     %.2f\n", render_counters.frames ? (double)render_counters.areas / render_counters.frames : 0.0);
+  printf("sprite RAM      %zu\n", region_buffer_ram_used());
+  Key_Queue_Stats q = key_queue_stats();
+  printf("keys dropped    %u\n", q.dropped);
+  printf("max queue depth %u\n", q.max_depth);
+  printf("heap allocs     %llu\n", (unsigned long long)allocations);
+  printf("flash bytes/key %.2f\n", (double)(sim_flash_bytes_written() - flash) / count);
+  printf("boot pixels     %llu\n", (unsigned long long)boot.pixels);
+  printf("boot ms         %.3f\n", boot_ms);
+  return 0;
+}
@@ -0,0 +1,275 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Differential fuzzer for the command state machine (state_machine.h).
+//
+//  Legacy_Calculator below is the command handling the transition table replaced:
+//  nested switches on memory_mode and the previous command. Random key sequences
+//  are fed to it and to the calculator's own process_command(), and after every
+//  key the two must agree on the accumulator, memory, pending expression, status,
+//  restart flag, mode and preview. The first disagreement is printed with the keys
+//  that led to it.
+//
+//  M . opens the function keys, which the switch-based handling didn't have, so
+//  the fuzzer types M = in its place.
+//
+#include "expression.h"
+#include "number.h"
+#include "state_machine.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+Calc_Command  input_to_command(char c);
+void          process_command(Calc_Command cmd, char key);
+Decimal       preview();
+extern Number         accumulator;
+extern Number         memory;
+extern Expression     expression;
+extern bool           restart;
+extern Decimal_Status status;
+extern Calc_Mode      calc_mode;
+
+// Keys, with digits more likely, as when typing
+static const char keys[] = "01234567890123456789.AM%/*-+`=";
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The command handling before the transition table, without the history tape.
+//
+struct Legacy_Calculator {
+  Number          accumulator;
+  Number          memory;
+  Expression      expression;
+  Calc_Command    previous    = NO_COMMAND;
+  bool            restart     = true;
+  bool            memory_mode = false;
+  Decimal_Status  status      = DECIMAL_OK;
+
+  Legacy_Calculator() {
+    expression_clear(expression);
+  }
+
+  static bool is_deferred_command(Calc_Command cmd) {
+    return (ADD == cmd || SUBTRACT == cmd || MULTIPLY == cmd || DIVIDE == cmd);
+  }
+
+  static char command_to_operator(Calc_Command cmd) {
+    switch(cmd) {
+      case ADD:      return '+';
+      case SUBTRACT: return '-';
+      case MULTIPLY: return '*';
+      case DIVIDE:   return '/';
+      default:       return 0;
+    }
+  }
+
+  void set_result(Number& target, const Decimal& result) {
+    target.set_decimal(result);
+    status = result.status;
+  }
+
+  void push_operator(Calc_Command cmd) {
+    char op = command_to_operator(cmd);
+    if(is_deferred_command(previous)) set_result(accumulator, expression_replace(expression, op));
+    else                              set_result(accumulator, expression_push(expression, accumulator.to_decimal(), op));
+    restart = true;
+  }
+
+  void perform_total() {
+    if(expression.depth > 0) {
+      set_result(accumulator, expression_evaluate(expression, accumulator.to_decimal()));
+      expression_clear(expression);
+    }
+    restart = true;
+  }
+
+  void perform_percentage() {
+    Decimal acc = accumulator.to_decimal();
+    Decimal pct = decimal_percent(acc);
+    char    op  = expression_operator(expression);
+    if('+' == op || '-' == op) {
+      acc = pct;
+      pct = decimal_multiply(acc, expression.value[expression.depth - 1]);
+    }
+    set_result(accumulator, pct);
+    if(op) perform_total();
+  }
+
+  void process_memory_command(Calc_Command cmd) {
+    Decimal acc = accumulator.to_decimal();
+    Decimal mem = memory.to_decimal();
+    switch(cmd) {
+      case CLEAR:    memory.clear();                                                      restart = true; break;
+      case ADD:      set_result(memory, decimal_add(mem, acc));                           restart = true; break;
+      case SUBTRACT: set_result(memory, decimal_subtract(mem, acc));                      restart = true; break;
+      case MULTIPLY: set_result(memory, decimal_multiply(mem, acc));                      restart = true; break;
+      case DIVIDE:   set_result(memory, decimal_divide(mem, acc));                        restart = true; break;
+      case PERCENT:  set_result(memory, decimal_percent(decimal_divide(mem, acc)));       restart = true; break;
+      case TOTAL:    memory = accumulator;                                                restart = true; break;
+      case MEMORY:   accumulator = memory;                                                restart = true; break;
+      default:       break;
+    }
+  }
+
+  void process_calculator_command(Calc_Command cmd) {
+    switch(cmd) {
+      case CLEAR:
+        accumulator.clear();
+        status = DECIMAL_OK;
+        if(CLEAR == previous) {
+          memory.clear();
+          expression_clear(expression);
+        }
+        return;
+      case DECIMAL:
+        if(!accumulator.has_point()) {
+          if(restart) {
+            accumulator.clear();
+            restart = false;
+          }
+          accumulator.append_point();
+        }
+        break;
+      case ADD:
+      case SUBTRACT:
+      case MULTIPLY:
+      case DIVIDE:   push_operator(cmd);                                break;
+      case MEMORY:   memory_mode = true;                                break;
+      case SIGN:     if(!accumulator.is_clear()) accumulator.negate();  break;
+      case PERCENT:  perform_percentage();                              break;
+      case TOTAL:    perform_total();                                   break;
+      default:       break;
+    }
+  }
+
+  void process_command(Calc_Command cmd) {
+    if(memory_mode) {
+      process_memory_command(cmd);
+      memory_mode = false;
+    }
+    else {
+      process_calculator_command(cmd);
+      previous = cmd;
+    }
+  }
+
+  void process_digit(uint8_t digit) {
+    previous = NO_COMMAND;
+    status   = DECIMAL_OK;
+    if(restart) accumulator.clear();
+    accumulator.append_digit(digit);
+    restart = false;
+  }
+
+  void process_key(char key) {
+    if(key >= '0' && key <= '9') process_digit((uint8_t)(key - '0'));
+    else                         process_command(input_to_command(key));
+  }
+
+  Calc_Mode mode() const {
+    if(memory_mode)                   return MODE_MEMORY;
+    if(CLEAR == previous)             return MODE_CLEARED;
+    if(is_deferred_command(previous)) return MODE_OPERATOR;
+    return MODE_READY;
+  }
+
+  Decimal preview() const {
+    Expression  pending = expression;
+    Decimal     last    = accumulator.to_decimal();
+    if(is_deferred_command(previous) && pending.depth > 0) {
+      pending.depth--;
+      last = pending.value[pending.depth];
+    }
+    return expression_evaluate(pending, last);
+  }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Comparison
+//
+//  Field by field, what pack() would store, without packing: this runs after every key.
+//
+static bool same_number(const Number& a, const Number& b) {
+  return a.length == b.length && a.point == b.point && a.negative == b.negative && a.exponent == b.exponent &&
+         a.error == b.error && 0 == memcmp(a.digits, b.digits, a.length);
+}
+
+static bool same_decimal(const Decimal& a, const Decimal& b) {
+  return a.mantissa == b.mantissa && a.exponent == b.exponent && a.negative == b.negative && a.status == b.status;
+}
+
+static const char* difference(const Legacy_Calculator& legacy) {
+  if(!same_number(accumulator, legacy.accumulator))   return "accumulator";
+  if(!same_number(memory, legacy.memory))             return "memory";
+  if(expression.depth != legacy.expression.depth)     return "expression depth";
+  for(uint8_t i = 0; i < expression.depth; i++) {
+    if(expression.op[i] != legacy.expression.op[i])   return "expression operator";
+    if(!same_decimal(expression.value[i], legacy.expression.value[i])) return "expression value";
+  }
+  if(status != legacy.status)                         return "status";
+  if(restart != legacy.restart)                       return "restart";
+  if(calc_mode != legacy.mode())                      return "mode";
+  if(!same_decimal(preview(), legacy.preview()))      return "preview";
+  return nullptr;
+}
+
+
+static void reset_calculator() {
+  accumulator.clear();
+  memory.clear();
+  expression_clear(expression);
+  restart   = true;
+  status    = DECIMAL_OK;
+  calc_mode = MODE_READY;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Run count random sequences of 1 to 32 keys, each from a fresh calculator.
+//  Return 0 if the two implementations always agreed.
+//
+int fuzz_commands(size_t count, uint32_t seed) {
+  uint32_t  state   = seed ? seed : 1;
+  size_t    typed   = 0;
+  char      sequence[33];
+  auto      start   = std::chrono::steady_clock::now();
+
+  for(size_t n = 0; n < count; n++) {
+    Legacy_Calculator legacy;
+    reset_calculator();
+    state ^= state << 13;  state ^= state >> 17;  state ^= state << 5;   // xorshift32
+    uint8_t length = 1 + state % 32;
+    for(uint8_t i = 0; i < length; i++) {
+      state ^= state << 13;  state ^= state >> 17;  state ^= state << 5;
+      char key      = keys[state % (sizeof(keys) - 1)];
+      if('.' == key && MODE_MEMORY == calc_mode) key = '=';
+      sequence[i]   = key;
+      sequence[i+1] = '\0';
+      process_command(input_to_command(key), key);
+      legacy.process_key(key);
+      const char* differs = difference(legacy);
+      if(differs) {
+        char text[NUMBER_TEXT_SIZE], legacy_text[NUMBER_TEXT_SIZE];
+        accumulator.to_text(text, locale_plain);
+        legacy.accumulator.to_text(legacy_text, locale_plain);
+        printf("MISMATCH in %s after \"%s\" (sequence %zu)\n", differs, sequence, n);
+        printf("  table:  accumulator %s  mode %d\n", text, calc_mode);
+        printf("  legacy: accumulator %s  mode %d\n", legacy_text, legacy.mode());
+        return 1;
+      }
+    }
+    typed += length;
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("sequences       %zu\n", count);
+  printf("keys            %zu\n", typed);
+  printf("sequences/sec   %.0f\n", count / seconds);
+  printf("keys/sec        %.0f\n", typed / seconds);
+  printf("mismatches      0\n");
+  return 0;
+}
@@ -0,0 +1,296 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Accuracy and speed of graph mode's plotting (graph.h).
+//
+//  Each formula below is built a token at a time, as typing it would, and plotted
+//  at every zoom. Each column's point is compared with a double-precision
+//  evaluation of the same tokens by recursive descent, at the same x, as rows of a
+//  plot GRAPH_HEIGHT rows high. A point more than a row out beyond rounding to its
+//  row, or defined when the reference isn't (or the other way about), is a failure,
+//  except where the reference itself moves by more than a row, or becomes defined
+//  or undefined, between x and the next fixed-point x: there, at an asymptote or
+//  the edge of the domain, no rounding of the result could be trusted anyway.
+//
+//  Then points are timed four ways: the compiled program, as plotted (fixed point
+//  with float for the rest); the same program in float alone; parsing the tokens
+//  again for each point, in double; and working each point out in Decimal, as the
+//  calculator works out what is typed, with expression.h and scientific.h.
+//
+#include "graph.h"
+#include "expression.h"
+#include "scientific.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK_ROWS            200           // Rows of the plot on screen: GRAPH_HEIGHT in main.cpp
+
+static const char* formulas[] = {          // Tokens, space-separated: numbers, x, + - * / ^, FUNCTION_ characters and n
+  "x",
+  "2 x q - 3 s",
+  "x s",
+  "x c 3 * + 0.5 x",
+  "x t",
+  "x l",
+  "x g",
+  "x e",
+  "x r",
+  "x i",
+  "x ^ 3 - 4 x",
+  "x ^ 0.5",
+  "2 ^ x",
+  "x q n + 100",
+  "1 / x q + 1",
+  "x s x c",
+  "x n r",
+  "0.001 x ^ 3",
+  "50000 x - 7",
+  "x ^ 2 ^ 0.5 / x",
+  "x s q + x c q",
+  "3 - x / 7 * 2 ^ 2",
+  "x i s",
+  "x l e"
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Building formulas
+//
+static Decimal parse_number(const char* text) {
+  int64_t mantissa = 0;
+  int16_t exponent = 0;
+  bool    point    = false;
+  for(; *text; text++) {
+    if('.' == *text) point = true;
+    else {
+      mantissa = mantissa * 10 + (*text - '0');
+      if(point) exponent--;
+    }
+  }
+  return decimal_make(mantissa, exponent);
+}
+
+static bool build(Graph_Formula& f, const char* spec) {
+  char copy[128];
+  strncpy(copy, spec, sizeof(copy) - 1);
+  copy[sizeof(copy) - 1] = '\0';
+  graph_clear(f);
+  for(char* token = strtok(copy, " "); token; token = strtok(nullptr, " ")) {
+    bool added = (token[0] >= '0' && token[0] <= '9') || '.' == token[0]
+               ? graph_append_number(f, parse_number(token))
+               : graph_append(f, token[0]);
+    if(!added) return false;
+  }
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Recursive descent over the tokens in double, one function per precedence level.
+//  ^ is left-associative, as the calculator's expression is.
+//
+struct Reader {
+  const Graph_Formula*  f;
+  double                x;
+  uint8_t               next;
+  uint8_t               number;
+};
+
+static double apply(char function, double v) {
+  switch(function) {
+    case GRAPH_NEGATE:          return -v;
+    case FUNCTION_SQRT:         return sqrt(v);
+    case FUNCTION_SQUARE:       return v * v;
+    case FUNCTION_RECIPROCAL:   return 1 / v;
+    case FUNCTION_LN:           return log(v);
+    case FUNCTION_LOG:          return log10(v);
+    case FUNCTION_EXP:          return exp(v);
+    case FUNCTION_SIN:          return sin(fmod(v, 360) * (M_PI / 180));
+    case FUNCTION_COS:          return cos(fmod(v, 360) * (M_PI / 180));
+    default:                    return 90 == fabs(fmod(v, 180)) ? NAN : tan(fmod(v, 360) * (M_PI / 180));
+  }
+}
+
+static double operand(Reader& r) {
+  const Graph_Formula& f = *r.f;
+  char   t = f.token[r.next++];
+  double v;
+  if(GRAPH_X == t) v = r.x;
+  else {
+    const Decimal& d = f.number[r.number++];
+    v = (double)d.mantissa * pow(10.0, d.exponent);
+    if(d.negative) v = -v;
+  }
+  while(r.next < f.length && !strchr("+-*/^", f.token[r.next])) v = apply(f.token[r.next++], v);
+  return v;
+}
+
+static double level(Reader& r, uint8_t precedence) {
+  static const char* ops[] = { "+-", "*/", "^" };
+  if(3 == precedence) return operand(r);
+  double left = level(r, precedence + 1);
+  while(r.next < r.f->length && strchr(ops[precedence], r.f->token[r.next])) {
+    char   op    = r.f->token[r.next++];
+    double right = level(r, precedence + 1);
+    switch(op) {
+      case '+': left += right;            break;
+      case '-': left -= right;            break;
+      case '*': left *= right;            break;
+      case '/': left /= right;            break;
+      default:  left = pow(left, right);  break;
+    }
+  }
+  return left;
+}
+
+static double reference(const Graph_Formula& f, double x) {
+  Reader r = { &f, x, 0, 0 };
+  return level(r, 0);
+}
+
+static double reference_row(const Graph_Window& w, double y) {
+  double row = ((double)w.y_max - y) * (CHECK_ROWS - 1) / ((double)w.y_max - w.y_min);
+  if(!(row > -1))     return -1;
+  if(row > CHECK_ROWS) return CHECK_ROWS;
+  return row;
+}
+
+static int32_t column_x(const Graph_Window& w, uint16_t column) {
+  return (int32_t)((int64_t)w.half * ((int32_t)column - GRAPH_ORIGIN) / GRAPH_ORIGIN);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The same point in Decimal: each operand through scientific_function, each
+//  operator through the expression's stack.
+//
+static Decimal decimal_point(const Graph_Formula& f, const Decimal& x) {
+  Expression e;
+  Decimal    value  = x;
+  uint8_t    number = 0;
+  expression_clear(e);
+  for(uint8_t i = 0; i < f.length; i++) {
+    char t = f.token[i];
+    if(GRAPH_X == t)                    value = x;
+    else if(GRAPH_NUMBER == t)          value = f.number[number++];
+    else if(GRAPH_NEGATE == t)          value.negative = !value.negative;
+    else if(strchr("+-*/^", t))         expression_push(e, value, t);
+    else                                value = scientific_function(t, value);
+  }
+  return expression_evaluate(e, value);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Plot every formula at every zoom. Return 0 if every point was within a row.
+//
+int check_graph(size_t count) {
+  Graph_Formula f;
+  Graph_Program p;
+  Graph_Window  w;
+  size_t        failures  = 0;
+  size_t        points    = 0;
+  size_t        skipped   = 0;
+  size_t        fixed     = 0;
+  double        worst     = 0;
+
+  printf("%-24s %8s %10s %8s\n", "formula", "points", "max rows", "fixed");
+  for(const char* spec : formulas) {
+    if(!build(f, spec) || !graph_compile(f, p)) {
+      printf("CANNOT PLOT %s\n", spec);
+      failures++;
+      continue;
+    }
+    char text[GRAPH_TEXT_SIZE];
+    graph_text(text, f, locale_plain);
+    double formula_worst = 0;
+    size_t formula_fixed = 0;
+    for(uint8_t zoom = 0; zoom < GRAPH_ZOOMS; zoom++) {
+      graph_scale(w, p, zoom);
+      if(w.fixed) formula_fixed++;
+      for(uint16_t column = 0; column < GRAPH_COLUMNS; column++) {
+        int32_t x      = column_x(w, column);
+        double  expect = reference(f, x / 65536.0);
+        double  next   = reference(f, (x + 1) / 65536.0);
+        float   y;
+        bool    defined = graph_point(p, w, column, y);
+        points++;
+        if(defined != (expect == expect)) {
+          if((next == next) == (expect == expect)) {
+            printf("MISMATCH %s at x = %.6f, zoom %u: %s, expected %g\n", text, x / 65536.0, zoom, defined ? "defined" : "undefined", expect);
+            failures++;
+          }
+          else skipped++;
+          continue;
+        }
+        if(!defined) continue;
+        double row  = reference_row(w, expect);
+        double got  = graph_row(w, y, CHECK_ROWS);
+        if(fabs(reference_row(w, next) - row) > 1) {
+          skipped++;                        // Too steep to tell
+          continue;
+        }
+        double error = fabs(got - row);
+        if(error > formula_worst) formula_worst = error;
+        if(error > 1.5 && failures < 20) {  // A row out, and rounding to the row
+          printf("MISMATCH %s at x = %.6f, zoom %u: y = %g, expected %g (row %.0f, expected %.1f)\n",
+                 text, x / 65536.0, zoom, y, expect, got, row);
+          failures++;
+        }
+      }
+    }
+    if(formula_worst > worst) worst = formula_worst;
+    fixed += formula_fixed;
+    printf("%-24s %8u %10.2f %5zu/%u\n", text, GRAPH_ZOOMS * GRAPH_COLUMNS, formula_worst, formula_fixed, GRAPH_ZOOMS);
+  }
+  printf("points %zu, %zu beside an asymptote, max error %.2f rows, %zu of %zu windows in fixed point\n",
+         points, skipped, worst, fixed, sizeof(formulas) / sizeof(formulas[0]) * GRAPH_ZOOMS);
+
+  // Times, over the formulas at the default zoom
+  const size_t n = sizeof(formulas) / sizeof(formulas[0]);
+  double  seconds[4] = { 0, 0, 0, 0 };
+  size_t  defined = 0;                      // Used, so the work isn't optimized away
+  for(size_t k = 0; k < n; k++) {
+    if(!build(f, formulas[k]) || !graph_compile(f, p)) continue;
+    graph_scale(w, p, GRAPH_ZOOM_DEFAULT);
+    Graph_Window in_float = w;
+    in_float.fixed = false;
+    size_t  each = count / n + 1;
+    float   y;
+    auto t0 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < each; i++) defined += graph_point(p, w, i % GRAPH_COLUMNS, y);
+    auto t1 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < each; i++) defined += graph_point(p, in_float, i % GRAPH_COLUMNS, y);
+    auto t2 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < each; i++) {
+      double y = reference(f, column_x(w, i % GRAPH_COLUMNS) / 65536.0);
+      defined += y == y;
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    size_t slow = each / 10 + 1;            // Decimal is slow enough that a tenth of the points time it
+    for(size_t i = 0; i < slow; i++) {
+      Decimal x = decimal_divide(decimal_make(column_x(w, i % GRAPH_COLUMNS), 0), decimal_make(65536, 0));
+      defined += !decimal_is_error(decimal_point(f, x));
+    }
+    auto t4 = std::chrono::steady_clock::now();
+    seconds[0] += std::chrono::duration<double>(t1 - t0).count();
+    seconds[1] += std::chrono::duration<double>(t2 - t1).count();
+    seconds[2] += std::chrono::duration<double>(t3 - t2).count();
+    seconds[3] += std::chrono::duration<double>(t4 - t3).count() * 10;
+  }
+  size_t timed = (count / n + 1) * n;
+  printf("%-24s %14s\n", "points worked out as", "points/sec");
+  printf("%-24s %14.0f\n", "program, fixed point",  timed / seconds[0]);
+  printf("%-24s %14.0f\n", "program, float",        timed / seconds[1]);
+  printf("%-24s %14.0f\n", "parsed, double",        timed / seconds[2]);
+  printf("%-24s %14.0f\n", "Decimal",               timed / seconds[3]);
+  printf("defined points %zu\n", defined);
+  printf(failures ? "FAILED\n" : "every point within a row\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Count heap allocations on the host.
+//
+//  glibc lets a program replace malloc() and friends; these forward to the real
+//  allocator and count each call. operator new uses malloc(), so C++ allocations
+//  (including the Arduino String stand-in) are counted too.
+//
+#include <M5Stack.h>
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void  __libc_free(void* ptr);
+
+static uint64_t heap_allocations = 0;
+
+extern "C" void* malloc(size_t size)                { heap_allocations++; return __libc_malloc(size); }
+extern "C" void* calloc(size_t count, size_t size)  { heap_allocations++; return __libc_calloc(count, size); }
+extern "C" void* realloc(void* ptr, size_t size)    { heap_allocations++; return __libc_realloc(ptr, size); }
+extern "C" void  free(void* ptr)                    { __libc_free(ptr); }
+
+uint64_t sim_heap_allocations() {
+  return heap_allocations;
+}
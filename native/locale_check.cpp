@@ -0,0 +1,215 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Digit grouping and decimal points in each locale (format.h), and the width
+//  of text in the Accumulator's fonts (glyph_width.h).
+//
+//  First, a few strings are measured, as a whole and added a character at a time,
+//  and compared with the widths TFT_eSPI's textWidth() gives them. A few values are written in every locale and compared with the text expected.
+//  Then random values, of every length and scale, are written by format_fixed()
+//  and by Number::to_text() in each locale, and compared with their plain text
+//  grouped the obvious way, with a division per digit. Number::fits() is checked
+//  against the width of the text it wrote, a pixel either side, in every font in
+//  the tables. Then writing numbers is timed in each locale against locale_plain.
+//
+#include "format.h"
+#include "number.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK_SIZE            64            // Room for any value format_fixed() is asked to write here
+
+struct Check_Locale {
+  const char*   name;
+  const Locale& locale;
+};
+
+static const Check_Locale locales[] = {
+  { "plain",    locale_plain   },
+  { "english",  locale_english },
+  { "german",   locale_german  },
+  { "french",   locale_french  },
+  { "swiss",    locale_swiss   },
+  { "indian",   locale_indian  }
+};
+#define LOCALES               (sizeof(locales) / sizeof(locales[0]))
+
+struct Exact_Case {
+  int64_t       mantissa;
+  int16_t       exponent;
+  const char*   text[LOCALES];              // In the order of locales[]
+};
+
+static const Exact_Case exact_cases[] = {
+  { 123456789, -2,  { "1234567.89", "1,234,567.89", "1.234.567,89", "1 234 567,89", "1'234'567.89", "12,34,567.89" } },
+  { -1000,     0,   { "-1000", "-1,000", "-1.000", "-1 000", "-1'000", "-1,000" } },
+  { 999,       0,   { "999", "999", "999", "999", "999", "999" } },
+  { 15,        -4,  { "0.0015", "0.0015", "0,0015", "0,0015", "0.0015", "0.0015" } },
+  { 100000,    0,   { "100000", "100,000", "100.000", "100 000", "100'000", "1,00,000" } },
+  { 12,        6,   { "12000000", "12,000,000", "12.000.000", "12 000 000", "12'000'000", "1,20,00,000" } },
+  { 123456789012LL, 0, { "123456789012", "123,456,789,012", "123.456.789.012", "123 456 789 012", "123'456'789'012", "1,23,45,67,89,012" } }
+};
+
+
+struct Width_Case {
+  const char*   text;
+  uint8_t       font;
+  int32_t       width;                      // As TFT_eSPI's textWidth() measures it, or -1 if the font is missing a glyph
+};
+
+static const Width_Case width_cases[] = {
+  { "0123456789", 2,  70 },
+  { "0123456789", 4, 140 },
+  { "0123456789", 6, 260 },
+  { "-1,234.5",   2,  44 },
+  { "-1,234.5",   4,  85 },
+  { "-1,234.5",   6,  -1 },
+  { "-12.5",      6, 108 },
+  { "1 234.5",    6, 155 },
+  { "1.5e-7",     4,  66 },
+  { "12:30 pm",   6, 200 },
+  { "FF00",       2,  26 }
+};
+
+
+static uint64_t next_random(uint64_t& state) {
+  state ^= state << 13;  state ^= state >> 7;  state ^= state << 17;   // xorshift64
+  return state;
+}
+
+// Plain text, grouped with a division per digit
+static void reference_text(char* text, const char* plain, const Locale& locale) {
+  if('-' == *plain) *text++ = *plain++;
+  size_t integers = strspn(plain, "0123456789");
+  for(size_t i = 0; i < integers; i++) {
+    size_t left = integers - i;             // Digits from here to the point
+    bool   gap  = left == locale.group || (left > locale.group && 0 == (left - locale.group) % locale.next_group);
+    if(locale.separator && i > 0 && gap) *text++ = locale.separator;
+    *text++ = plain[i];
+  }
+  for(plain += integers; *plain; plain++) *text++ = '.' == *plain ? locale.point : *plain;
+  *text = '\0';
+}
+
+// Width in font, or -1 if the font is missing a glyph
+static int32_t text_width(const char* text, uint8_t font) {
+  int32_t width = 0;
+  for(; *text; text++) {
+    uint8_t w = glyph_width(*text, font);
+    if(0 == w) return -1;
+    width += w;
+  }
+  return width;
+}
+
+
+int check_locales(size_t count) {
+  static const uint8_t fonts[] = { 2, 4, 6 };
+  uint64_t  state     = 0x2545F4914F6CDD1DULL;
+  size_t    failures  = 0;
+  char      text[CHECK_SIZE], plain[CHECK_SIZE], expect[CHECK_SIZE];
+  Number    number;
+
+  for(const Width_Case& c : width_cases) {
+    Text_Width running;
+    running.clear();
+    running.add(c.text);
+    int32_t least = c.width < 0 ? 1000 : c.width - 1;   // No room is enough for a missing glyph
+    for(int32_t room = least; room <= least + 2; room++) {
+      bool fits = c.width >= 0 && room >= c.width;
+      if(room >= 0 && (text_fits(c.text, c.font, (uint16_t)room) != fits || running.fits(c.font, (uint16_t)room) != fits)) {
+        printf("WRONG width \"%s\" in font %u: %d pixels, expected %d\n", c.text, c.font, text_width(c.text, c.font), c.width);
+        failures++;
+        break;
+      }
+    }
+  }
+  for(const Exact_Case& c : exact_cases) {
+    for(size_t k = 0; k < LOCALES; k++) {
+      format_fixed(text, sizeof(text), decimal_make(c.mantissa, c.exponent), locales[k].locale);
+      if(0 != strcmp(text, c.text[k])) {
+        printf("WRONG %s: \"%s\", expected \"%s\"\n", locales[k].name, text, c.text[k]);
+        failures++;
+      }
+    }
+  }
+  static const char* typing[] = { "1234.", "0.", "12345", "1234567.25" };
+  for(const char* typed : typing) {         // As typed, some with a trailing point
+    number.clear();
+    for(const char* p = typed; *p; p++) '.' == *p ? number.append_point() : (void)number.append_digit((uint8_t)(*p - '0'));
+    number.to_text(plain, locale_plain);
+    number.to_text(text, locale_german);
+    reference_text(expect, plain, locale_german);
+    if(0 != strcmp(plain, typed) || 0 != strcmp(text, expect)) {
+      printf("WRONG typing %s: \"%s\", \"%s\", expected \"%s\"\n", typed, plain, text, expect);
+      failures++;
+    }
+  }
+  format_scientific(text, decimal_make(125, 28), DECIMAL_DIGITS, locale_german);
+  if(0 != strcmp(text, "1,25e30")) {
+    printf("WRONG scientific german: \"%s\"\n", text);
+    failures++;
+  }
+
+  size_t checked = 0;
+  for(size_t i = 0; i < count && failures < 10; i++) {
+    uint8_t digits   = 1 + next_random(state) % DECIMAL_DIGITS;
+    int64_t mantissa = (int64_t)(next_random(state) % 1000000000000000000ULL);
+    while(decimal_count_digits((uint64_t)mantissa) > digits) mantissa /= 10;
+    if(next_random(state) & 1) mantissa = -mantissa;
+    Decimal value = decimal_make(mantissa, (int16_t)(next_random(state) % 40) - 24);
+    number.set_decimal(value);
+    for(const Check_Locale& l : locales) {
+      format_fixed(plain, sizeof(plain), value, locale_plain);
+      format_fixed(text, sizeof(text), value, l.locale);
+      reference_text(expect, plain, l.locale);
+      if(0 != strcmp(text, expect)) {
+        printf("MISMATCH format_fixed %s: \"%s\", expected \"%s\"\n", l.name, text, expect);
+        failures++;
+      }
+      number.to_text(plain, locale_plain);
+      number.to_text(text, l.locale);
+      reference_text(expect, plain, l.locale);
+      if(0 != strcmp(text, expect)) {
+        printf("MISMATCH to_text %s: \"%s\", expected \"%s\"\n", l.name, text, expect);
+        failures++;
+      }
+      for(uint8_t font : fonts) {
+        int32_t width = text_width(text, font);
+        for(int32_t room = width - 1; width >= 0 && room <= width + 1; room++) {
+          if(room >= 0 && number.fits(font, (uint16_t)room, l.locale) != (room >= width)) {
+            printf("MISMATCH fits %s: \"%s\" in font %u, %d pixels of %d\n", l.name, text, font, room, width);
+            failures++;
+          }
+        }
+        if(width < 0 && number.fits(font, 1000, l.locale)) {
+          printf("MISMATCH fits %s: \"%s\" in font %u, which has no glyph for it\n", l.name, text, font);
+          failures++;
+        }
+      }
+      checked++;
+    }
+  }
+  printf("%zu numbers checked in %zu locales\n", checked / LOCALES, LOCALES);
+
+  const size_t  n = 1024;
+  Number        numbers[n];
+  size_t        length = 0;                 // Used, so the work isn't optimized away
+  for(size_t i = 0; i < n; i++) numbers[i].set_decimal(decimal_make((int64_t)(next_random(state) % 1000000000000ULL), (int16_t)(next_random(state) % 8) - 4));
+  printf("%-10s %14s %16s\n", "locale", "to_text/sec", "format_fixed/sec");
+  for(const Check_Locale& l : locales) {
+    auto t0 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < count; i++) {
+      numbers[i % n].to_text(text, l.locale);
+      length += text[1];
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < count; i++) length += format_fixed(text, sizeof(text), numbers[i % n].to_decimal(), l.locale);
+    auto t2 = std::chrono::steady_clock::now();
+    printf("%-10s %14.0f %16.0f\n", l.name,
+           count / std::chrono::duration<double>(t1 - t0).count(), count / std::chrono::duration<double>(t2 - t1).count());
+  }
+  printf("characters %zu\n", length);
+  printf(failures ? "FAILED\n" : "every number right in every locale\n");
+  return failures ? 1 : 0;
+}
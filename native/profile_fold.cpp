@@ -0,0 +1,84 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Turn a capture of the profiler's serial stream (profiler.h) into folded stacks:
+//  one line per call path with the cycles spent in the last routine of the path,
+//  not counting the routines it called:
+//
+//    core1;process_input;push_operator 18234
+//
+//  This is the input format of flamegraph.pl and speedscope. Anything on the port
+//  that is not a valid packet is skipped. If events were dropped, the stacks in
+//  progress on that core are abandoned, as their enters and exits no longer match.
+//
+#include "profiler.h"
+#include <map>
+#include <string>
+#include <vector>
+
+struct Frame {
+  uint8_t   point;
+  uint32_t  start;
+  uint32_t  children;                       // Cycles spent in routines it called
+};
+
+
+static std::string stack_name(uint8_t core, const std::vector<Frame>& stack) {
+  std::string name = "core" + std::to_string(core);
+  for(const Frame& frame : stack) name += std::string(";") + profile_point_name[frame.point];
+  return name;
+}
+
+
+int fold_profile(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if(!f) { fprintf(stderr, "Cannot read %s\n", path); return 1; }
+  std::vector<uint8_t> data;
+  uint8_t block[4096];
+  size_t  n;
+  while(0 < (n = fread(block, 1, sizeof(block), f))) data.insert(data.end(), block, block + n);
+  fclose(f);
+
+  std::vector<Frame>              stack[PROFILE_CORES];
+  std::map<std::string, uint64_t> folded;
+  Profile_Packet                  packet;
+  size_t    packets = 0, events = 0, dropped = 0, skipped = 0, unmatched = 0;
+
+  for(size_t offset = 0; offset < data.size(); ) {
+    size_t size;
+    if(!profile_parse(data.data() + offset, data.size() - offset, packet, size)) {
+      offset++;
+      skipped++;
+      continue;
+    }
+    offset += size;
+    packets++;
+    events  += packet.count;
+    dropped += packet.dropped;
+    std::vector<Frame>& frames = stack[packet.core];
+    if(packet.dropped) frames.clear();
+
+    for(uint8_t i = 0; i < packet.count; i++) {
+      const Profile_Event& event = packet.event[i];
+      uint8_t point = event.tag & ~PROFILE_EXIT;
+      if(point >= PROFILE_POINTS) { unmatched++; continue; }
+      if(0 == (event.tag & PROFILE_EXIT)) {
+        frames.push_back({ point, event.cycles, 0 });
+        continue;
+      }
+      size_t depth = frames.size();
+      while(depth > 0 && frames[depth - 1].point != point) depth--;
+      if(0 == depth) { unmatched++; continue; }
+      unmatched += frames.size() - depth;   // Routines whose exit was lost
+      frames.resize(depth);
+      uint32_t elapsed = event.cycles - frames.back().start;
+      folded[stack_name(packet.core, frames)] += elapsed - frames.back().children;
+      frames.pop_back();
+      if(!frames.empty()) frames.back().children += elapsed;
+    }
+  }
+
+  for(const auto& line : folded) printf("%s %llu\n", line.first.c_str(), (unsigned long long)line.second);
+  fprintf(stderr, "%zu packets, %zu events, %zu dropped, %zu unmatched, %zu bytes of other output\n",
+          packets, events, dropped, unmatched, skipped);
+  return 0;
+}
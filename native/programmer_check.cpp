@@ -0,0 +1,164 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Correctness and speed of programmer mode (programmer.h).
+//
+//  Random 64 bit values, with random numbers of significant bits so short and
+//  long texts are both common, are written in each radix and compared with
+//  snprintf (and, for binary, a loop over the bits), then typed back in a digit
+//  at a time and compared with the value. Random calculations of up to
+//  PROGRAMMER_DEPTH + 2 operators are pushed one operator at a time, as the
+//  calculator does, and compared with a recursive-descent evaluation of the
+//  same tokens with C's precedence. Then formatting is timed against snprintf.
+//
+#include "programmer.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK_TERMS           (PROGRAMMER_DEPTH + 3)  // Most values in a calculation
+
+
+static uint64_t next_random(uint64_t& state) {
+  state ^= state << 13;  state ^= state >> 7;  state ^= state << 17;  // xorshift64
+  return state;
+}
+
+static int64_t random_value(uint64_t& state) {
+  uint8_t bits = next_random(state) % 65;
+  uint64_t v   = next_random(state);
+  return (int64_t)(bits ? v >> (64 - bits) : 0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  What the text should be, without tables.
+//
+static void reference_text(char* text, int64_t value, Radix radix) {
+  switch(radix) {
+    case RADIX_DECIMAL: snprintf(text, PROGRAMMER_TEXT_SIZE, "%lld", (long long)value);            return;
+    case RADIX_HEX:     snprintf(text, PROGRAMMER_TEXT_SIZE, "%llX", (unsigned long long)value);   return;
+    case RADIX_OCTAL:   snprintf(text, PROGRAMMER_TEXT_SIZE, "%llo", (unsigned long long)value);   return;
+    default: break;
+  }
+  int bit = 63;
+  while(bit > 0 && 0 == (((uint64_t)value >> bit) & 1)) bit--;
+  for(; bit >= 0; bit--) *text++ = (char)('0' + (((uint64_t)value >> bit) & 1));
+  *text = '\0';
+}
+
+static int8_t key_value(char c) {
+  return c >= 'A' ? (int8_t)(c - 'A' + 10) : (int8_t)(c - '0');
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Recursive descent over value op value op ... value, one function per precedence
+//  level, with the same wrapping arithmetic. Division by zero gives 0.
+//
+struct Tokens {
+  int64_t   value[CHECK_TERMS];
+  char      op[CHECK_TERMS];
+  uint8_t   count;                          // Values; there is one operator fewer
+  uint8_t   next;
+};
+
+static const char* levels[] = { "|", "^", "&", "<>", "+-", "*/" };
+
+static int64_t reference_apply(int64_t a, char op, int64_t b) {
+  uint64_t x = (uint64_t)a, y = (uint64_t)b;
+  switch(op) {
+    case '+': return (int64_t)(x + y);
+    case '-': return (int64_t)(x - y);
+    case '*': return (int64_t)(x * y);
+    case '/': return 0 == b ? 0 : -1 == b ? (int64_t)(0 - x) : a / b;
+    case '&': return (int64_t)(x & y);
+    case '^': return (int64_t)(x ^ y);
+    case '|': return (int64_t)(x | y);
+    case '<': return b >= 64 ? 0 : b >= 0 ? (int64_t)(x << b) : b <= -64 ? (a < 0 ? -1 : 0) : a >> -b;
+    default:  return b >= 64 ? (a < 0 ? -1 : 0) : b >= 0 ? a >> b : b <= -64 ? 0 : (int64_t)(x << -b);
+  }
+}
+
+static int64_t parse(Tokens& t, uint8_t level) {
+  if(level == sizeof(levels) / sizeof(levels[0])) return t.value[t.next++];
+  int64_t left = parse(t, level + 1);
+  while(t.next < t.count && strchr(levels[level], t.op[t.next - 1])) {
+    char op = t.op[t.next - 1];
+    left = reference_apply(left, op, parse(t, level + 1));
+  }
+  return left;
+}
+
+
+int check_programmer(size_t count) {
+  static const char ops[] = "+-*/<>&^|";
+  uint64_t  state     = 88172645463325252ULL;
+  size_t    failures  = 0;
+  char      text[PROGRAMMER_TEXT_SIZE], expect[PROGRAMMER_TEXT_SIZE];
+
+  for(size_t i = 0; i < count && failures < 10; i++) {
+    int64_t value = random_value(state);
+    if(next_random(state) & 1) value = (int64_t)(0 - (uint64_t)value);
+    for(uint8_t r = 0; r < RADIX_COUNT; r++) {
+      Radix radix = (Radix)r;
+      programmer_format(text, value, radix);
+      reference_text(expect, value, radix);
+      int64_t typed    = 0;
+      bool    negative = '-' == text[0];
+      for(const char* p = text + (negative ? 1 : 0); *p; p++) programmer_append_digit(typed, (uint8_t)key_value(*p), radix);
+      if(negative) typed = (int64_t)(0 - (uint64_t)typed);
+      if(0 != strcmp(text, expect) || typed != value) {
+        printf("MISMATCH %s %lld: \"%s\", expected \"%s\", typed back as %lld\n",
+               programmer_radix_name(radix), (long long)value, text, expect, (long long)typed);
+        failures++;
+      }
+    }
+  }
+
+  for(size_t i = 0; i < count && failures < 10; i++) {
+    Tokens                t;
+    Programmer_Expression e;
+    Decimal_Status        status = DECIMAL_OK;
+    programmer_clear(e);
+    t.count = 2 + next_random(state) % (CHECK_TERMS - 1);
+    t.next  = 0;
+    for(uint8_t k = 0; k < t.count; k++) {
+      bool shifted = k > 0 && ('<' == t.op[k - 1] || '>' == t.op[k - 1]);
+      t.op[k]    = ops[next_random(state) % (sizeof(ops) - 1)];
+      t.value[k] = shifted ? (int64_t)(next_random(state) % 80) - 8 : random_value(state);   // Counts either side of 0 - 63
+      if(k + 1 < t.count) programmer_push(e, t.value[k], t.op[k], status);
+    }
+    int64_t got      = programmer_evaluate(e, t.value[t.count - 1], status);
+    int64_t expected = parse(t, 0);
+    if(got != expected) {
+      printf("MISMATCH");
+      for(uint8_t k = 0; k < t.count; k++) printf(" %lld %c", (long long)t.value[k], k + 1 < t.count ? t.op[k] : '=');
+      printf(" %lld, expected %lld\n", (long long)got, (long long)expected);
+      failures++;
+    }
+  }
+
+  const size_t  n = 1024;
+  int64_t       values[n];
+  size_t        length = 0;                 // Used, so the work isn't optimized away
+  for(size_t i = 0; i < n; i++) values[i] = (int64_t)next_random(state);
+  printf("%-8s %14s %14s\n", "radix", "format/sec", "snprintf/sec");
+  for(uint8_t r = 0; r < RADIX_COUNT; r++) {
+    Radix radix = (Radix)r;
+    auto t0 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < count; i++) length += programmer_format(text, values[i % n], radix);
+    auto t1 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < count; i++) {
+      reference_text(text, values[i % n], radix);
+      length += text[0];
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    printf("%-8s %14.0f %14.0f\n", programmer_radix_name(radix),
+           count / std::chrono::duration<double>(t1 - t0).count(), count / std::chrono::duration<double>(t2 - t1).count());
+  }
+  printf("characters %zu\n", length);
+  printf(failures ? "FAILED\n" : "every value and calculation right\n");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Accuracy and speed of the scientific functions (scientific.h), against libm.
+//
+//  Each function is given random arguments of 15 significant digits over the
+//  ranges a user might type. The reference is the host's long double libm, which
+//  carries about 19 digits, evaluated so that it loses none of them: angles are
+//  reduced exactly in Decimal arithmetic first, and logarithms near 1 use log1p of
+//  the exact x - 1. The largest error is reported in units of the last digit kept
+//  (digit SCIENTIFIC_DIGITS); above 1 is a failure, as is a wrong answer to any of
+//  the exact cases below.
+//
+//  Times are per call on the host, next to libm's double function. On the ESP32
+//  double arithmetic is done in software, so that comparison favours libm there
+//  far less than it does here.
+//
+#include "format.h"
+#include "scientific.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+
+static const long double pi = 3.14159265358979323846264338327950288L;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers
+//
+static long double to_long_double(const Decimal& d) {
+  long double value = (long double)d.mantissa * powl(10.0L, d.exponent);
+  return d.negative ? -value : value;
+}
+
+static int compare(const Decimal& a, const Decimal& b) {
+  Decimal difference = decimal_subtract(a, b);
+  if(0 == difference.mantissa) return 0;
+  return difference.negative ? -1 : 1;
+}
+
+static uint64_t next_random(uint64_t& state) {
+  state ^= state << 13;  state ^= state >> 7;  state ^= state << 17;   // xorshift64
+  return state;
+}
+
+// A value with 15 significant digits from low to high, spread evenly or by order of magnitude
+static Decimal random_decimal(uint64_t& state, long double low, long double high, bool log_scale) {
+  long double u     = (next_random(state) >> 11) / 9007199254740992.0L;
+  long double value = log_scale ? expl(logl(low) + u * (logl(high) - logl(low))) : low + u * (high - low);
+  if(0 == value) return decimal_make(0, 0);
+  int         e     = (int)floorl(log10l(fabsl(value))) - 14;
+  return decimal_make((int64_t)llroundl(value / powl(10.0L, e)), (int16_t)e);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  References
+//
+static long double reference_trig(char function, const Decimal& degrees) {
+  Decimal full_turn = decimal_make(360, 0);
+  Decimal ninety    = decimal_make(90, 0);
+  Decimal r         = degrees;
+  r.negative        = false;
+  while(compare(r, full_turn) >= 0) r = decimal_subtract(r, full_turn);
+  int     quadrant  = 0;
+  while(compare(r, ninety) >= 0) {
+    r = decimal_subtract(r, ninety);
+    quadrant++;
+  }
+  bool complement = compare(r, decimal_make(45, 0)) > 0;
+  if(complement) r = decimal_subtract(ninety, r);
+  long double radians = to_long_double(r) * pi / 180;
+  long double s       = sinl(radians);
+  long double c       = cosl(radians);
+  if(complement) {
+    long double t = s;
+    s = c;
+    c = t;
+  }
+  long double sine, cosine;
+  switch(quadrant) {
+    case 0:  sine =  s;  cosine =  c;  break;
+    case 1:  sine =  c;  cosine = -s;  break;
+    case 2:  sine = -s;  cosine = -c;  break;
+    default: sine = -c;  cosine =  s;  break;
+  }
+  if(degrees.negative) sine = -sine;
+  if(FUNCTION_SIN == function) return sine;
+  if(FUNCTION_COS == function) return cosine;
+  return sine / cosine;
+}
+
+static long double reference_ln(const Decimal& x) {
+  if(compare(x, decimal_make(5, -1)) >= 0 && compare(x, decimal_make(2, 0)) <= 0) {
+    return log1pl(to_long_double(decimal_subtract(x, decimal_make(1, 0))));
+  }
+  return logl(to_long_double(x));
+}
+
+static long double reference(char function, const Decimal& x, const Decimal& y) {
+  switch(function) {
+    case FUNCTION_SQRT:   return sqrtl(to_long_double(x));
+    case FUNCTION_LN:     return reference_ln(x);
+    case FUNCTION_LOG:    return reference_ln(x) / logl(10.0L);
+    case FUNCTION_EXP:    return expl(to_long_double(x));
+    case FUNCTION_POWER:  return powl(to_long_double(x), to_long_double(y));
+    default:              return reference_trig(function, x);
+  }
+}
+
+static double libm(char function, double x, double y) {
+  switch(function) {
+    case FUNCTION_SQRT:   return sqrt(x);
+    case FUNCTION_LN:     return log(x);
+    case FUNCTION_LOG:    return log10(x);
+    case FUNCTION_EXP:    return exp(x);
+    case FUNCTION_POWER:  return pow(x, y);
+    case FUNCTION_SIN:    return sin(x * (M_PI / 180));
+    case FUNCTION_COS:    return cos(x * (M_PI / 180));
+    default:              return tan(x * (M_PI / 180));
+  }
+}
+
+static Decimal evaluate(char function, const Decimal& x, const Decimal& y) {
+  return FUNCTION_POWER == function ? scientific_power(x, y) : scientific_function(function, x);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The ranges tried. Angles near 0 and 90 degrees, and logarithms near 1, have
+//  ranges of their own, as they take different paths through the code.
+//
+struct Check_Range {
+  char        function;
+  const char* label;
+  long double low, high;                    // x; y for power is from -20 to 20
+  bool        log_scale;
+};
+
+static const Check_Range ranges[] = {
+  { FUNCTION_SQRT,  "sqrt",           1e-90L,   1e90L,      true  },
+  { FUNCTION_LN,    "ln",             1e-90L,   1e90L,      true  },
+  { FUNCTION_LN,    "ln near 1",      0.5L,     2.0L,       false },
+  { FUNCTION_LOG,   "log",            1e-90L,   1e90L,      true  },
+  { FUNCTION_EXP,   "exp",            -220.0L,  220.0L,     false },
+  { FUNCTION_EXP,   "exp near 0",     -1.0L,    1.0L,       false },
+  { FUNCTION_POWER, "x^y",            1e-2L,    1e2L,       true  },
+  { FUNCTION_SIN,   "sin",            -720.0L,  720.0L,     false },
+  { FUNCTION_SIN,   "sin near 0",     1e-9L,    10.0L,      true  },
+  { FUNCTION_COS,   "cos",            -720.0L,  720.0L,     false },
+  { FUNCTION_COS,   "cos near 90",    89.0L,    90.0L,      false },
+  { FUNCTION_TAN,   "tan",            -720.0L,  720.0L,     false }
+};
+
+
+struct Exact_Case {
+  char        function;
+  int64_t     x, y;                         // Whole numbers
+  int64_t     result_mantissa;
+  int16_t     result_exponent;
+  Decimal_Status status;
+};
+
+static const Exact_Case exact_cases[] = {
+  { FUNCTION_SIN,   30,   0,  5,    -1, DECIMAL_OK },
+  { FUNCTION_SIN,   -210, 0,  5,    -1, DECIMAL_OK },
+  { FUNCTION_COS,   60,   0,  5,    -1, DECIMAL_OK },
+  { FUNCTION_COS,   90,   0,  0,    0,  DECIMAL_OK },
+  { FUNCTION_TAN,   45,   0,  1,    0,  DECIMAL_OK },
+  { FUNCTION_TAN,   90,   0,  0,    0,  DECIMAL_DIVIDE_BY_ZERO },
+  { FUNCTION_SQRT,  16,   0,  4,    0,  DECIMAL_OK },
+  { FUNCTION_SQRT,  -1,   0,  0,    0,  DECIMAL_INVALID },
+  { FUNCTION_LN,    1,    0,  0,    0,  DECIMAL_OK },
+  { FUNCTION_LN,    0,    0,  0,    0,  DECIMAL_INVALID },
+  { FUNCTION_LOG,   1000, 0,  3,    0,  DECIMAL_OK },
+  { FUNCTION_EXP,   0,    0,  1,    0,  DECIMAL_OK },
+  { FUNCTION_EXP,   1000, 0,  0,    0,  DECIMAL_OVERFLOW },
+  { FUNCTION_POWER, 2,    10, 1024, 0,  DECIMAL_OK },
+  { FUNCTION_POWER, -2,   3,  -8,   0,  DECIMAL_OK },
+  { FUNCTION_POWER, 2,    -2, 25,   -2, DECIMAL_OK },
+  { FUNCTION_POWER, 0,    -1, 0,    0,  DECIMAL_DIVIDE_BY_ZERO }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Run count arguments through each range. Return 0 if every result was accurate.
+//
+int check_scientific(size_t count) {
+  uint64_t  state   = 0x9E3779B97F4A7C15ULL;
+  int       failed  = 0;
+  Decimal*  xs      = new Decimal[count];
+  Decimal*  ys      = new Decimal[count];
+  double*   dxs     = new double[count];
+  double*   dys     = new double[count];
+
+  for(const Exact_Case& c : exact_cases) {
+    Decimal x       = decimal_make(c.x, 0);
+    Decimal y       = decimal_make(c.y, 0);
+    Decimal result  = evaluate(c.function, x, y);
+    Decimal expect  = decimal_make(c.result_mantissa, c.result_exponent);
+    if(result.status != c.status || (DECIMAL_OK == c.status && 0 != compare(result, expect))) {
+      char text[FORMAT_SCIENTIFIC_SIZE];
+      format_scientific(text, result, DECIMAL_DIGITS, locale_plain);
+      printf("WRONG: %c(%lld, %lld) gave %s, status %d\n", c.function, (long long)c.x, (long long)c.y, text, result.status);
+      failed = 1;
+    }
+  }
+
+  printf("%-14s %10s %12s %10s %10s\n", "function", "arguments", "max error", "ns/call", "libm ns");
+  for(const Check_Range& range : ranges) {
+    double worst = 0;
+    for(size_t i = 0; i < count; i++) {
+      xs[i]  = random_decimal(state, range.low, range.high, range.log_scale);
+      ys[i]  = random_decimal(state, -20.0L, 20.0L, false);
+      dxs[i] = (double)to_long_double(xs[i]);
+      dys[i] = (double)to_long_double(ys[i]);
+      Decimal     result  = evaluate(range.function, xs[i], ys[i]);
+      long double expect  = reference(range.function, xs[i], ys[i]);
+      double      error;
+      if(decimal_is_error(result) || DECIMAL_UNDERFLOW == result.status) {
+        error = fabsl(expect) > 1e-99L && fabsl(expect) < 1e99L ? INFINITY : 0;
+      }
+      else if(0 == expect) {
+        error = 0 == result.mantissa ? 0 : INFINITY;
+      }
+      else {
+        long double unit = powl(10.0L, floorl(log10l(fabsl(expect))) - (SCIENTIFIC_DIGITS - 1));
+        error = (double)(fabsl(to_long_double(result) - expect) / unit);
+      }
+      if(error > worst) worst = error;
+    }
+
+    auto    start = std::chrono::steady_clock::now();
+    Decimal sink  = decimal_make(0, 0);
+    for(size_t i = 0; i < count; i++) sink = decimal_add(sink, evaluate(range.function, xs[i], ys[i]));
+    double  ours  = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+
+    start = std::chrono::steady_clock::now();
+    volatile double libm_sink = 0;
+    for(size_t i = 0; i < count; i++) libm_sink = libm_sink + libm(range.function, dxs[i], dys[i]);
+    double  theirs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+
+    printf("%-14s %10zu %12.3f %10.0f %10.1f%s\n", range.label, count, worst, ours, theirs, worst > 1 ? "  FAIL" : "");
+    if(worst > 1) failed = 1;
+  }
+
+  delete[] xs;
+  delete[] ys;
+  delete[] dxs;
+  delete[] dys;
+  if(failed) printf("FAILED\n");
+  else       printf("every result within 1 unit of digit %d\n", SCIENTIFIC_DIGITS);
+  return failed;
+}
@@ -0,0 +1,120 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Numerical stability and speed of the running statistics (statistics.h).
+//
+//  Each batch is count random readings with three decimal places, added one at a
+//  time as the calculator adds them. Readings are whole numbers of thousandths,
+//  so the exact count, sum, min and max are kept in integers alongside, and the
+//  exact mean and variance follow from the sums of the readings and their squares
+//  (taken from the batch's lowest possible reading, so they can't overflow).
+//  The batches with a large offset are the hard case: summing x and x^2 in double
+//  and subtracting at the end, shown for comparison, loses most or all of the
+//  variance there. The statistics must match to CHECK_DIGITS, one more digit than
+//  the Info area shows. The error of the mean is taken relative to the standard
+//  deviation when that is larger: a mean near zero, from readings either side of
+//  it, can't be known to more digits than the spread of the readings allows.
+//
+#include "statistics.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+
+#define CHECK_DIGITS          11            // Digits every statistic must be right to
+
+
+struct Check_Batch {
+  const char* label;
+  int64_t     low;                          // Lowest reading, in thousandths
+  int64_t     spread;                       // Readings are low to low + spread - 1 thousandths
+};
+
+static const Check_Batch batches[] = {
+  { "0 to 1000",        0,                     1000000 },
+  { "-500 to 500",      -500000,               1000000 },
+  { "1e8 + 0 to 1",     100000000000LL,        1000    },
+  { "1e12 + 0 to 0.01", 1000000000000000LL,    10      }
+};
+
+
+static long double to_long_double(const Decimal& d) {
+  long double value = (long double)d.mantissa * powl(10.0L, d.exponent);
+  return d.negative ? -value : value;
+}
+
+// Error of a statistic relative to scale, or 0 if both are zero
+static double relative_error(const Decimal& value, long double exact, long double scale) {
+  long double difference = fabsl(to_long_double(value) - exact);
+  if(0 == scale) return 0 == difference ? 0 : INFINITY;
+  return (double)(difference / scale);
+}
+
+static bool same(const Decimal& a, const Decimal& b) {
+  return 0 == decimal_subtract(a, b).mantissa;
+}
+
+static uint64_t next_random(uint64_t& state) {
+  state ^= state << 13;  state ^= state >> 7;  state ^= state << 17;   // xorshift64
+  return state;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Add count readings to each batch. Return 0 if every statistic was accurate.
+//
+int check_statistics(size_t count) {
+  uint64_t  state   = 0x9E3779B97F4A7C15ULL;
+  int       failed  = 0;
+  double    limit   = pow(10.0, -CHECK_DIGITS);
+  Decimal*  values  = new Decimal[count];
+
+  printf("%-18s %10s %10s %10s %10s %12s %12s\n", "batch", "values", "sum err", "mean err", "var err", "double var", "values/sec");
+  for(const Check_Batch& batch : batches) {
+    Statistics  stats;
+    __int128    sum       = 0;              // Of the readings less batch.low, in thousandths
+    __int128    squares   = 0;
+    int64_t     low       = INT64_MAX;
+    int64_t     high      = INT64_MIN;
+    double      naive_sum = 0;              // The textbook formula in double
+    double      naive_squares = 0;
+
+    for(size_t i = 0; i < count; i++) {
+      int64_t k = (int64_t)(next_random(state) % (uint64_t)batch.spread);
+      int64_t m = batch.low + k;
+      values[i] = decimal_make(m, -3);
+      sum      += k;
+      squares  += (__int128)k * k;
+      if(m < low)  low  = m;
+      if(m > high) high = m;
+      double x  = m / 1000.0;
+      naive_sum     += x;
+      naive_squares += x * x;
+    }
+
+    statistics_clear(stats);
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < count; i++) statistics_add(stats, values[i]);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long double n           = (long double)count;
+    long double exact_sum   = ((long double)batch.low * n + (long double)sum) / 1000;
+    long double exact_mean  = (batch.low + (long double)sum / n) / 1000;
+    long double exact_var   = (long double)((__int128)count * squares - sum * sum) / (n * (n - 1)) / 1000000;
+    double      naive_var   = (naive_squares - naive_sum * naive_sum / count) / (count - 1);
+    double      sum_error   = relative_error(stats.sum, exact_sum, fabsl(exact_sum));
+    double      mean_error  = relative_error(statistics_mean(stats), exact_mean, fmaxl(fabsl(exact_mean), sqrtl(exact_var)));
+    double      var_error   = relative_error(statistics_variance(stats), exact_var, exact_var);
+    double      naive_error = (double)(fabsl(naive_var - exact_var) / exact_var);
+    bool        exact_range = stats.count == count && same(stats.min, decimal_make(low, -3)) && same(stats.max, decimal_make(high, -3));
+    bool        bad         = !exact_range || sum_error > limit || mean_error > limit || var_error > limit;
+
+    printf("%-18s %10zu %10.1e %10.1e %10.1e %12.1e %12.0f%s\n", batch.label, count, sum_error, mean_error, var_error,
+           naive_error, count / seconds, bad ? "  FAIL" : "");
+    if(bad) failed = 1;
+  }
+
+  delete[] values;
+  if(failed) printf("FAILED\n");
+  else       printf("every statistic right to %d digits; count, min and max exact\n", CHECK_DIGITS);
+  return failed;
+}
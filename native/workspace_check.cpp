@@ -0,0 +1,183 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Switching workspaces (workspace.h), and the text kept for each one (main.cpp).
+//
+//  Random keys are typed into the calculator, with M A among them, so all three
+//  workspaces are worked in and switched between. Each workspace's accumulator is
+//  noted as it is left, and must be the same when it comes back. Now and then, and
+//  often straight after switching back to a workspace, the screen is compared with
+//  the same state composed and drawn afresh: display_frame() forgets the text kept
+//  for every workspace, and render() composes every line again. A line that differs
+//  means text kept for a workspace was shown after its state changed.
+//  Now and then the calculator is saved and restarted: the parked workspaces are
+//  cleared, as at boot, and everything read back from flash must pack to the same
+//  bytes as before (saved_state.h).
+//
+//  First, switches are timed and their drawing counted, showing each workspace's kept
+//  text, and again with the whole screen composed and painted afresh for each. On the
+//  M5Stack the pixels sent to the panel take most of the time.
+//
+#include <M5Stack.h>
+#include "retained_text.h"
+#include "workspace.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+void setup();
+void loop();
+void render();
+void display_frame();
+void accumulator_text(char* text);
+void save_state();
+void get_saved_state(Saved_State& state);
+void set_saved_state(const Saved_State& state);
+extern Retained_Text ann_memory, ann_status, acc_text, acc_split, info_line[], label_a, label_b, label_c;
+extern bool          graph_plotted;
+
+#define CHECK_TEXT_SIZE       80            // Room for accumulator_text() in any radix
+
+static const char* tokens[] = {            // Keys typed together: a memory command or function with its M
+  "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "1", "2", "5", "7", ".", "`",
+  "+", "-", "*", "/", "=", "=", "%", "A", "a", "b", "c",
+  "M+", "M-", "M*", "M/", "M%", "M=", "MM", "MA", "Mb", "Mc",
+  "M.1", "M.2", "M.4", "M.7", "M.0", "M.+", "M.-", "M..",
+  "Ma", "Ma", "Ma", "Ma"
+};
+#define TOKENS                (sizeof(tokens) / sizeof(tokens[0]))
+#define PACKED_SIZE           (SAVED_STATE_SIZE + WORKSPACE_PACKED_SIZE)
+
+
+static uint32_t next_random(uint32_t& state) {
+  state ^= state << 13;  state ^= state >> 17;  state ^= state << 5;   // xorshift32
+  return state;
+}
+
+// A key at a time: loop() handles the front buttons before the keys waiting
+static void type_keys(const char* keys) {
+  for(; *keys; keys++) {
+    char key[2] = { *keys, 0 };
+    sim_push_keys(key);
+    do {
+      loop();
+    } while(sim_pending_keys());
+  }
+}
+
+// Every line of text on the screen, with its font. A plot covers the Accumulator and Info lines.
+static std::string screen_text() {
+  const Retained_Text* lines[] = { &ann_memory, &ann_status, &label_a, &label_b, &label_c,
+                                   &acc_text, &acc_split, &info_line[0], &info_line[1], &info_line[2] };
+  std::string text;
+  for(const Retained_Text* rt : lines) {
+    if(graph_plotted && rt == &acc_text) break;
+    text += '[';
+    text += std::string(rt->text, rt->length);
+    text += rt->length ? (char)('0' + rt->font) : ' ';
+    text += ']';
+  }
+  return text;
+}
+
+// The live state and every parked workspace
+static size_t pack_everything(uint8_t* p) {
+  Saved_State state;
+  get_saved_state(state);
+  size_t size = saved_state_pack(p, state);
+  return size + workspace_pack(p + size);
+}
+
+// Return false if what is read back isn't what was saved
+static bool restart() {
+  uint8_t     before[PACKED_SIZE], after[PACKED_SIZE];
+  Saved_State state;
+  size_t      size = pack_everything(before);
+  save_state();
+  workspace_clear();                        // As setup() starts
+  if(!saved_state_load(state)) return false;
+  set_saved_state(state);
+  return size == pack_everything(after) && 0 == memcmp(before, after, size);
+}
+
+
+int check_workspaces(size_t count) {
+  uint32_t  state     = 0x9E3779B9;
+  size_t    failures  = 0;
+  size_t    compared  = 0;
+  size_t    kept      = 0;                  // Screens compared straight after switching to a workspace with kept text
+  size_t    switches  = 0;
+  size_t    restarts  = 0;
+  uint8_t   current   = 0;
+  bool      visited[WORKSPACES] = { true }; // Shown since the kept text was last forgotten
+  char      left[WORKSPACES][CHECK_TEXT_SIZE];
+  char      text[CHECK_TEXT_SIZE];
+
+  setup();
+  // A calculation in each workspace, then round and round them
+  type_keys("AAAA1234.5*6+MaAAM.-255*3+M..MaAAM.+3+4+5+Ma");
+  const size_t  rounds = count / 10 + 1;
+  double        seconds[2];
+  uint64_t      pixels[2];
+  for(int fresh = 0; fresh < 2; fresh++) {
+    sim_reset_stats();
+    auto t0 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < rounds; i++) {
+      if(fresh) display_frame();
+      type_keys("Ma");
+    }
+    seconds[fresh] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    pixels[fresh]  = M5.Lcd.stats.pixels;
+  }
+  printf("%-34s %10s %12s\n", "switches (M then A)", "us/switch", "pixels/switch");
+  printf("%-34s %10.2f %12.0f\n", "from each workspace's kept text",  seconds[0] * 1e6 / rounds, (double)pixels[0] / rounds);
+  printf("%-34s %10.2f %12.0f\n", "composed and painted afresh",      seconds[1] * 1e6 / rounds, (double)pixels[1] / rounds);
+
+  workspace_clear();                        // The one showing becomes the first, and the others are cleared
+  display_frame();
+  for(auto& t : left) strcpy(t, "0");
+  for(size_t i = 0; i < count && failures < 10; i++) {
+    size_t  token     = next_random(state) % TOKENS;
+    bool    from_kept = false;
+    accumulator_text(left[current]);
+    type_keys(tokens[token]);
+    if(current != workspace_current()) {    // Not after M B or C with nothing to take, which stays in memory mode
+      uint8_t to = (current + 1) % WORKSPACES;
+      accumulator_text(text);
+      if(to != workspace_current() || 0 == strchr(tokens[token], 'a') || 0 != strcmp(text, left[to])) {
+        printf("MISMATCH switching to workspace %u after %zu keys: workspace %u showing %s, left as %s\n", to + 1, i, workspace_current() + 1, text, left[to]);
+        failures++;
+      }
+      current   = workspace_current();
+      from_kept = visited[current];
+      visited[current] = true;
+      switches++;
+    }
+    if(0 == next_random(state) % (from_kept ? 2 : 32)) {
+      std::string shown = screen_text();
+      display_frame();
+      render();
+      std::string fresh = screen_text();
+      compared++;
+      if(from_kept) kept++;
+      if(shown != fresh) {
+        printf("MISMATCH screen after %zu keys, token %s in workspace %u:\n  shown %s\n  fresh %s\n", i, tokens[token], current + 1, shown.c_str(), fresh.c_str());
+        failures++;
+      }
+      for(bool& v : visited) v = false;
+      visited[current] = true;
+    }
+    if(0 == next_random(state) % 256) {
+      restarts++;
+      if(!restart()) {
+        printf("MISMATCH restarting after %zu keys, token %s in workspace %u: not restored as saved\n", i, tokens[token], current + 1);
+        failures++;
+      }
+    }
+  }
+  printf("%zu tokens, %zu switches, %zu screens compared, %zu of them just switched to from kept text, %zu restarts\n",
+         count, switches, compared, kept, restarts);
+
+  printf(failures ? "FAILED\n" : "every workspace and screen right\n");
+  return failures ? 1 : 0;
+}
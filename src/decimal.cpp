@@ -0,0 +1,337 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Decimal: exact decimal arithmetic on 64 bit integers. See decimal.h.
+//
+#include "decimal.h"
+
+static const uint64_t powers_of_ten[20] = {
+  1ULL,                   10ULL,                  100ULL,                 1000ULL,
+  10000ULL,               100000ULL,              1000000ULL,             10000000ULL,
+  100000000ULL,           1000000000ULL,          10000000000ULL,         100000000000ULL,
+  1000000000000ULL,       10000000000000ULL,      100000000000000ULL,     1000000000000000ULL,
+  10000000000000000ULL,   100000000000000000ULL,  1000000000000000000ULL, 10000000000000000000ULL
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Wide: a 128 bit unsigned integer, for results that don't fit in 64 bits.
+//  Only the handful of operations the Decimal routines need are provided.
+//
+struct Wide {
+  uint64_t  hi;
+  uint64_t  lo;
+};
+
+static Wide wide(uint64_t value) {
+  Wide w = { 0, value };
+  return w;
+}
+
+static bool wide_is_zero(const Wide& w) {
+  return 0 == w.hi && 0 == w.lo;
+}
+
+static int wide_compare(const Wide& a, const Wide& b) {
+  if(a.hi != b.hi) return a.hi < b.hi ? -1 : 1;
+  if(a.lo != b.lo) return a.lo < b.lo ? -1 : 1;
+  return 0;
+}
+
+static Wide wide_add(const Wide& a, const Wide& b) {
+  Wide r;
+  r.lo = a.lo + b.lo;
+  r.hi = a.hi + b.hi + (r.lo < a.lo ? 1 : 0);
+  return r;
+}
+
+// a - b, where a >= b
+static Wide wide_subtract(const Wide& a, const Wide& b) {
+  Wide r;
+  r.lo = a.lo - b.lo;
+  r.hi = a.hi - b.hi - (a.lo < b.lo ? 1 : 0);
+  return r;
+}
+
+// Full 64 x 64 -> 128 bit product, from 32 x 32 bit partial products
+static Wide wide_multiply(uint64_t a, uint64_t b) {
+  uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+  uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+  uint64_t p0   = a_lo * b_lo;
+  uint64_t p1   = a_lo * b_hi;
+  uint64_t p2   = a_hi * b_lo;
+  uint64_t p3   = a_hi * b_hi;
+  uint64_t mid  = (p0 >> 32) + (uint32_t)p1 + (uint32_t)p2;
+  Wide r;
+  r.lo = (mid << 32) | (uint32_t)p0;
+  r.hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+  return r;
+}
+
+// w * m. The caller guarantees the product fits in 128 bits.
+static Wide wide_scale(const Wide& w, uint64_t m) {
+  Wide r  = wide_multiply(w.lo, m);
+  r.hi   += w.hi * m;
+  return r;
+}
+
+// Divide w by a 32 bit divisor in place, one 32 bit limb at a time. Return the remainder.
+static uint32_t wide_divide_small(Wide& w, uint32_t divisor) {
+  uint32_t  limb[4] = { (uint32_t)(w.hi >> 32), (uint32_t)w.hi, (uint32_t)(w.lo >> 32), (uint32_t)w.lo };
+  uint64_t  rem     = 0;
+  for(int i = 0; i < 4; i++) {
+    uint64_t cur = (rem << 32) | limb[i];
+    limb[i] = (uint32_t)(cur / divisor);
+    rem     = cur % divisor;
+  }
+  w.hi = ((uint64_t)limb[0] << 32) | limb[1];
+  w.lo = ((uint64_t)limb[2] << 32) | limb[3];
+  return (uint32_t)rem;
+}
+
+// Divide n by a 64 bit divisor: binary long division
+static Wide wide_divide(const Wide& n, uint64_t divisor) {
+  Wide      q = { 0, 0 };
+  uint64_t  r = 0;
+  for(int i = 127; i >= 0; i--) {
+    uint64_t  bit   = i >= 64 ? (n.hi >> (i - 64)) & 1 : (n.lo >> i) & 1;
+    bool      carry = 0 != (r >> 63);
+    r = (r << 1) | bit;
+    if(carry || r >= divisor) {
+      r -= divisor;
+      if(i >= 64) q.hi |= 1ULL << (i - 64);
+      else        q.lo |= 1ULL << i;
+    }
+  }
+  return q;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Count the decimal digits in a value.
+//
+uint8_t decimal_count_digits(uint64_t value) {
+  uint8_t digits = 1;
+  while(digits < 20 && value >= powers_of_ten[digits]) digits++;
+  return digits;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Zero, with a status
+//
+static Decimal decimal_zero(Decimal_Status status) {
+  Decimal d = { 0, 0, false, status };
+  return d;
+}
+
+Decimal decimal_error(Decimal_Status status) {
+  return decimal_zero(status);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Strip trailing zeros and check the result is in range.
+//
+static Decimal decimal_normalize(uint64_t mantissa, int32_t exponent, bool negative) {
+  if(0 == mantissa) return decimal_zero(DECIMAL_OK);
+  while(0 == mantissa % 10) {
+    mantissa /= 10;
+    exponent++;
+  }
+  int32_t magnitude = exponent + decimal_count_digits(mantissa) - 1;
+  if(magnitude >  DECIMAL_MAX_EXPONENT) return decimal_error(DECIMAL_OVERFLOW);
+  if(magnitude < -DECIMAL_MAX_EXPONENT) return decimal_zero(DECIMAL_UNDERFLOW);
+  Decimal d = { mantissa, (int16_t)exponent, negative, DECIMAL_OK };
+  return d;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Round a wide result half-up to DECIMAL_DIGITS digits, then normalize it.
+//  Results that already fit (the usual case) skip straight to normalizing.
+//
+static Decimal decimal_round(Wide m, int32_t exponent, bool negative) {
+  if(0 != m.hi || m.lo >= powers_of_ten[DECIMAL_DIGITS]) {
+    uint32_t dropped = 0;                   // The most significant digit dropped decides the rounding
+    while(0 != m.hi || m.lo >= powers_of_ten[DECIMAL_DIGITS]) {
+      dropped = wide_divide_small(m, 10);
+      exponent++;
+    }
+    if(dropped >= 5 && powers_of_ten[DECIMAL_DIGITS] == ++m.lo) {
+      m.lo = powers_of_ten[DECIMAL_DIGITS - 1];     // Rounded up to 10^DECIMAL_DIGITS
+      exponent++;
+    }
+  }
+  return decimal_normalize(m.lo, exponent, negative);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Make a Decimal from an integer and a power of ten.
+//
+Decimal decimal_make(int64_t mantissa, int16_t exponent) {
+  bool      negative  = mantissa < 0;
+  uint64_t  magnitude = negative ? 0 - (uint64_t)mantissa : (uint64_t)mantissa;
+  return decimal_round(wide(magnitude), exponent, negative);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Addition.
+//  Equal exponents (integers, or numbers with the same decimals) add in 64 bits.
+//  Otherwise the operand with the larger exponent is scaled up in 128 bits to line
+//  up the decimal points; digits of the other operand beyond 37 digits of precision only
+//  affect rounding.
+//
+Decimal decimal_add(const Decimal& a, const Decimal& b) {
+  if(decimal_is_error(a)) return a;
+  if(decimal_is_error(b)) return b;
+  if(0 == b.mantissa) return decimal_normalize(a.mantissa, a.exponent, a.negative);
+  if(0 == a.mantissa) return decimal_normalize(b.mantissa, b.exponent, b.negative);
+
+  const Decimal&  high     = a.exponent >= b.exponent ? a : b;
+  const Decimal&  low      = a.exponent >= b.exponent ? b : a;
+  int32_t         exponent = high.exponent;
+  int32_t         diff     = high.exponent - low.exponent;
+  Wide            x        = wide(high.mantissa);
+  Wide            y        = wide(low.mantissa);
+
+  if(0 != diff) {
+    int32_t step = diff > 19 ? 19 : diff;   // x has at most 18 digits; 10^19 more still fits in 128 bits
+    x         = wide_scale(x, powers_of_ten[step]);
+    exponent -= step;
+    diff     -= step;
+    if(diff > 0) {
+      // y has digits below x's last digit. Keep y's digits that line up, plus one
+      // guard digit that is 1 if any were dropped, so the final rounding comes out right.
+      uint64_t kept   = 0;
+      bool     sticky = true;
+      if(diff <= 19) {
+        kept   = low.mantissa / powers_of_ten[diff];
+        sticky = 0 != low.mantissa % powers_of_ten[diff];
+      }
+      x         = wide_scale(x, 10);
+      y         = wide(kept * 10 + (sticky ? 1 : 0));
+      exponent -= 1;
+    }
+  }
+
+  if(high.negative == low.negative) {
+    return decimal_round(wide_add(x, y), exponent, high.negative);
+  }
+  int cmp = wide_compare(x, y);
+  if(0 == cmp) return decimal_zero(DECIMAL_OK);
+  return cmp > 0 ? decimal_round(wide_subtract(x, y), exponent, high.negative)
+                 : decimal_round(wide_subtract(y, x), exponent, low.negative);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Subtraction: add the negation.
+//
+Decimal decimal_subtract(const Decimal& a, const Decimal& b) {
+  Decimal neg = b;
+  neg.negative = !b.negative;
+  return decimal_add(a, neg);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Multiplication. The product is exact in 64 bits when it fits, else in 128.
+//
+Decimal decimal_multiply(const Decimal& a, const Decimal& b) {
+  if(decimal_is_error(a)) return a;
+  if(decimal_is_error(b)) return b;
+  if(0 == a.mantissa || 0 == b.mantissa) return decimal_zero(DECIMAL_OK);
+  uint64_t product;
+  Wide     w = __builtin_mul_overflow(a.mantissa, b.mantissa, &product) ? wide_multiply(a.mantissa, b.mantissa) : wide(product);
+  return decimal_round(w, (int32_t)a.exponent + b.exponent, a.negative != b.negative);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Division. Exact quotients are found in 64 bits.
+//  Otherwise the dividend is scaled up in 128 bits so the quotient has one more
+//  digit than DECIMAL_DIGITS, for rounding.
+//
+Decimal decimal_divide(const Decimal& a, const Decimal& b) {
+  if(decimal_is_error(a)) return a;
+  if(decimal_is_error(b)) return b;
+  if(0 == b.mantissa) return decimal_error(DECIMAL_DIVIDE_BY_ZERO);
+  if(0 == a.mantissa) return decimal_zero(DECIMAL_OK);
+
+  bool    negative = a.negative != b.negative;
+  int32_t exponent = (int32_t)a.exponent - b.exponent;
+  if(0 == a.mantissa % b.mantissa) {
+    return decimal_round(wide(a.mantissa / b.mantissa), exponent, negative);
+  }
+
+  int32_t scale = DECIMAL_DIGITS + 1 + decimal_count_digits(b.mantissa) - decimal_count_digits(a.mantissa);
+  Wide    n     = wide(a.mantissa);
+  exponent -= scale;
+  while(scale > 0) {
+    int32_t step = scale > 19 ? 19 : scale;
+    n      = wide_scale(n, powers_of_ten[step]);
+    scale -= step;
+  }
+  Wide q = wide_divide(n, b.mantissa);
+  if(wide_is_zero(q)) return decimal_zero(DECIMAL_UNDERFLOW);
+  return decimal_round(q, exponent, negative);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Percent: move the decimal point two places.
+//
+Decimal decimal_percent(const Decimal& a) {
+  if(decimal_is_error(a)) return a;
+  return decimal_normalize(a.mantissa, (int32_t)a.exponent - 2, a.negative);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Round to fewer significant digits, for results only that many digits of are known.
+//
+Decimal decimal_round_to(const Decimal& a, uint8_t digits) {
+  if(decimal_is_error(a)) return a;
+  uint8_t count = decimal_count_digits(a.mantissa);
+  if(count <= digits) return a;
+  uint64_t  scale     = powers_of_ten[count - digits];
+  uint64_t  mantissa  = a.mantissa / scale + (a.mantissa % scale >= scale / 2 ? 1 : 0);
+  return decimal_normalize(mantissa, (int32_t)a.exponent + count - digits, a.negative);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Packed form, for records in flash. Little-endian:
+//  mantissa (8), exponent (2), sign (bit 7) and Decimal_Status (bits 0-6) (1)
+//
+void decimal_pack(uint8_t* p, const Decimal& value) {
+  for(uint8_t i = 0; i < 8; i++) p[i] = (uint8_t)(value.mantissa >> (8 * i));
+  p[8]  = (uint8_t)value.exponent;
+  p[9]  = (uint8_t)((uint16_t)value.exponent >> 8);
+  p[10] = (uint8_t)((value.negative ? 0x80 : 0) | value.status);
+}
+
+Decimal decimal_unpack(const uint8_t* p) {
+  Decimal value;
+  value.mantissa = 0;
+  for(uint8_t i = 0; i < 8; i++) value.mantissa |= (uint64_t)p[i] << (8 * i);
+  value.exponent = (int16_t)(p[8] | (p[9] << 8));
+  value.negative = 0 != (p[10] & 0x80);
+  value.status   = (Decimal_Status)(p[10] & 0x7F);
+  return value;
+}
@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Decimal: exact decimal arithmetic without soft-float doubles.
+//
+//  A Decimal is a 64 bit integer mantissa of at most DECIMAL_DIGITS digits, scaled
+//  by a power of ten. 0.1 + 0.2 is exactly 0.3, and integers up to 18 digits are exact.
+//  Operations run on 64 bit integers when the result fits, and fall back to 128 bit
+//  intermediates (built from 32 bit limbs, which the ESP32 has in hardware) when it
+//  doesn't; results are then rounded half-up to DECIMAL_DIGITS significant digits.
+//
+//  Results whose magnitude is outside 1e-99 .. 1e99 overflow (an error) or underflow
+//  (to zero). Errors propagate through later operations.
+//
+#pragma once
+
+#include <stdint.h>
+
+#define DECIMAL_DIGITS        18            // Significant digits kept in a result
+#define DECIMAL_MAX_EXPONENT  99            // Largest power of ten a result may reach
+#define DECIMAL_PACKED_SIZE   11            // Bytes written by decimal_pack()
+
+
+enum Decimal_Status : uint8_t {
+  DECIMAL_OK,                               // A normal value
+  DECIMAL_UNDERFLOW,                        // The result was too small and became zero. Zero can still be used.
+  DECIMAL_OVERFLOW,                         // Error: the result was too large
+  DECIMAL_DIVIDE_BY_ZERO,                   // Error: division by zero
+  DECIMAL_INVALID                           // Error: an operand was not a number
+};
+
+
+struct Decimal {
+  uint64_t        mantissa;                 // At most DECIMAL_DIGITS digits, no trailing zeros (except for zero itself)
+  int16_t         exponent;                 // value = mantissa * 10^exponent
+  bool            negative;
+  Decimal_Status  status;
+};
+
+
+inline bool decimal_is_error(const Decimal& d) { return d.status >= DECIMAL_OVERFLOW; }
+
+Decimal decimal_make(int64_t mantissa, int16_t exponent);   // mantissa * 10^exponent, normalized
+Decimal decimal_error(Decimal_Status status);               // A value that is an error
+Decimal decimal_add(const Decimal& a, const Decimal& b);
+Decimal decimal_subtract(const Decimal& a, const Decimal& b);
+Decimal decimal_multiply(const Decimal& a, const Decimal& b);
+Decimal decimal_divide(const Decimal& a, const Decimal& b);
+Decimal decimal_percent(const Decimal& a);                  // a / 100, exactly
+Decimal decimal_round_to(const Decimal& a, uint8_t digits); // Rounded half-up to at most digits significant digits
+uint8_t decimal_count_digits(uint64_t value);               // Number of decimal digits in value (1 for 0)
+void    decimal_pack(uint8_t* p, const Decimal& value);     // Store in DECIMAL_PACKED_SIZE bytes, for flash
+Decimal decimal_unpack(const uint8_t* p);
@@ -0,0 +1,84 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Expression: incremental operator-precedence evaluation. See expression.h.
+//
+#include "expression.h"
+#include "scientific.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Operator helpers
+//
+static uint8_t precedence(char op) {
+  if('^' == op)               return 3;
+  if('*' == op || '/' == op)  return 2;
+  return 1;
+}
+
+static Decimal apply(const Decimal& left, char op, const Decimal& right, Expression_Listener listener) {
+  Decimal result;
+  switch(op) {
+    case '+': result = decimal_add(left, right);          break;
+    case '-': result = decimal_subtract(left, right);     break;
+    case '*': result = decimal_multiply(left, right);     break;
+    case '^': result = scientific_power(left, right);     break;
+    default:  result = decimal_divide(left, right);       break;
+  }
+  if(listener) listener(left, op, right, result);
+  return result;
+}
+
+
+void expression_clear(Expression& e) {
+  e.depth = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Add a number and the operator after it. Work out the pending operators that
+//  bind at least as tightly as the new one first (they are all at the top of the stack.)
+//
+Decimal expression_push(Expression& e, const Decimal& value, char op, Expression_Listener listener) {
+  Decimal left = value;
+  while(e.depth > 0 && precedence(e.op[e.depth - 1]) >= precedence(op)) {
+    e.depth--;
+    left = apply(e.value[e.depth], e.op[e.depth], left, listener);
+  }
+  e.value[e.depth]  = left;
+  e.op[e.depth]     = op;
+  e.depth++;
+  return left;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The user pressed another operator straight after the last one: use the new one instead.
+//  Changing to a lower precedence may mean work that was waiting can be done now.
+//
+Decimal expression_replace(Expression& e, char op, Expression_Listener listener) {
+  if(0 == e.depth) return decimal_make(0, 0);
+  e.depth--;
+  return expression_push(e, e.value[e.depth], op, listener);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Work out every pending operator, from the top of the stack down.
+//  The expression is unchanged, so this can be called after every key for a preview.
+//
+Decimal expression_evaluate(const Expression& e, const Decimal& last, Expression_Listener listener) {
+  Decimal right = last;
+  for(uint8_t i = e.depth; i > 0; i--) {
+    right = apply(e.value[i - 1], e.op[i - 1], right, listener);
+  }
+  return right;
+}
+
+
+char expression_operator(const Expression& e) {
+  return e.depth > 0 ? e.op[e.depth - 1] : 0;
+}
@@ -0,0 +1,37 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Expression: the calculation typed so far, evaluated with operator precedence,
+//  so 10 + 4 * 2 = 18.
+//
+//  This is the shunting-yard algorithm, run one key at a time. Each operator key
+//  pushes the number before it and the operator. First, any pending operators of
+//  equal or higher precedence are worked out. So the stack only ever holds operators
+//  of strictly increasing precedence: at most one per precedence level.
+//  Pushing, and evaluating the whole expression for a preview, therefore take
+//  constant time, however long the calculation gets.
+//
+//  Operators are the keys: '+', '-', '*' and '/', and '^' (x to the y) from the function keys.
+//  A listener, if given, is told about each operation as it is worked out.
+//
+#pragma once
+
+#include "decimal.h"
+
+#define EXPRESSION_DEPTH      3             // Pending operators: one per precedence level
+
+
+struct Expression {
+  Decimal   value[EXPRESSION_DEPTH];        // value[i] is the left side of op[i]
+  char      op[EXPRESSION_DEPTH];
+  uint8_t   depth;                          // Number of pending operators
+};
+
+
+typedef void (*Expression_Listener)(const Decimal& left, char op, const Decimal& right, const Decimal& result);
+
+
+void    expression_clear(Expression& e);
+Decimal expression_push(Expression& e, const Decimal& value, char op, Expression_Listener listener = nullptr);  // Return the new left side of op
+Decimal expression_replace(Expression& e, char op, Expression_Listener listener = nullptr);   // Change the last operator. Return as for push.
+Decimal expression_evaluate(const Expression& e, const Decimal& last, Expression_Listener listener = nullptr);  // The value if last completes the expression
+char    expression_operator(const Expression& e);                       // The last operator, or 0 if none is pending
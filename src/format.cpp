@@ -0,0 +1,172 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Format: number to text conversion. See format.h.
+//
+#include "format.h"
+#include <string.h>
+
+static const char digit_pairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Write the digits of value, most significant first.
+//  They are generated from the right, two per division, into a scratch buffer.
+//
+uint8_t format_digits(char* text, uint64_t value) {
+  char      buffer[20];
+  char*     p = buffer + sizeof(buffer);
+  while(value >= 100) {
+    uint32_t pair = (uint32_t)(value % 100) * 2;
+    value /= 100;
+    *--p = digit_pairs[pair + 1];
+    *--p = digit_pairs[pair];
+  }
+  if(value >= 10) {
+    *--p = digit_pairs[value * 2 + 1];
+    *--p = digit_pairs[value * 2];
+  }
+  else {
+    *--p = (char)('0' + value);
+  }
+  uint8_t n = (uint8_t)(buffer + sizeof(buffer) - p);
+  memcpy(text, p, n);
+  text[n] = '\0';
+  return n;
+}
+
+
+uint8_t format_integer(char* text, int32_t value) {
+  if(value >= 0) return format_digits(text, (uint64_t)value);
+  *text = '-';
+  return 1 + format_digits(text + 1, (uint64_t)(-(int64_t)value));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Write the digits before the point, with a separator between groups: a count
+//  down of the digits left in the group, rather than a division per digit.
+//  The first group is whatever is left over, so it may be short.
+//
+char* format_grouped(char* p, const char* digits, uint8_t n, uint8_t integers, const Locale& locale) {
+  int32_t separators  = format_separators(integers, locale);
+  int32_t left        = integers - (separators ? locale.group + (separators - 1) * locale.next_group : 0);
+  for(uint8_t i = 0; i < integers; i++) {
+    if(0 == left) {
+      *p++  = locale.separator;
+      left  = --separators ? locale.next_group : locale.group;
+    }
+    *p++ = i < n ? digits[i] : '0';
+    left--;
+  }
+  return p;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Write the value with plain digits, grouped: "1,200", "12.5", "0.0015".
+//  The length is known before anything is written, so a value that won't fit
+//  costs no more than the check.
+//
+uint8_t format_fixed(char* text, uint8_t size, const Decimal& value, const Locale& locale) {
+  char      mantissa[20];
+  char*     p         = text;
+  uint8_t   n         = format_digits(mantissa, value.mantissa);
+  int32_t   integers  = n + value.exponent;           // Digits before the decimal point
+  int32_t   length    = value.negative ? 1 : 0;
+  int32_t   i;
+
+  if(decimal_is_error(value)) {
+    if(size < 6) return 0;
+    strcpy(text, "Error");
+    return 5;
+  }
+  if(value.exponent >= 0) length += integers;         // 1200
+  else if(integers > 0)   length += n + 1;            // 12.5
+  else                    length += 2 - integers + n; // 0.0015
+  if(integers > 0)        length += format_separators(integers, locale);
+  if(length >= size) return 0;
+
+  if(value.negative) *p++ = '-';
+  if(value.exponent >= 0) {
+    p = format_grouped(p, mantissa, n, (uint8_t)integers, locale);
+  }
+  else if(integers > 0) {
+    p = format_grouped(p, mantissa, (uint8_t)integers, (uint8_t)integers, locale);
+    *p++ = locale.point;
+    memcpy(p, mantissa + integers, n - integers);
+    p += n - integers;
+  }
+  else {
+    *p++ = '0';
+    *p++ = locale.point;
+    for(i = 0; i < -integers; i++) *p++ = '0';
+    memcpy(p, mantissa, n);
+    p += n;
+  }
+  *p = '\0';
+  return (uint8_t)length;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Write the value as a mantissa with one digit before the decimal point, and a
+//  power of ten: "1.25e30", "-5e-7". Zero is "0".
+//
+uint8_t format_scientific(char* text, const Decimal& value, uint8_t digits, const Locale& locale) {
+  uint64_t  mantissa  = value.mantissa;
+  char*     p         = text;
+  if(decimal_is_error(value)) {
+    strcpy(text, "Error");
+    return 5;
+  }
+  if(0 == mantissa) {
+    strcpy(text, "0");
+    return 1;
+  }
+  if(digits < 1) digits = 1;
+
+  uint8_t   n         = decimal_count_digits(mantissa);
+  int32_t   exponent  = n - 1 + value.exponent;       // Of the first digit
+  if(n > digits) {
+    uint32_t dropped = 0;                             // The most significant digit dropped decides the rounding
+    for(; n > digits; n--) {
+      dropped   = (uint32_t)(mantissa % 10);
+      mantissa /= 10;
+    }
+    if(dropped >= 5 && decimal_count_digits(++mantissa) > n) {
+      mantissa /= 10;                                 // 9.99 rounded up to 10.0
+      exponent++;
+    }
+    while(0 == mantissa % 10) mantissa /= 10;
+  }
+
+  char      buffer[20];
+  n = format_digits(buffer, mantissa);
+  if(value.negative) *p++ = '-';
+  *p++ = buffer[0];
+  if(n > 1) {
+    *p++ = locale.point;
+    memcpy(p, buffer + 1, n - 1);
+    p += n - 1;
+  }
+  if(0 != exponent) {
+    *p++ = 'e';
+    p += format_integer(p, exponent);
+  }
+  *p = '\0';
+  return (uint8_t)(p - text);
+}
@@ -0,0 +1,55 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Format: write numbers as text, straight into the caller's buffer.
+//
+//  A Decimal's mantissa has no trailing zeros, so its digits are already the
+//  shortest text that reads back as the same value; there is nothing to search
+//  for, as there is when printing a double. Digits are generated two at a time
+//  from a table, without printf.
+//
+//  How numbers are written for the reader is a Locale: the decimal point, and the
+//  separator put between groups of the digits before it. The display's is chosen
+//  when building, with DISPLAY_LOCALE. Separators are only ever written into text
+//  for the display, as the digits are: Numbers, Decimals, flash, traces and the
+//  serial protocol all keep plain digits and '.', so nothing read back has to have
+//  separators taken out first.
+//
+#pragma once
+
+#include <stdint.h>
+#include "decimal.h"
+
+#define FORMAT_SCIENTIFIC_SIZE 26           // Buffer size format_scientific() needs: sign, 18 digits, point, "e-99", NUL
+
+
+struct Locale {
+  char      point;                          // The decimal point
+  char      separator;                      // Between groups of the digits before the point, or 0 for none
+  uint8_t   group;                          // Digits in the group next to the point
+  uint8_t   next_group;                     // Digits in each group before that one
+};
+
+//                                point separator  groups
+constexpr Locale locale_plain   = { '.',  0,        3, 3 };   // 1234567.89: for reading back
+constexpr Locale locale_english = { '.',  ',',      3, 3 };   // 1,234,567.89
+constexpr Locale locale_german  = { ',',  '.',      3, 3 };   // 1.234.567,89
+constexpr Locale locale_french  = { ',',  ' ',      3, 3 };   // 1 234 567,89
+constexpr Locale locale_swiss   = { '.',  '\'',     3, 3 };   // 1'234'567.89
+constexpr Locale locale_indian  = { '.',  ',',      3, 2 };   // 12,34,567.89
+
+#ifndef DISPLAY_LOCALE
+#define DISPLAY_LOCALE        locale_english  // How the display writes numbers: build with -D DISPLAY_LOCALE=locale_german, say
+#endif
+
+
+// Separators written between the integers digits before the point
+constexpr int32_t format_separators(int32_t integers, const Locale& locale) {
+  return 0 == locale.separator || integers <= locale.group ? 0 : 1 + (integers - locale.group - 1) / locale.next_group;
+}
+
+
+uint8_t format_digits(char* text, uint64_t value);   // "1234". Return the number of characters written, not counting the NUL.
+uint8_t format_integer(char* text, int32_t value);   // "-12". Return as for format_digits().
+char*   format_grouped(char* p, const char* digits, uint8_t n, uint8_t integers, const Locale& locale);  // Write integers digits, the first n from digits and then zeros, in groups. Return the end. No NUL.
+uint8_t format_fixed(char* text, uint8_t size, const Decimal& value, const Locale& locale);        // "-1,234.5", or nothing (return 0) if it needs more than size - 1 characters
+uint8_t format_scientific(char* text, const Decimal& value, uint8_t digits, const Locale& locale); // "1.25e30", rounded half-up to at most digits significant digits
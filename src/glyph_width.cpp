@@ -0,0 +1,60 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Glyph_Width: running text widths. See glyph_width.h.
+//
+#include "glyph_width.h"
+
+static_assert(26 == glyph_width('0', 6) && 14 == glyph_width('9', 4) && 7 == glyph_width('5', 2), "Digit widths");
+static_assert(13 == glyph_width('.', 6) && 4 == glyph_width(',', 4) && 5 == glyph_width(' ', 2), "Punctuation widths");
+static_assert(0 == glyph_width('e', 6) && 0 == glyph_width(',', 6), "Font 6 has no letters or comma");
+static_assert(0 == glyph_width('0', 7), "Font 7 is not in the tables");
+
+static const uint8_t fonts[GLYPH_FONTS] = { 2, 4, 6 };
+
+
+void Text_Width::clear() {
+  for(uint8_t i = 0; i < GLYPH_FONTS; i++) {
+    width[i]   = 0;
+    missing[i] = 0;
+  }
+}
+
+
+void Text_Width::add(char c) {
+  for(uint8_t i = 0; i < GLYPH_FONTS; i++) {
+    uint8_t w = glyph_width(c, fonts[i]);
+    width[i] += w;
+    if(0 == w) missing[i]++;
+  }
+}
+
+
+void Text_Width::remove(char c) {
+  for(uint8_t i = 0; i < GLYPH_FONTS; i++) {
+    uint8_t w = glyph_width(c, fonts[i]);
+    width[i] -= w;
+    if(0 == w) missing[i]--;
+  }
+}
+
+
+void Text_Width::add(const char* text) {
+  while(*text) add(*text++);
+}
+
+
+bool Text_Width::fits(uint8_t font, uint16_t room) const {
+  int8_t i = glyph_font_index(font);
+  return i >= 0 && 0 == missing[i] && width[i] <= room;
+}
+
+
+bool text_fits(const char* text, uint8_t font, uint16_t room) {
+  uint16_t width = 0;
+  for(; *text; text++) {
+    uint8_t w = glyph_width(*text, font);
+    if(0 == w) return false;
+    width += w;
+  }
+  return width <= room;
+}
@@ -0,0 +1,84 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Glyph_Width: the width of text in the Accumulator's fonts, known at compile time.
+//
+//  Measuring text with M5.Lcd.textWidth() means selecting the font and walking
+//  the font's data for every character. The tables here give each glyph's width
+//  in the TFT_eSPI fonts 2, 4 and 6 without the display library. A Text_Width
+//  keeps a running total for all three fonts as characters are added and
+//  removed, so finding the largest font that fits takes constant time per key.
+//
+//  The widths are TFT_eSPI's own tables (widtbl_f16, widtbl_f32 and widtbl_f64
+//  in Fonts/), the advance textWidth() adds for each character, so text that
+//  fits by these tables is exactly as wide on the screen. A width of 0 means the
+//  font has no such glyph: font 6 only has digits, space and - . : a m p, and
+//  draws the rest as 1 pixel blanks.
+//
+#pragma once
+
+#include <stdint.h>
+
+#define GLYPH_FIRST           ' '           // First character in the tables
+#define GLYPH_LAST            '~'           // Last character in the tables
+#define GLYPH_FONTS           3             // Fonts with tables: 2, 4 and 6
+
+constexpr uint8_t glyph_widths[GLYPH_FONTS][GLYPH_LAST - GLYPH_FIRST + 1] = {
+  { // Font 2: widtbl_f16
+     5,  2,  3,  8,  7,  8,  8,  2,  6,  6,  7,  6,  2,  5,  2,  5,   //   ! " # $ % & ' ( ) * + , - . /
+     7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  2,  2,  5,  6,  5,  6,   // 0 1 2 3 4 5 6 7 8 9 : ; < = > ?
+    10,  7,  7,  7,  7,  7,  6,  7,  7,  2,  6,  7,  6,  9,  7,  7,   // @ A B C D E F G H I J K L M N O
+     7,  7,  7,  7,  6,  7,  7,  9,  7,  7,  7,  3,  5,  3,  5,  7,   // P Q R S T U V W X Y Z [ \ ] ^ _
+     3,  6,  6,  6,  6,  6,  4,  6,  6,  2,  3,  6,  2,  8,  6,  6,   // ` a b c d e f g h i j k l m n o
+     6,  6,  4,  6,  4,  6,  6,  8,  6,  6,  6,  4,  2,  4,  7        // p q r s t u v w x y z { | } ~
+  },
+  { // Font 4: widtbl_f32
+     3,  4,  4, 15, 14, 18, 17,  3,  6,  6, 10, 10,  4,  7,  4,  8,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14,  4,  4, 12, 12, 12, 13,
+    19, 16, 16, 17, 17, 15, 14, 18, 17,  6, 12, 16, 13, 19, 17, 18,
+    16, 18, 16, 16, 14, 17, 15, 22, 15, 15, 15,  6,  8,  6,  9, 14,
+     5, 14, 14, 12, 14, 13,  7, 14, 14,  5,  5, 12,  5, 20, 14, 14,
+    14, 14,  8, 12,  7, 14, 12, 18, 12, 12, 12,  7,  4,  7, 14
+  },
+  { // Font 6: widtbl_f64
+    12,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 17, 13,  0,
+    26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 13,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0, 29,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 42,  0,  0,
+    29,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Table lookups. These are constexpr (one expression each, for C++11) so they
+//  can be checked at compile time.
+//
+constexpr int8_t glyph_font_index(uint8_t font) {
+  return 2 == font ? 0 : 4 == font ? 1 : 6 == font ? 2 : -1;
+}
+
+// Width of c in font, or 0 if the font has no glyph for c (or is not in the tables)
+constexpr uint8_t glyph_width(char c, uint8_t font) {
+  return (glyph_font_index(font) < 0 || c < GLYPH_FIRST || c > GLYPH_LAST) ? 0
+       : glyph_widths[glyph_font_index(font)][c - GLYPH_FIRST];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Running width of a line of text in every font in the tables.
+//
+struct Text_Width {
+  uint16_t  width[GLYPH_FONTS];             // Sum of the glyph widths, per font
+  uint8_t   missing[GLYPH_FONTS];           // Number of characters the font has no glyph for
+
+  void      clear();
+  void      add(char c);
+  void      remove(char c);                 // c must have been added
+  void      add(const char* text);
+  bool      fits(uint8_t font, uint16_t room) const;  // True if the font has every glyph and they fit in room pixels
+};
+
+bool text_fits(const char* text, uint8_t font, uint16_t room);   // Measure text and return as for Text_Width::fits()
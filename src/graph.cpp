@@ -0,0 +1,592 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Graph: plotting y = f(x) across the screen. See graph.h.
+//
+#include "graph.h"
+#include "number.h"
+#include "scientific.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#define FIXED_ONE             65536         // 1 in 16.16 fixed point
+#define FIXED_LN2             45426         // ln(2)
+#define FIXED_LOG10_2         19728         // log10(2)
+#define FIXED_LOG2_E          94548         // log2(e)
+#define FIXED_90              (90 << 16)    // Degrees
+#define FIXED_180             (180 << 16)
+#define FIXED_360             (360 << 16)
+#define FIXED_POWER_MAX       64            // Largest whole power worked out by multiplying
+#define FIXED_SMALL           4096          // 1/16: below, a value has too few bits to divide by or take the logarithm of
+#define SEGMENT_BITS          10            // The log2 and exp2 tables have a segment per 2^10 of the 16 bit fraction
+#define GRAPH_OUTLIER         16            // Points this far beyond the rest of the coarse pass are going off towards an asymptote
+#define GRAPH_STEPS_MAX       1e4f          // Most steps from y = 0 to the window: beyond, float's rounding shows as rows
+
+
+enum Graph_Op : uint8_t {
+  GRAPH_OP_NUMBER,                          // Followed by the index of the number
+  GRAPH_OP_X,
+  GRAPH_OP_ADD,
+  GRAPH_OP_SUBTRACT,
+  GRAPH_OP_MULTIPLY,
+  GRAPH_OP_DIVIDE,
+  GRAPH_OP_POWER,
+  GRAPH_OP_NEGATE,
+  GRAPH_OP_SQRT,
+  GRAPH_OP_SQUARE,
+  GRAPH_OP_RECIPROCAL,
+  GRAPH_OP_LN,
+  GRAPH_OP_LOG,
+  GRAPH_OP_EXP,
+  GRAPH_OP_SIN,
+  GRAPH_OP_COS,
+  GRAPH_OP_TAN
+};
+
+// x from -half to half: half in tenths at each zoom
+static const uint32_t half_tenths[GRAPH_ZOOMS] = {
+  1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000
+};
+
+// sin of 0 - 90 degrees, a degree apart
+static const int32_t sin_table[91] = {
+       0,   1144,   2287,   3430,   4572,   5712,   6850,   7987,
+    9121,  10252,  11380,  12505,  13626,  14742,  15855,  16962,
+   18064,  19161,  20252,  21336,  22415,  23486,  24550,  25607,
+   26656,  27697,  28729,  29753,  30767,  31772,  32768,  33754,
+   34729,  35693,  36647,  37590,  38521,  39441,  40348,  41243,
+   42126,  42995,  43852,  44695,  45525,  46341,  47143,  47930,
+   48703,  49461,  50203,  50931,  51643,  52339,  53020,  53684,
+   54332,  54963,  55578,  56175,  56756,  57319,  57865,  58393,
+   58903,  59396,  59870,  60326,  60764,  61183,  61584,  61966,
+   62328,  62672,  62997,  63303,  63589,  63856,  64104,  64332,
+   64540,  64729,  64898,  65048,  65177,  65287,  65376,  65446,
+   65496,  65526,  65536
+};
+
+// log2(1 + i/64)
+static const int32_t log2_table[65] = {
+       0,   1466,   2909,   4331,   5732,   7112,   8473,   9814,
+   11136,  12440,  13727,  14996,  16248,  17484,  18704,  19909,
+   21098,  22272,  23433,  24579,  25711,  26830,  27936,  29029,
+   30109,  31178,  32234,  33279,  34312,  35334,  36346,  37346,
+   38336,  39316,  40286,  41246,  42196,  43137,  44068,  44990,
+   45904,  46809,  47705,  48593,  49472,  50344,  51207,  52063,
+   52911,  53751,  54584,  55410,  56229,  57040,  57845,  58643,
+   59434,  60219,  60997,  61769,  62534,  63294,  64047,  64794,
+   65536
+};
+
+// 2^(i/64)
+static const int32_t exp2_table[65] = {
+   65536,  66250,  66971,  67700,  68438,  69183,  69936,  70698,
+   71468,  72246,  73032,  73828,  74632,  75444,  76266,  77096,
+   77936,  78785,  79642,  80510,  81386,  82273,  83169,  84074,
+   84990,  85915,  86851,  87796,  88752,  89719,  90696,  91684,
+   92682,  93691,  94711,  95743,  96785,  97839,  98905,  99982,
+  101070, 102171, 103283, 104408, 105545, 106694, 107856, 109031,
+  110218, 111418, 112631, 113858, 115098, 116351, 117618, 118899,
+  120194, 121502, 122825, 124163, 125515, 126882, 128263, 129660,
+  131072
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Tokens
+//
+static bool is_operator(char t) {
+  return '+' == t || '-' == t || '*' == t || '/' == t || FUNCTION_POWER == t;
+}
+
+static bool is_function(char t) {
+  return GRAPH_NEGATE == t || nullptr != scientific_name(t);
+}
+
+// As expression.h does it, so a formula plots what typing it would give
+static uint8_t precedence(char op) {
+  if(FUNCTION_POWER == op)    return 3;
+  if('*' == op || '/' == op)  return 2;
+  return 1;
+}
+
+static uint8_t operation(char t) {
+  switch(t) {
+    case '+':                 return GRAPH_OP_ADD;
+    case '-':                 return GRAPH_OP_SUBTRACT;
+    case '*':                 return GRAPH_OP_MULTIPLY;
+    case '/':                 return GRAPH_OP_DIVIDE;
+    case FUNCTION_POWER:      return GRAPH_OP_POWER;
+    case GRAPH_NEGATE:        return GRAPH_OP_NEGATE;
+    case FUNCTION_SQRT:       return GRAPH_OP_SQRT;
+    case FUNCTION_SQUARE:     return GRAPH_OP_SQUARE;
+    case FUNCTION_RECIPROCAL: return GRAPH_OP_RECIPROCAL;
+    case FUNCTION_LN:         return GRAPH_OP_LN;
+    case FUNCTION_LOG:        return GRAPH_OP_LOG;
+    case FUNCTION_EXP:        return GRAPH_OP_EXP;
+    case FUNCTION_SIN:        return GRAPH_OP_SIN;
+    case FUNCTION_COS:        return GRAPH_OP_COS;
+    default:                  return GRAPH_OP_TAN;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Building a formula
+//
+void graph_clear(Graph_Formula& f) {
+  f.length  = 0;
+  f.numbers = 0;
+}
+
+
+bool graph_operand_ends(const Graph_Formula& f) {
+  return f.length > 0 && !is_operator(f.token[f.length - 1]);
+}
+
+
+// An operand after another needs room for a * too
+bool graph_has_room(const Graph_Formula& f, char token) {
+  bool ends = graph_operand_ends(f);
+  if(is_operator(token))                            return f.length > 0 && (!ends || f.length < GRAPH_TOKENS);
+  if(is_function(token))                            return ends && f.length < GRAPH_TOKENS;
+  if(GRAPH_NUMBER == token && GRAPH_NUMBERS == f.numbers) return false;
+  if(GRAPH_NUMBER != token && GRAPH_X != token)     return false;
+  return f.length + (ends ? 2 : 1) <= GRAPH_TOKENS;
+}
+
+
+bool graph_append(Graph_Formula& f, char token) {
+  if(GRAPH_NUMBER == token || !graph_has_room(f, token)) return false;
+  if(is_operator(token) && !graph_operand_ends(f)) {
+    f.token[f.length - 1] = token;          // Another operator replaces it
+    return true;
+  }
+  if(GRAPH_X == token && graph_operand_ends(f)) f.token[f.length++] = '*';
+  f.token[f.length++] = token;
+  return true;
+}
+
+
+bool graph_append_number(Graph_Formula& f, const Decimal& number) {
+  if(!graph_has_room(f, GRAPH_NUMBER)) return false;
+  if(graph_operand_ends(f)) f.token[f.length++] = '*';
+  f.number[f.numbers++]   = number;
+  f.token[f.length++]     = GRAPH_NUMBER;
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Packed, a formula is its length (1) and tokens, then its numbers (decimal_pack).
+//  It is unpacked by appending the tokens again, so only a formula that could have
+//  been typed comes back.
+//
+uint8_t graph_pack(uint8_t* p, const Graph_Formula& f) {
+  uint8_t* start = p;
+  *p++ = f.length;
+  for(uint8_t i = 0; i < f.length; i++) *p++ = (uint8_t)f.token[i];
+  for(uint8_t i = 0; i < f.numbers; i++, p += DECIMAL_PACKED_SIZE) decimal_pack(p, f.number[i]);
+  return (uint8_t)(p - start);
+}
+
+
+uint8_t graph_unpack(const uint8_t* p, uint8_t size, Graph_Formula& f) {
+  graph_clear(f);
+  if(0 == size || p[0] > GRAPH_TOKENS || size < 1 + p[0]) return 0;
+  const uint8_t* token  = p + 1;
+  const uint8_t* number = token + p[0];
+  for(uint8_t i = 0; i < p[0]; i++) {
+    bool appended;
+    if(GRAPH_NUMBER != (char)token[i]) appended = graph_append(f, (char)token[i]);
+    else if(p + size - number < DECIMAL_PACKED_SIZE) appended = false;
+    else {
+      appended  = graph_append_number(f, decimal_unpack(number));
+      number   += DECIMAL_PACKED_SIZE;
+    }
+    if(!appended || f.length != i + 1) {    // Not as it was typed: an operator replaced, or a * put in
+      graph_clear(f);
+      return 0;
+    }
+  }
+  return (uint8_t)(number - p);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The formula as it would be written: each operand with its functions around it,
+//  the last outermost. A negative operand is bracketed unless it starts the formula,
+//  as it is raised to a power before it is negated on paper.
+//
+static const char* prefix(char function) {
+  if(GRAPH_NEGATE == function)        return "-";
+  if(FUNCTION_RECIPROCAL == function) return "1/";
+  return scientific_name(function);
+}
+
+uint16_t graph_text(char* text, const Graph_Formula& f, const Locale& locale) {
+  char*   p       = text;
+  uint8_t number  = 0;
+  char    digits[NUMBER_TEXT_SIZE];
+  for(uint8_t i = 0; i < f.length; ) {
+    if(is_operator(f.token[i])) {
+      *p++ = f.token[i++];
+      continue;
+    }
+    uint8_t end = i + 1;                    // One past the operand's last function
+    while(end < f.length && is_function(f.token[end])) end++;
+    if(GRAPH_NUMBER == f.token[i]) {
+      Number value;
+      value.set_decimal(f.number[number++]);
+      value.to_text(digits, locale);
+    }
+    else {
+      digits[0] = GRAPH_X;
+      digits[1] = '\0';
+    }
+    bool negative = end > i + 1 ? GRAPH_NEGATE == f.token[end - 1] : '-' == digits[0];
+    bool bracket  = negative && (i > 0 || (end < f.length && FUNCTION_POWER == f.token[end]));
+    if(bracket) *p++ = '(';
+    for(uint8_t k = end - 1; k > i; k--) {
+      p = stpcpy(p, prefix(f.token[k]));
+      *p++ = '(';
+    }
+    p = stpcpy(p, digits);
+    for(uint8_t k = end - 1; k > i; k--) *p++ = ')';
+    if(bracket) *p++ = ')';
+    i = end;
+  }
+  *p = '\0';
+  return (uint16_t)(p - text);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Compiling: the shunting yard, which holds back each operator until one of lower
+//  or equal precedence shows its right operand is complete. At most one operator of
+//  each precedence waits, so the stack never holds more than four values.
+//
+static bool compile_number(Graph_Program& p, const Decimal& number, uint8_t index) {
+  double value = (double)number.mantissa * pow(10.0, number.exponent);
+  if(number.negative) value = -value;
+  p.float_number[index] = (float)value;
+  if(!isfinite(p.float_number[index])) return false;
+  double magnitude = fabs(value);
+  if(magnitude >= INT16_MAX || (0 != magnitude && magnitude < 1.0 / 16)) {
+    p.fixed = false;                        // Too big for 16.16, or too few bits of it to be worth the speed
+    p.fixed_number[index] = 0;
+  }
+  else {
+    p.fixed_number[index] = (int32_t)lround(value * FIXED_ONE);
+  }
+  return true;
+}
+
+
+bool graph_compile(const Graph_Formula& f, Graph_Program& p) {
+  if(!graph_operand_ends(f)) return false;
+  char    waiting[GRAPH_STACK];             // Operators waiting for their right operand
+  uint8_t waits   = 0;
+  uint8_t number  = 0;
+  p.length  = 0;
+  p.fixed   = true;
+  for(uint8_t i = 0; i < f.length; i++) {
+    char t = f.token[i];
+    if(is_operator(t)) {
+      while(waits > 0 && precedence(waiting[waits - 1]) >= precedence(t)) p.code[p.length++] = operation(waiting[--waits]);
+      waiting[waits++] = t;
+    }
+    else if(GRAPH_NUMBER == t) {
+      if(!compile_number(p, f.number[number], number)) return false;
+      p.code[p.length++] = GRAPH_OP_NUMBER;
+      p.code[p.length++] = number++;
+    }
+    else if(GRAPH_X == t) {
+      p.code[p.length++] = GRAPH_OP_X;
+    }
+    else {
+      p.code[p.length++] = operation(t);
+    }
+  }
+  while(waits > 0) p.code[p.length++] = operation(waiting[--waits]);
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Fixed-Point Kernels
+//
+//  16.16 values, with 64 bit intermediates. Each returns false if the result won't
+//  fit, or the argument is one float should decide about: 0 for ln, say, which may
+//  be a small number rounded, or any divisor or logarithm below FIXED_SMALL, whose
+//  rounding the result would magnify. Tables are interpolated linearly: sin between whole
+//  degrees, log2 and exp2 across 64 segments of an octave.
+//
+static inline bool fits(int64_t value) {
+  return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static inline bool fixed_multiply(int32_t a, int32_t b, int32_t& r) {
+  int64_t product = ((int64_t)a * b + (FIXED_ONE / 2)) >> 16;
+  r = (int32_t)product;
+  return fits(product);
+}
+
+static inline bool fixed_divide(int32_t a, int32_t b, int32_t& r) {
+  if(b > -FIXED_SMALL && b < FIXED_SMALL) return false;
+  int64_t quotient = ((int64_t)a << 16) / b;
+  r = (int32_t)quotient;
+  return fits(quotient);
+}
+
+static bool fixed_sqrt(int32_t a, int32_t& r) {
+  if(a < 0) return false;
+  uint64_t n    = (uint64_t)a << 16;        // sqrt(a * 2^16) is sqrt(a) in 16.16
+  uint64_t root = 0;
+  uint64_t bit  = (uint64_t)1 << 46;        // The highest power of four below 2^47
+  while(bit > n) bit >>= 2;
+  for(; bit; bit >>= 2) {
+    if(n >= root + bit) {
+      n    -= root + bit;
+      root  = (root >> 1) + bit;
+    }
+    else root >>= 1;
+  }
+  r = (int32_t)root;
+  return true;
+}
+
+// Between two entries of a table, by the low bits of f
+static inline int32_t interpolate(const int32_t* table, uint32_t f, uint8_t bits) {
+  uint32_t i = f >> bits;
+  int32_t  a = table[i];
+  return a + (int32_t)(((int64_t)(table[i + 1] - a) * (int32_t)(f & ((1u << bits) - 1))) >> bits);
+}
+
+static int32_t fixed_log2(int32_t a) {      // a > 0
+  int8_t   n = 31 - __builtin_clz((uint32_t)a);   // a is in [2^n, 2^(n+1)) units
+  uint32_t m = n >= 16 ? (uint32_t)a >> (n - 16) : (uint32_t)a << (16 - n);  // Scaled into [1, 2)
+  return ((int32_t)(n - 16) << 16) + interpolate(log2_table, m - FIXED_ONE, SEGMENT_BITS);
+}
+
+static bool fixed_exp2(int64_t t, int32_t& r) {
+  int64_t n = t >> 16;                      // 2^t is 2^n * 2^f, 0 <= f < 1
+  if(n > 14)  return false;
+  if(n < -17) { r = 0; return true; }
+  int32_t m = interpolate(exp2_table, (uint32_t)(t & 0xFFFF), SEGMENT_BITS);
+  r = n >= 0 ? m << n : m >> -n;
+  return true;
+}
+
+static bool fixed_ln(int32_t a, int32_t& r, int32_t base) {     // base: ln(2), or log10(2)
+  if(a < FIXED_SMALL) return false;
+  r = (int32_t)(((int64_t)fixed_log2(a) * base + (FIXED_ONE / 2)) >> 16);
+  return true;
+}
+
+static bool fixed_exp(int32_t a, int32_t& r) {
+  return fixed_exp2(((int64_t)a * FIXED_LOG2_E + (FIXED_ONE / 2)) >> 16, r);
+}
+
+static bool fixed_power(int32_t x, int32_t y, int32_t& r) {
+  if(0 == (y & 0xFFFF) && y >= -(FIXED_POWER_MAX << 16) && y <= (FIXED_POWER_MAX << 16)) {
+    uint32_t n      = (uint32_t)(y < 0 ? -y : y) >> 16;
+    int32_t  power  = FIXED_ONE;
+    for(int32_t base = x; n; ) {            // By squaring
+      if((n & 1) && !fixed_multiply(power, base, power)) return false;
+      n >>= 1;
+      if(n && !fixed_multiply(base, base, base)) return false;
+    }
+    return y < 0 ? fixed_divide(FIXED_ONE, power, r) : ((r = power), true);
+  }
+  if(x < FIXED_SMALL) return false;
+  return fixed_exp2(((int64_t)y * fixed_log2(x) + (FIXED_ONE / 2)) >> 16, r);
+}
+
+static int32_t reduce_degrees(int32_t a) {  // To [0, 360)
+  int32_t r = a % FIXED_360;
+  return r < 0 ? r + FIXED_360 : r;
+}
+
+static int32_t fixed_sin(int32_t r) {       // r in [0, 450) degrees
+  if(r >= FIXED_360) r -= FIXED_360;
+  bool negative = r >= FIXED_180;
+  if(negative)      r -= FIXED_180;
+  if(r > FIXED_90)  r  = FIXED_180 - r;
+  int32_t s = r == FIXED_90 ? FIXED_ONE : interpolate(sin_table, (uint32_t)r, 16);
+  return negative ? -s : s;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Running a program: a stack of values, one case per operation.
+//
+bool graph_run_fixed(const Graph_Program& p, int32_t x, int32_t& y) {
+  int32_t stack[GRAPH_STACK];
+  uint8_t sp = 0;                           // Values on the stack
+  for(const uint8_t* pc = p.code, *end = p.code + p.length; pc < end; pc++) {
+    int32_t& top = stack[sp ? sp - 1 : 0];
+    int32_t  sum;
+    switch(*pc) {
+      case GRAPH_OP_NUMBER:     stack[sp++] = p.fixed_number[*++pc];  break;
+      case GRAPH_OP_X:          stack[sp++] = x;                      break;
+      case GRAPH_OP_ADD:
+        if(__builtin_add_overflow(stack[sp - 2], top, &sum)) return false;
+        stack[--sp - 1] = sum;
+        break;
+      case GRAPH_OP_SUBTRACT:
+        if(__builtin_sub_overflow(stack[sp - 2], top, &sum)) return false;
+        stack[--sp - 1] = sum;
+        break;
+      case GRAPH_OP_MULTIPLY:   sp--; if(!fixed_multiply(stack[sp - 1], top, stack[sp - 1])) return false;  break;
+      case GRAPH_OP_DIVIDE:     sp--; if(!fixed_divide(stack[sp - 1], top, stack[sp - 1]))   return false;  break;
+      case GRAPH_OP_POWER:      sp--; if(!fixed_power(stack[sp - 1], top, stack[sp - 1]))    return false;  break;
+      case GRAPH_OP_NEGATE:     if(INT32_MIN == top) return false;  top = -top;                break;
+      case GRAPH_OP_SQRT:       if(!fixed_sqrt(top, top))                   return false;      break;
+      case GRAPH_OP_SQUARE:     if(!fixed_multiply(top, top, top))          return false;      break;
+      case GRAPH_OP_RECIPROCAL: if(!fixed_divide(FIXED_ONE, top, top))      return false;      break;
+      case GRAPH_OP_LN:         if(!fixed_ln(top, top, FIXED_LN2))          return false;      break;
+      case GRAPH_OP_LOG:        if(!fixed_ln(top, top, FIXED_LOG10_2))      return false;      break;
+      case GRAPH_OP_EXP:        if(!fixed_exp(top, top))                    return false;      break;
+      case GRAPH_OP_SIN:        top = fixed_sin(reduce_degrees(top));                          break;
+      case GRAPH_OP_COS:        top = fixed_sin(reduce_degrees(top) + FIXED_90);               break;
+      default: {                // GRAPH_OP_TAN
+        int32_t r = reduce_degrees(top);
+        if(!fixed_divide(fixed_sin(r), fixed_sin(r + FIXED_90), top)) return false;
+        break;
+      }
+    }
+  }
+  y = stack[0];
+  return true;
+}
+
+
+static inline float radians(float degrees) {
+  return fmodf(degrees, 360.0f) * 0.0174532925f;
+}
+
+static inline float tangent(float degrees) {  // Undefined at 90 and 270 degrees, as scientific_tan() is
+  float r = fabsf(fmodf(degrees, 180.0f));
+  return 90.0f == r ? NAN : tanf(radians(degrees));
+}
+
+bool graph_run_float(const Graph_Program& p, float x, float& y) {
+  float   stack[GRAPH_STACK];
+  uint8_t sp = 0;
+  for(const uint8_t* pc = p.code, *end = p.code + p.length; pc < end; pc++) {
+    float& top = stack[sp ? sp - 1 : 0];
+    switch(*pc) {
+      case GRAPH_OP_NUMBER:     stack[sp++] = p.float_number[*++pc];            break;
+      case GRAPH_OP_X:          stack[sp++] = x;                                break;
+      case GRAPH_OP_ADD:        sp--; stack[sp - 1] += top;                     break;
+      case GRAPH_OP_SUBTRACT:   sp--; stack[sp - 1] -= top;                     break;
+      case GRAPH_OP_MULTIPLY:   sp--; stack[sp - 1] *= top;                     break;
+      case GRAPH_OP_DIVIDE:     sp--; stack[sp - 1] /= top;                     break;
+      case GRAPH_OP_POWER:      sp--; stack[sp - 1] = powf(stack[sp - 1], top); break;
+      case GRAPH_OP_NEGATE:     top = -top;                                     break;
+      case GRAPH_OP_SQRT:       top = sqrtf(top);                               break;
+      case GRAPH_OP_SQUARE:     top = top * top;                                break;
+      case GRAPH_OP_RECIPROCAL: top = 1.0f / top;                               break;
+      case GRAPH_OP_LN:         top = logf(top);                                break;
+      case GRAPH_OP_LOG:        top = log10f(top);                              break;
+      case GRAPH_OP_EXP:        top = expf(top);                                break;
+      case GRAPH_OP_SIN:        top = sinf(radians(top));                       break;
+      case GRAPH_OP_COS:        top = cosf(radians(top));                       break;
+      default:                  top = tangent(top);                             break;
+    }
+  }
+  y = stack[0];
+  return y == y;                            // Not NaN
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The Window
+//
+bool graph_point(const Graph_Program& p, const Graph_Window& w, uint16_t column, float& y) {
+  int32_t x = (int32_t)((int64_t)w.half * ((int32_t)column - GRAPH_ORIGIN) / GRAPH_ORIGIN);
+  int32_t fixed;
+  if(w.fixed && graph_run_fixed(p, x, fixed)) {
+    y = fixed * (1.0f / FIXED_ONE);
+    return true;
+  }
+  return graph_run_float(p, x * (1.0f / FIXED_ONE), y);
+}
+
+
+void graph_scale(Graph_Window& w, const Graph_Program& p, uint8_t zoom) {
+  w.zoom  = zoom;
+  w.half  = (int32_t)(((int64_t)half_tenths[zoom] << 16) / 10);
+  w.fixed = false;                          // The coarse pass is in float, which decides every point
+  float   y[GRAPH_SCALE_SAMPLES];
+  uint8_t n = 0;
+  for(uint8_t i = 0; i < GRAPH_SCALE_SAMPLES; i++) {
+    if(graph_point(p, w, i * (GRAPH_COLUMNS - 1) / (GRAPH_SCALE_SAMPLES - 1), y[n]) && isfinite(y[n])) n++;
+  }
+  float low  = -1;                          // Nothing to plot: the window around y = 0
+  float high = 1;
+  if(n > 0) {
+    std::sort(y, y + n);
+    uint8_t cut = n / 10;
+    low  = y[0];
+    high = y[n - 1];
+    if(high - low > GRAPH_OUTLIER * (y[n - 1 - cut] - y[cut])) {
+      low  = y[cut];
+      high = y[n - 1 - cut];
+    }
+  }
+  if(high == low) {                         // Flat: a step either side
+    float margin = fabsf(low) > 1 ? fabsf(low) / 2 : 1;
+    low  -= margin;
+    high += margin;
+  }
+
+  float   step  = (high - low) / GRAPH_SCALE_STEPS;
+  float   most  = fmaxf(fabsf(low), fabsf(high)) / GRAPH_STEPS_MAX;
+  if(step < most) step = most;
+  float   power = floorf(log10f(step));     // Within float's range, even if step overflowed
+  int     e     = power < -37 ? -37 : power > 37 ? 37 : (int)power;
+  float   unit  = powf(10.0f, (float)e);
+  float   m     = step / unit;
+  uint8_t digit = m <= 1 ? 1 : m <= 2 ? 2 : m <= 5 ? 5 : 10;
+  if(10 == digit) {
+    digit = 1;
+    unit *= 10;
+    e++;
+  }
+  step            = digit * unit;
+  w.step_digit    = digit;
+  w.step_exponent = (int8_t)e;
+  w.y_low         = (int32_t)floorf(low / step);
+  w.y_high        = (int32_t)ceilf(high / step);
+  if(w.y_high == w.y_low) w.y_high++;
+  w.y_min         = w.y_low * step;
+  w.y_max         = w.y_high * step;
+  w.fixed         = p.fixed && w.y_max - w.y_min >= GRAPH_FIXED_RANGE;
+}
+
+
+int16_t graph_row(const Graph_Window& w, float y, int16_t rows) {
+  float row = (w.y_max - y) * (rows - 1) / (w.y_max - w.y_min);
+  if(!(row > -1))   return -1;              // Also -inf
+  if(row > rows)    return rows;
+  return (int16_t)floorf(row + 0.5f);
+}
+
+
+Decimal graph_x_bound(const Graph_Window& w) {
+  return decimal_make(half_tenths[w.zoom], -1);
+}
+
+
+Decimal graph_y_bound(const Graph_Window& w, bool high) {
+  return decimal_make((int64_t)(high ? w.y_high : w.y_low) * w.step_digit, w.step_exponent);
+}
@@ -0,0 +1,98 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Graph: plotting y = f(x) across the screen.
+//
+//  A formula is typed as tokens: numbers, x, the operators + - * / ^ and the
+//  functions (scientific.h), which apply to the operand before them, as they do
+//  to the accumulator: x sin is sin(x), and 2 x sin ^ 2 is 2 * sin(x)^2. An operand
+//  straight after another is multiplied by it, so 3 x is 3 * x.
+//
+//  When it is plotted the formula is compiled once, with the calculator's own
+//  precedence (expression.h), to a program for a stack machine: a byte per
+//  operation, and the numbers in a table beside it. Each point is then a run of
+//  a tight loop over the bytes, with nothing parsed, formatted or allocated.
+//  Points are worked out in 16.16 fixed point, with tables for the functions,
+//  which is several times faster on the ESP32 than its single-precision float
+//  (whose libm functions are done in software), and good to a fraction of a
+//  pixel. A point that overflows fixed point, or whose argument a fixed-point
+//  function can't take, is worked out again in float, which decides whether it
+//  is defined. A formula whose numbers are too small or too large for fixed
+//  point, or whose plot is too flat for its rounding, is worked out in float.
+//
+//  The window is centred on x = 0, GRAPH_COLUMNS points wide, and zoomed in steps
+//  of 1, 2 and 5. y is scaled to fit the points of a coarse pass over the window,
+//  out to whole steps of 1, 2 or 5 times a power of ten, ignoring the few that go
+//  off towards an asymptote. Angles are in degrees, as everywhere else.
+//
+#pragma once
+
+#include <stdint.h>
+#include "decimal.h"
+#include "format.h"
+
+#define GRAPH_TOKENS          24            // Most tokens in a formula
+#define GRAPH_NUMBERS         8             // Most numbers in a formula
+#define GRAPH_CODE_SIZE       (2 * GRAPH_TOKENS)  // Most bytes in a program: a number is two
+#define GRAPH_STACK           8             // Deepest a program's stack can get: three pending operators need four
+#define GRAPH_TEXT_SIZE       480           // Buffer size graph_text() needs
+#define GRAPH_COLUMNS         320           // Points across the window, one per column of the screen
+#define GRAPH_ORIGIN          160           // Column where x = 0
+#define GRAPH_ZOOMS           16            // Widths of the window, from x = -0.1 to 0.1 up to -10000 to 10000
+#define GRAPH_ZOOM_DEFAULT    6             // x from -10 to 10
+#define GRAPH_SCALE_SAMPLES   33            // Points in the pass that scales y
+#define GRAPH_SCALE_STEPS     4             // Steps of y a plot is scaled to, before rounding out to whole steps
+#define GRAPH_FIXED_RANGE     0.0625f       // Flattest plot worked out in fixed point: a pixel is still many units of its rounding
+
+#define GRAPH_X               'x'           // The variable, typed as %
+#define GRAPH_NEGATE          'n'           // ` after an operand: the operand negated
+#define GRAPH_NUMBER          '0'           // The formula's next number
+#define GRAPH_MODE            '!'           // M . *: turn graph mode on or off
+#define GRAPH_PACKED_SIZE     (1 + GRAPH_TOKENS + GRAPH_NUMBERS * DECIMAL_PACKED_SIZE)  // Most bytes written by graph_pack()
+
+
+struct Graph_Formula {
+  char      token[GRAPH_TOKENS];            // GRAPH_NUMBER, GRAPH_X, an operator, a FUNCTION_ character or GRAPH_NEGATE
+  Decimal   number[GRAPH_NUMBERS];          // The numbers, in order
+  uint8_t   length;                         // Tokens in token[]
+  uint8_t   numbers;                        // Numbers in number[]
+};
+
+struct Graph_Program {
+  uint8_t   code[GRAPH_CODE_SIZE];          // Graph_Op bytes, each GRAPH_OP_NUMBER followed by its index
+  uint8_t   length;                         // Bytes in code[]
+  bool      fixed;                          // Every number is worth working with in fixed point
+  int32_t   fixed_number[GRAPH_NUMBERS];    // The numbers in 16.16 fixed point
+  float     float_number[GRAPH_NUMBERS];
+};
+
+struct Graph_Window {
+  uint8_t   zoom;                           // x runs from -half to half, where half is the zoom'th of 0.1, 0.2, 0.5, 1, 2, 5 ...
+  int32_t   half;                           // In 16.16 fixed point
+  int32_t   y_low;                          // y runs from y_low to y_high steps
+  int32_t   y_high;
+  uint8_t   step_digit;                     // A step of y is step_digit * 10^step_exponent: step_digit is 1, 2 or 5
+  int8_t    step_exponent;
+  float     y_min;                          // y_low and y_high steps
+  float     y_max;
+  bool      fixed;                          // Points are worked out in fixed point first
+};
+
+
+void      graph_clear(Graph_Formula& f);
+bool      graph_operand_ends(const Graph_Formula& f);               // True if the formula ends with an operand: it could be plotted
+bool      graph_has_room(const Graph_Formula& f, char token);       // True if the token (GRAPH_NUMBER for a number) can be added now
+bool      graph_append(Graph_Formula& f, char token);               // Add x, an operator, a function or GRAPH_NEGATE. Return false if it can't go there, or there is no room.
+bool      graph_append_number(Graph_Formula& f, const Decimal& number);
+uint8_t   graph_pack(uint8_t* p, const Graph_Formula& f);           // Store the formula compactly, for traces. Return the number of bytes written.
+uint8_t   graph_unpack(const uint8_t* p, uint8_t size, Graph_Formula& f);  // Restore what graph_pack() stored. Return the bytes used, or 0 (and clear) if they aren't valid.
+uint16_t  graph_text(char* text, const Graph_Formula& f, const Locale& locale); // "2*sin(x)^2+1". Return its length.
+
+bool      graph_compile(const Graph_Formula& f, Graph_Program& p);  // Return false if the formula can't be plotted yet
+bool      graph_run_fixed(const Graph_Program& p, int32_t x, int32_t& y);  // 16.16 fixed point. Return false if float must decide.
+bool      graph_run_float(const Graph_Program& p, float x, float& y);      // Return false if y is undefined at x
+
+void      graph_scale(Graph_Window& w, const Graph_Program& p, uint8_t zoom);  // Set the window for the zoom, and scale y to fit the plot
+bool      graph_point(const Graph_Program& p, const Graph_Window& w, uint16_t column, float& y);  // The point in a column. Return false if it is undefined.
+int16_t   graph_row(const Graph_Window& w, float y, int16_t rows);  // Row of y, counting down from y_max at 0, clipped to -1 above and rows below
+Decimal   graph_x_bound(const Graph_Window& w);                     // The window's right edge, and less its left
+Decimal   graph_y_bound(const Graph_Window& w, bool high);          // Its top or bottom
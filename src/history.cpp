@@ -0,0 +1,233 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  History: ring buffer and append-only log. See history.h.
+//
+//  A record is 36 bytes:
+//    3 values (left, right, result), packed by decimal_pack() (11 bytes each)
+//    op (1), flags (1), checksum (1)
+//
+#include "history.h"
+#include "format.h"
+#include "programmer.h"
+#include "scientific.h"
+#include "statistics.h"
+#include <SPIFFS.h>
+#include <string.h>
+
+#define VALUE_SIZE            DECIMAL_PACKED_SIZE
+#define CHECKSUM_SEED         0x5A          // So neither erased (0xFF) nor zeroed flash passes
+
+static uint8_t    ring[HISTORY_SIZE][HISTORY_RECORD_SIZE];
+static uint32_t   added     = 0;            // Records ever added; the newest is at added - 1
+static uint32_t   flushed   = 0;            // Records written to the log
+static File       log_file;
+static uint32_t   log_size  = 0;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Record encoding
+//
+static uint8_t checksum(const uint8_t* record) {
+  uint8_t sum = CHECKSUM_SEED;
+  for(uint8_t i = 0; i < HISTORY_RECORD_SIZE - 1; i++) sum += record[i];
+  return sum;
+}
+
+static void encode(uint8_t* record, const History_Entry& entry) {
+  decimal_pack(record,                  entry.left);
+  decimal_pack(record + VALUE_SIZE,     entry.right);
+  decimal_pack(record + 2 * VALUE_SIZE, entry.result);
+  record[3 * VALUE_SIZE]      = (uint8_t)entry.op;
+  record[3 * VALUE_SIZE + 1]  = entry.flags;
+  record[HISTORY_RECORD_SIZE - 1] = checksum(record);
+}
+
+static void decode(const uint8_t* record, History_Entry& entry) {
+  entry.left    = decimal_unpack(record);
+  entry.right   = decimal_unpack(record + VALUE_SIZE);
+  entry.result  = decimal_unpack(record + 2 * VALUE_SIZE);
+  entry.op      = (char)record[3 * VALUE_SIZE];
+  entry.flags   = record[3 * VALUE_SIZE + 1];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Write the records in RAM that are not in the log yet: at most two runs, as the ring wraps.
+//
+static void write_records(File& file, uint32_t from, uint32_t to) {
+  while(from != to) {
+    uint32_t  slot  = from & (HISTORY_SIZE - 1);
+    uint32_t  count = to - from;
+    if(count > HISTORY_SIZE - slot) count = HISTORY_SIZE - slot;
+    file.write(ring[slot], count * HISTORY_RECORD_SIZE);
+    from += count;
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Replace the log with one holding only the records in RAM.
+//  The new log is written under another name first, so a power cut leaves one complete log.
+//
+void history_restart() {
+  uint32_t  oldest  = added > HISTORY_SIZE ? added - HISTORY_SIZE : 0;
+  File      file    = SPIFFS.open(HISTORY_NEW_LOG_PATH, FILE_WRITE);
+  log_file.close();
+  if(file) {
+    write_records(file, oldest, added);
+    file.close();
+    SPIFFS.remove(HISTORY_LOG_PATH);
+    SPIFFS.rename(HISTORY_NEW_LOG_PATH, HISTORY_LOG_PATH);
+  }
+  flushed   = added;
+  log_size  = (added - oldest) * HISTORY_RECORD_SIZE;
+  log_file  = SPIFFS.open(HISTORY_LOG_PATH, FILE_APPEND);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Load the newest HISTORY_SIZE records from the log. SPIFFS must be mounted.
+//  Without flash the tape still works, in RAM only.
+//
+void history_begin() {
+  uint8_t record[HISTORY_RECORD_SIZE];
+  if(!SPIFFS.exists(HISTORY_LOG_PATH) && SPIFFS.exists(HISTORY_NEW_LOG_PATH)) {
+    SPIFFS.rename(HISTORY_NEW_LOG_PATH, HISTORY_LOG_PATH);    // Power was cut while restarting the log
+  }
+
+  File      file  = SPIFFS.open(HISTORY_LOG_PATH, FILE_READ);
+  uint32_t  size  = file ? file.size() : 0;
+  uint32_t  count = size / HISTORY_RECORD_SIZE;
+  uint32_t  first = count > HISTORY_SIZE ? count - HISTORY_SIZE : 0;
+  if(file && file.seek(first * HISTORY_RECORD_SIZE)) {
+    for(uint32_t i = first; i < count && HISTORY_RECORD_SIZE == file.read(record, sizeof(record)); i++) {
+      if(checksum(record) != record[HISTORY_RECORD_SIZE - 1]) continue;
+      memcpy(ring[added & (HISTORY_SIZE - 1)], record, HISTORY_RECORD_SIZE);
+      added++;
+    }
+  }
+  file.close();
+  flushed = added;
+
+  if(0 != size % HISTORY_RECORD_SIZE) {
+    history_restart();                    // A torn record at the end would misalign everything after it
+  }
+  else {
+    log_size = size;
+    log_file = SPIFFS.open(HISTORY_LOG_PATH, FILE_APPEND);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Add a record, overwriting the oldest once the ring is full.
+//
+void history_add(const History_Entry& entry) {
+  encode(ring[added & (HISTORY_SIZE - 1)], entry);
+  added++;
+  if(added - flushed > HISTORY_SIZE) flushed = added - HISTORY_SIZE;  // Only if the log can't keep up
+}
+
+
+uint32_t history_count() {
+  return added < HISTORY_SIZE ? added : HISTORY_SIZE;
+}
+
+
+bool history_get(uint32_t age, History_Entry& entry) {
+  if(age >= history_count()) return false;
+  decode(ring[(added - 1 - age) & (HISTORY_SIZE - 1)], entry);
+  return true;
+}
+
+
+bool history_flush_due(uint32_t idle_ms) {
+  uint32_t waiting = added - flushed;
+  return waiting >= HISTORY_FLUSH_COUNT || (waiting > 0 && idle_ms >= HISTORY_FLUSH_IDLE_MS);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Append the waiting records to the log.
+//
+void history_flush() {
+  if(added == flushed) return;
+  if(!log_file) {
+    flushed = added;                        // No flash
+    return;
+  }
+  write_records(log_file, flushed, added);
+  log_file.flush();
+  log_size += (added - flushed) * HISTORY_RECORD_SIZE;
+  flushed   = added;
+}
+
+
+bool history_restart_due(uint32_t idle_ms) {
+  return log_file && log_size >= HISTORY_LOG_LIMIT && idle_ms >= HISTORY_FLUSH_IDLE_MS;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Write an entry as a line of the tape: "12.5 * 2 = 25", "M 7 + 5 = 12", "7 % = 0.07", "sin 30 = 0.5",
+//  "stat 12.5 = n 4" (the fourth value added to the statistics), "0xFF0 >> 4 = 0xFF".
+//  Values that need many characters are shortened to 7 significant digits.
+//  Programmer mode values are written in hex unless they were shown in decimal:
+//  64 binary digits, or three 22 digit octal values, don't fit on a line.
+//
+static char* value_text(char* p, const Decimal& value, const Locale& locale) {
+  uint8_t n = format_fixed(p, 18, value, locale);     // 13 characters, and the separators between their groups
+  if(0 == n) n = format_scientific(p, value, 7, locale);
+  return p + n;
+}
+
+static char* entry_value_text(char* p, const Decimal& value, uint8_t flags, const Locale& locale) {
+  if(0 == (flags & HISTORY_INTEGER)) return value_text(p, value, locale);
+  int64_t bits = (int64_t)value.mantissa;
+  if(0 == (flags & HISTORY_HEX))     return value_text(p, decimal_make(bits, 0), locale);
+  *p++ = '0';
+  *p++ = 'x';
+  return p + programmer_format(p, bits, RADIX_HEX);
+}
+
+void history_entry_text(char* text, const History_Entry& entry, const Locale& locale) {
+  char* p = text;
+  if(entry.flags & HISTORY_MEMORY) {
+    *p++ = 'M';
+    *p++ = ' ';
+  }
+  const char* name = scientific_name(entry.op);
+  if(STATISTICS_ADD == entry.op) name = "stat";
+  if(entry.flags & HISTORY_INTEGER) name = PROGRAMMER_NOT == entry.op ? "not" : nullptr;
+  if(name) {                                // A function: "sqrt 2 = 1.414214"
+    while(*name) *p++ = *name++;
+    *p++  = ' ';
+    p     = entry_value_text(p, entry.left, entry.flags, locale);
+    *p++  = ' ';
+  }
+  else {
+    p     = entry_value_text(p, entry.left, entry.flags, locale);
+    *p++  = ' ';
+    *p++  = entry.op;
+    if('<' == entry.op || '>' == entry.op) *p++ = entry.op;   // A shift: << or >>
+    *p++  = ' ';
+    if('%' != entry.op) {
+      p     = entry_value_text(p, entry.right, entry.flags, locale);
+      *p++  = ' ';
+    }
+  }
+  *p++  = '=';
+  *p++  = ' ';
+  if(STATISTICS_ADD == entry.op) {
+    *p++  = 'n';
+    *p++  = ' ';
+  }
+  entry_value_text(p, entry.result, entry.flags, locale);
+}
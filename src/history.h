@@ -0,0 +1,56 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  History: the tape of calculations, in RAM and in flash.
+//
+//  Every operation the calculator performs is kept as a fixed-size binary record
+//  (its operands, operator and result) in a ring buffer of the last HISTORY_SIZE.
+//  Adding one costs a copy into the ring, whatever the length of the history.
+//
+//  New records are appended to a log file in flash (SPIFFS) HISTORY_FLUSH_COUNT
+//  at a time, or when the keyboard goes idle. The log is only ever appended to,
+//  which spreads writes over the flash; once it has reached HISTORY_LOG_LIMIT it
+//  is replaced by a new log holding just the records in RAM, when the keyboard
+//  goes idle so a burst of keys is never held up. At boot the newest
+//  records in the log are read back, so the tape survives a restart. Records
+//  carry a checksum, so a record torn by a power cut is skipped.
+//
+#pragma once
+
+#include <stdint.h>
+#include "decimal.h"
+#include "format.h"
+
+#define HISTORY_SIZE          64            // Records kept in RAM. Must be a power of two.
+#define HISTORY_RECORD_SIZE   36            // Bytes in a record, in RAM and in the log
+#define HISTORY_FLUSH_COUNT   8             // New records written to flash together
+#define HISTORY_FLUSH_IDLE_MS 2000          // Fewer records are written once the keyboard has been idle this long
+#define HISTORY_LOG_LIMIT     65536         // Log size (bytes) at which history_restart_due() asks for a new log
+#define HISTORY_LOG_PATH      "/history.log"
+#define HISTORY_NEW_LOG_PATH  "/history.new"
+#define HISTORY_TEXT_SIZE     64            // Buffer size needed by history_entry_text()
+
+#define HISTORY_MEMORY        0x01          // Entry flag: the operation changed memory
+#define HISTORY_INTEGER       0x02          // Entry flag: a programmer mode operation. The mantissas hold the 64 bit values.
+#define HISTORY_HEX           0x04          // Entry flag: with HISTORY_INTEGER, the values were shown in hex, binary or octal
+
+
+struct History_Entry {
+  Decimal   left;
+  Decimal   right;                          // Not used by '%' or the functions
+  Decimal   result;
+  char      op;                             // '+', '-', '*', '/', '^', '%', a function (a FUNCTION_ character: see scientific.h)
+                                            // or STATISTICS_ADD, with the count as the result.
+                                            // With HISTORY_INTEGER, a programmer mode operator or PROGRAMMER_NOT.
+  uint8_t   flags;                          // HISTORY_MEMORY, HISTORY_INTEGER, HISTORY_HEX
+};
+
+
+void      history_begin();                              // Open the log and load the newest records from it. Call after SPIFFS.begin().
+void      history_add(const History_Entry& entry);
+uint32_t  history_count();                              // Number of records in RAM
+bool      history_get(uint32_t age, History_Entry& entry);  // age 0 is the newest. Return false if there is no such record.
+bool      history_flush_due(uint32_t idle_ms);          // True if records should be written, given the time since the last key
+void      history_flush();                              // Write waiting records to the log
+bool      history_restart_due(uint32_t idle_ms);        // True if the log has reached HISTORY_LOG_LIMIT and the keyboard has been idle HISTORY_FLUSH_IDLE_MS
+void      history_restart();                            // Replace the log with one holding only the records in RAM
+void      history_entry_text(char* text, const History_Entry& entry, const Locale& locale);   // "12.5 * 2 = 25", "sin 30 = 0.5"
@@ -0,0 +1,77 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Idle: when the calculator may sleep, and how long it slept. See idle.h.
+//  The sleeping itself is done in main.cpp.
+//
+#include "idle.h"
+#include "format.h"
+#include "history.h"
+#include "saved_state.h"
+#include "trace.h"
+
+uint32_t    idle_dim_ms = IDLE_DIM_MS;
+Idle_Stats  idle_stats;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Everything loop() does without input happens once the time since the last input
+//  passes one of these. Sleep until the next of them, or until there is input if
+//  they have all passed. A deadline with nothing to do costs one wake.
+//
+uint32_t idle_sleep_ms(uint32_t idle_ms) {
+  if(idle_ms < IDLE_SLEEP_MS) return 0;
+  const uint32_t deadlines[] = { HISTORY_FLUSH_IDLE_MS, TRACE_FLUSH_IDLE_MS, SAVED_STATE_IDLE_MS, idle_dim_ms };
+  uint32_t sleep_ms = IDLE_FOREVER;
+  for(uint32_t deadline : deadlines) {
+    if(deadline > idle_ms && deadline - idle_ms < sleep_ms) sleep_ms = deadline - idle_ms;
+  }
+  return sleep_ms;
+}
+
+
+bool idle_dim_due(uint32_t idle_ms) {
+  return 0 != idle_dim_ms && idle_ms >= idle_dim_ms;
+}
+
+
+void idle_slept(uint32_t asleep_us, bool by_input, uint32_t now_us) {
+  idle_stats.sleeps++;
+  idle_stats.asleep_us += asleep_us;
+  idle_stats.waking     = by_input;
+  idle_stats.woken_us   = now_us;
+}
+
+
+void idle_handled(uint32_t now_us) {
+  if(!idle_stats.waking) return;
+  uint32_t latency_us = now_us - idle_stats.woken_us;
+  idle_stats.waking = false;
+  idle_stats.wakes++;
+  idle_stats.latency_us += latency_us;
+  if(latency_us > idle_stats.latency_max_us) idle_stats.latency_max_us = latency_us;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Write the statistics as a line of text, without printf.
+//
+static char* append(char* p, uint64_t value, const char* label) {
+  p += format_digits(p, value);
+  while(*label) *p++ = *label++;
+  return p;
+}
+
+uint8_t idle_report(char* text) {
+  const Idle_Stats& s = idle_stats;
+  char* p = text;
+  for(const char* label = "idle "; *label; ) *p++ = *label++;
+  p = append(p, s.sleeps, " sleeps ");
+  p = append(p, s.asleep_us / 1000, " ms asleep ");
+  p = append(p, s.wakes, " wakes ");
+  p = append(p, s.wakes ? s.latency_us / s.wakes : 0, " us mean ");
+  p = append(p, s.latency_max_us, " us max\n");
+  *p = '\0';
+  return (uint8_t)(p - text);
+}
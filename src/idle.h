@@ -0,0 +1,49 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Idle: when the calculator may sleep, and how long it slept.
+//
+//  Most of the day the calculator sits on a desk with nothing to do. Once there
+//  has been no input for IDLE_SLEEP_MS, loop() puts the ESP32 in light sleep
+//  until KEYBOARD_INT or a front button goes low, a byte arrives on the serial
+//  port, or the next thing that happens on a timer is due: writing the history
+//  and trace to flash, saving the state, or dimming the backlight. Between keys
+//  loop() waits for the keyboard task instead of spinning, for up to IDLE_NAP_MS
+//  so the serial port is still read.
+//
+//  The backlight is dimmed after idle_dim_ms without input (the serial request
+//  d changes it), and comes back with the next key, which is also handled.
+//
+//  Idle_Stats counts the sleeps, the time spent asleep and the latency from a
+//  wake to the end of handling the first key or button after it (the serial
+//  request i reports them.)
+//
+#pragma once
+
+#include <stdint.h>
+
+#define IDLE_SLEEP_MS         500           // Light sleep once there has been no input this long
+#define IDLE_NAP_MS           10            // Longest loop() waits for a key or button before looking at the serial port
+#define IDLE_DIM_MS           30000         // Default time without input before the backlight is dimmed (0: never)
+#define IDLE_FOREVER          UINT32_MAX    // Sleep until there is input
+#define IDLE_REPORT_SIZE      112           // Buffer size idle_report() needs, with its newline and NUL
+
+
+struct Idle_Stats {
+  uint32_t  sleeps;                         // Times the calculator went to sleep
+  uint64_t  asleep_us;                      // Total time asleep
+  uint32_t  woken_us;                       // micros() at the last wake by a key or button, while waiting for it to be handled
+  bool      waking;                         // The last wake was by a key or button not handled yet
+  uint32_t  wakes;                          // Wakes by a key or button that was then handled
+  uint64_t  latency_us;                     // Total of the wake-to-handled latencies
+  uint32_t  latency_max_us;
+};
+
+
+extern uint32_t   idle_dim_ms;              // Time without input before the backlight is dimmed (0: never)
+extern Idle_Stats idle_stats;
+
+uint32_t  idle_sleep_ms(uint32_t idle_ms);  // How long to sleep now, given the time since the last input: 0 for not yet, or IDLE_FOREVER
+bool      idle_dim_due(uint32_t idle_ms);   // True if the backlight should be dimmed
+void      idle_slept(uint32_t asleep_us, bool by_input, uint32_t now_us);  // Record a sleep, and whether a key or button ended it
+void      idle_handled(uint32_t now_us);    // Record that input was handled, after a wake if one is waiting
+uint8_t   idle_report(char* text);          // "idle 12 sleeps 3456 ms asleep 9 wakes 380 us mean 1250 us max\n". Return its length.
@@ -0,0 +1,53 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Key_Queue: single-producer / single-consumer ring buffer. See key_queue.h.
+//
+#include "key_queue.h"
+
+static char                   keys[KEY_QUEUE_SIZE];
+static std::atomic<uint32_t>  head(0);      // Next slot to write; only the producer changes it
+static std::atomic<uint32_t>  tail(0);      // Next slot to read; only the consumer changes it
+static uint32_t               dropped   = 0;  // Producer only
+static uint32_t               max_depth = 0;  // Producer only
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Add a key. The indexes run freely and wrap; their difference is the depth.
+//
+bool key_queue_push(char key) {
+  uint32_t h     = head.load(std::memory_order_relaxed);
+  uint32_t depth = h - tail.load(std::memory_order_acquire);
+  if(KEY_QUEUE_SIZE == depth) {
+    dropped++;
+    return false;
+  }
+  keys[h & (KEY_QUEUE_SIZE - 1)] = key;
+  head.store(h + 1, std::memory_order_release);   // Publish the key
+  if(depth + 1 > max_depth) max_depth = depth + 1;
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Take the oldest key.
+//
+bool key_queue_pop(char& key) {
+  uint32_t t = tail.load(std::memory_order_relaxed);
+  if(t == head.load(std::memory_order_acquire)) return false;
+  key = keys[t & (KEY_QUEUE_SIZE - 1)];
+  tail.store(t + 1, std::memory_order_release);   // Give the slot back to the producer
+  return true;
+}
+
+
+uint32_t key_queue_depth() {
+  return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+
+Key_Queue_Stats key_queue_stats() {
+  Key_Queue_Stats stats = { dropped, max_depth };
+  return stats;
+}
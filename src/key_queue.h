@@ -0,0 +1,30 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Key_Queue: a lock-free ring buffer of keystrokes.
+//
+//  There is exactly one producer (the keyboard task, which drains the Calculator
+//  FACE when it raises KEYBOARD_INT, and reads the front buttons as 'a', 'b' and
+//  'c') and one consumer (process_input() in loop().) Keys and buttons share the
+//  queue, so they are handled in the order they came.
+//  Each side only writes its own index, so no locks are needed; the indexes are
+//  published with release/acquire ordering so the consumer never sees a key
+//  before it has been stored.
+//
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#define KEY_QUEUE_SIZE        32            // Keys held before new ones are dropped. Must be a power of two.
+
+
+struct Key_Queue_Stats {
+  uint32_t  dropped;                        // Keys lost because the queue was full
+  uint32_t  max_depth;                      // Most keys ever waiting at once
+};
+
+
+bool            key_queue_push(char key);   // Producer only. Return false (and count a drop) if the queue is full.
+bool            key_queue_pop(char& key);   // Consumer only. Return false if the queue is empty.
+uint32_t        key_queue_depth();          // Number of keys waiting
+Key_Queue_Stats key_queue_stats();
@@ -1,7 +1,42 @@
 #include <M5Stack.h>
+#include <SPIFFS.h>
+#include "expression.h"
+#include "format.h"
+#include "graph.h"
+#include "history.h"
+#include "idle.h"
+#include "key_queue.h"
+#include "number.h"
+#include "profiler.h"
+#include "programmer.h"
+#include "render_schedule.h"
+#include "retained_text.h"
+#include "saved_state.h"
+#include "scientific.h"
+#include "seqlock.h"
+#include "serial_batch.h"
+#include "state_machine.h"
+#include "statistics.h"
+#include "stage_timer.h"
+#include "trace.h"
+#include "undo.h"
+#include "workspace.h"
+#ifndef NATIVE_BUILD
+#include <driver/gpio.h>
+#include <driver/uart.h>
+#include <esp_sleep.h>
+#endif
 
 #define KEYBOARD_I2C_ADDR     0X08          // I2C address of the Calculator FACE
 #define KEYBOARD_INT          5             // Data ready pin for Calculator FACE (active low)
+#define INPUT_POLL_MS         10            // How often the keyboard task reads the front buttons, and checks KEYBOARD_INT without an interrupt
+#define KEYBOARD_TASK_PRIO    2             // Above loop(), so keys are read even while the display is busy
+#define INPUT_CORE            1             // Core for loop() and the keyboard task: input and calculation
+#define RENDER_CORE           0             // Core for the render task: all drawing
+#define RENDER_TASK_PRIO      1
+#define BOOT_BUDGET_MS        300           // Most time from reset to the first frame before a warning is logged
+#define BRIGHTNESS            200           // Backlight level, 0 - 255
+#define DIM_BRIGHTNESS        16            // Backlight level after idle_dim_ms without input (see idle.h)
 
 #define SCREEN_WIDTH          320           // Horizontal screen size
 #define SCREEN_H_CENTER       160           // Horizontal center of screen
@@ -23,6 +58,9 @@
 #define ACC_FONT_1            6             // Preferred Accumulator font
 #define ACC_FONT_2            4             // Smaller Accumulator font
 #define ACC_FONT_3            2             // Smallest Accumulator font
+#define ACC_TEXT_HEIGHT       48            // Height of ACC_FONT_1, the tallest Accumulator font
+#define ACC_SPLIT_DIGITS      32            // Digits on the second line, for binary too long for one
+#define ACC_SPLIT_OFFSET      24            // Offset from the first line to the second
 #define ACC_FG_COLOR          FG_COLOR      // Accumulator foreground color
 #define ACC_BG_COLOR          BG_COLOR      // Accumulator background color
 
@@ -31,6 +69,8 @@
 #define INFO_H_MARGIN         16            // Left/right margins of the Info area
 #define INFO_V_MARGIN         2             // Offset from top to top text
 #define INFO_FONT             2             // Info font
+#define INFO_LINES            3             // Lines of text in the Info area
+#define INFO_STAT_DIGITS      10            // Significant digits shown for each statistic
 #define INFO_FG_COLOR         FG_COLOR      // Info foreground color
 #define INFO_BG_COLOR         BG_COLOR      // Info background color
 
@@ -44,40 +84,86 @@
 #define LABEL_BTN_B_CENTER    160           // Vertical center for Button B
 #define LABEL_BTN_C_CENTER    252           // Vertical center for Button C
 
+#define GRAPH_TOP             (ANN_TOP + ANN_HEIGHT)  // The plot covers the Accumulator and Info areas
+#define GRAPH_HEIGHT          (LABEL_TOP - GRAPH_TOP)
+#define GRAPH_NO_ROW          INT16_MIN     // The point in the column before was undefined
+#define GRAPH_FG_COLOR        WHITE         // The curve
+#define GRAPH_AXIS_COLOR      DARKGREY
+#define GRAPH_BG_COLOR        BG_COLOR
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Calculator Commands
+//  Global Variables
 //
-enum Calc_Command {
-  NO_COMMAND,   // Nothing pending
-  CLEAR,        // Immidiate command: if command == MEMORY clear memory, else clear accumulator
-  TOTAL,        // If command == MEMORY, copy memory to accumulator. Else perform command, clear opperand and set accumulator to result
-  MEMORY,       // Set command mode to MEMORY. Affects the next command issued.
-  DECIMAL,      // If accumulator does not contain a decimal point, add a decimal point
-  ADD,          // If command == MEMORY, add accumulator to memory, else add accumulator to opperand, clear opperand
-  SUBTRACT,     // If command == MEMORY, subtract accumulator from memory, else subtract accumulator from opperand, clear opperand
-  MULTIPLY,     // If command == MEMORY, multiply memory by accumulator, else multiply accumulator by opperand, clear opperand
-  DIVIDE,       // If command == MEMORY, divide memory by accumulator, else divide opperand by accumulator, clear opperand
-  PERCENT,      // Depends on status of command; see function comments
-  SIGN          // Reverse the sign of the accumulator
-};
-
+const Locale& display_locale = DISPLAY_LOCALE;  // Decimal point and digit grouping, chosen when building (see format.h)
+Number        accumulator;                // The number displayed as the main value of the calculator
+Number        memory;                     // The invisible memory
+Expression    expression;                 // The calculation waiting for the accumulator to complete it
+Calc_Mode     calc_mode     = MODE_READY; // What the next command does (see state_machine.h)
+bool          statistics_mode = false;    // The + key adds the accumulator to the statistics
+Statistics    statistics;                 // The batch of values added in statistics mode
+bool          programmer_mode = false;    // Values are 64 bit integers, shown in radix (see programmer.h)
+Radix         radix         = RADIX_DECIMAL;
+int64_t       integer       = 0;          // The accumulator in programmer mode
+Programmer_Expression integer_expression; // The pending calculation in programmer mode
+bool          graph_mode    = false;      // Keys build a formula to plot (see graph.h)
+bool          graph_plotted = false;      // The formula's plot is shown
+Graph_Formula graph_formula;
+Graph_Program graph_program;              // The formula plotted
+Graph_Window  graph_window;
+Number        graph_stash;                // The accumulator, put aside while it holds numbers typed into the formula
+bool          restart       = true;       // This is true when the next number should clear the display (after processing a command)
+Decimal_Status status       = DECIMAL_OK; // Overflow, underflow or division by zero in the last calculation
+uint32_t      history_view  = 0;          // 0 if the Info area isn't showing the tape, else 1 + the age of the newest entry it shows
+uint32_t      last_input_ms = 0;          // millis() when a key or button was last handled
+bool          dimmed        = false;      // The backlight is at DIM_BRIGHTNESS
+bool          state_changed = false;      // The state has changed since it was last saved to flash
+bool          batch_render  = true;       // Draw the results of serial batch requests (see serial_batch.h)
+uint32_t      boot_us       = 0;          // micros() when the first frame had been drawn
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Global Variables
+//  Calculator State shared with the renderer
 //
-const char    dp            = '.';        // Decimal Point: changes in differnet cultures
-const char    ts            = ',';        // Thousands separator: changes in differnet cultures
-String        accumulator   = "0";        // The number displayed as the main value of the calculator
-String        opperand      = "0";        // The number the current command will operate on
-String        memory        = "0";        // The invisible memory
-Calc_Command  command       = NO_COMMAND; // Nothing to do currently
-Calc_Command  previous      = NO_COMMAND; // The previously executed command
-bool          restart       = true;       // This is true when the next number should clear the display (after processing a command)
-bool          memory_mode   = false;      // The memory key has been pressed once and another press is needed
+//  The calculator runs on INPUT_CORE and the display is drawn on RENDER_CORE.
+//  The renderer never reads the globals above: after each burst of input the
+//  calculator publishes a copy of what should be shown, and the renderer takes
+//  a consistent copy of the latest one through a seqlock.
+//
+struct Calc_State {
+  Number        accumulator;
+  Number        memory;
+  Expression    expression;
+  Decimal       preview;                  // The value of the expression if it were completed now
+  uint32_t      history_view;
+  uint32_t      history_count;
+  History_Entry tape[INFO_LINES];         // The entries shown when history_view is set, oldest first
+  uint8_t       tape_lines;
+  bool          memory_mode;
+  bool          function_mode;
+  bool          statistics_mode;
+  Statistics    statistics;
+  bool          programmer_mode;
+  Radix         radix;
+  int64_t       integer;
+  Programmer_Expression integer_expression;
+  int64_t       integer_preview;
+  bool          can_backspace;
+  bool          can_undo;                 // M B has a step to undo
+  bool          can_redo;                 // M C has a step to redo
+  bool          graph_mode;
+  bool          graph_plotted;
+  bool          graph_typing;             // The accumulator is a number being typed into the formula
+  Graph_Formula graph_formula;
+  Graph_Program graph_program;            // Set only while plotted
+  Graph_Window  graph_window;
+  Decimal_Status status;
+  uint8_t       workspace;                // The workspace showing (see workspace.h)
+};
+
+Seqlock<Calc_State> published_state;      // Written by the calculator, read by the renderer
 
 
 
@@ -96,41 +182,6 @@ bool is_digit(char c)   { return c >= '0' && c <= '9'; }    // Return true if th
 bool is_command(char c) { return 0 != c && !is_digit(c); }  // Return true if the character is one of the commands
 
 
-////////////////////////////////////////////////////////////////////////////////
-//
-//  Create a string that will be the calculator display and storage value for the given number.
-//  If there is no fractional part, don't include a decimal.
-//  If there is a fractional part, trim trailing zeros (and possibly decimal point as well.)
-//
-String double_to_string(double value) {
-  char  buffer[64];
-  if(0.0 == value - (long)value) {            // If this is an exact integer...
-    snprintf(buffer, 64, "%d", (int)value);   // Display without decimal point or trailing zeros
-  }
-  else {
-    snprintf(buffer, 64, "%.6f", value);
-    while('0' == buffer[strlen(buffer) - 1]) {
-      buffer[strlen(buffer) - 1] = '\0';
-    }
-    if('.' ==buffer[strlen(buffer) - 1]) {
-      buffer[strlen(buffer) - 1] = '\0';
-    }
-  }
-  return String(buffer);
-}
-
-
-////////////////////////////////////////////////////////////////////////////////
-//
-//  Convert a display string back into a double.
-//
-double string_to_double(String str) {
-  str.replace(String(ts), "");    // Remove all thousands separators
-  str.replace(dp, '.');           // For atof() to work correctly
-  return str.toDouble();
-}
-
-
 ////////////////////////////////////////////////////////////////////////////////
 //
 //  Convert an input character to a Calc_Command.
@@ -148,18 +199,84 @@ Calc_Command input_to_command(char c) {
     case '`': return SIGN;  // Unexpected character: 0x60
     case '=': return TOTAL;
     case '.': return DECIMAL;
-    default:  return NO_COMMAND;
+    case FUNCTION_SQRT:       return SQUARE_ROOT;
+    case FUNCTION_SQUARE:     return SQUARE;
+    case FUNCTION_RECIPROCAL: return RECIPROCAL;
+    case FUNCTION_LN:         return LN;
+    case FUNCTION_LOG:        return LOG;
+    case FUNCTION_EXP:        return EXP;
+    case FUNCTION_SIN:        return SIN;
+    case FUNCTION_COS:        return COS;
+    case FUNCTION_TAN:        return TAN;
+    case FUNCTION_POWER:      return POWER;
+    case STATISTICS_ADD:      return ADD_TO_STATISTICS;
+    case STATISTICS_MODE:     return TOGGLE_STATISTICS;
+    case '&':                 return BIT_AND;
+    case '|':                 return BIT_OR;
+    case '<':                 return SHIFT_LEFT;
+    case '>':                 return SHIFT_RIGHT;
+    case PROGRAMMER_NOT:      return BIT_NOT;
+    case PROGRAMMER_MODE:     return TOGGLE_PROGRAMMER;
+    case GRAPH_MODE:          return TOGGLE_GRAPH;
+    default:
+      if(is_digit(c))                      return DIGIT;
+      if(programmer_digit_value(c) >= 10)  return HEX_DIGIT;
+      return NO_COMMAND;
   }
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Identify a deferred command; one which is put in the command global rather
-//  being executed immediately
+//  After M . the digit keys are the function keys, laid out like the keypad:
+//    7 sin    8 cos    9 tan
+//    4 ln     5 e^x    6 log
+//    1 sqrt   2 x^2    3 x^y
+//    0 1/x
+//  + turns statistics mode on or off, - programmer mode and * graph mode. In statistics
+//  mode, + adds to the statistics. In graph mode the others wait until it is turned off.
+//  In programmer mode, M . 0 - 5 are the hex digits A - F and M . ` is not, and after M
+//  the operators are the bitwise ones:
+//    M * and    M + or    M - xor    M % <<    M / >>
+//  Return the character a key stands for in the mode, else the key.
 //
-bool is_deferred_command(Calc_Command cmd) {
-  return (ADD == cmd || SUBTRACT == cmd || MULTIPLY == cmd || DIVIDE == cmd);
+const char function_keys[] = {
+  FUNCTION_RECIPROCAL,  FUNCTION_SQRT,  FUNCTION_SQUARE,  FUNCTION_POWER,
+  FUNCTION_LN,          FUNCTION_EXP,   FUNCTION_LOG,
+  FUNCTION_SIN,         FUNCTION_COS,   FUNCTION_TAN
+};
+
+char decode_programmer_key(char c) {
+  if(MODE_FUNCTION == calc_mode) {
+    if(c >= '0' && c <= '5') return (char)(PROGRAMMER_HEX_DIGIT + 10 + c - '0');
+    if('`' == c)             return PROGRAMMER_NOT;
+    if('-' == c)             return PROGRAMMER_MODE;
+  }
+  else if(MODE_MEMORY == calc_mode) {
+    switch(c) {
+      case '*': return '&';
+      case '+': return '|';
+      case '-': return '^';
+      case '%': return '<';
+      case '/': return '>';
+    }
+  }
+  return c;
+}
+
+char decode_key(char c) {
+  if(programmer_mode) return decode_programmer_key(c);
+  if(MODE_FUNCTION == calc_mode) {
+    if(is_digit(c)) return function_keys[c - '0'];
+    if('*' == c)    return GRAPH_MODE;
+    if(graph_mode)  return c;
+    if('+' == c)    return STATISTICS_MODE;
+    if('-' == c)    return PROGRAMMER_MODE;
+  }
+  else if(statistics_mode && !graph_mode && MODE_MEMORY != calc_mode && '+' == c) {
+    return STATISTICS_ADD;
+  }
+  return c;
 }
 
 
@@ -168,7 +285,8 @@ bool is_deferred_command(Calc_Command cmd) {
 //  Return true if the user can backspace in the accumulator
 //
 bool can_backspace() {
-  return !restart && accumulator != "0" && accumulator != "";
+  if(programmer_mode) return !restart && 0 != integer;
+  return !restart && !accumulator.is_clear();
 }
 
 
@@ -179,7 +297,7 @@ bool can_backspace() {
 //  The display has four distinct parts:
 //  The annunciator at the top shows calculator status
 //  The Accumulator shows the current total
-//  The Info area may pop up instructions
+//  The Info area may pop up instructions, or preview the result of a calculation
 //  Button Labels title the A/B/C buttons
 //
 ////////////////////////////////////////////////////////////////////////////////
@@ -187,23 +305,221 @@ bool can_backspace() {
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Clear the area used to display additional info
+//  Screen Model
+//
+//  Each line of text on the screen remembers what it shows, so a redraw only
+//  repaints the glyphs that changed (see retained_text.h.)
+//  The annunciator and label bars are painted once, by display_frame().
+//  The annunciator and the Accumulator's line of text are drawn off-screen and
+//  pushed to the panel in one transfer (see region_buffer.h.)
+//
+Region_Buffer ann_region  = { 0,                            ANN_TOP,                  SCREEN_WIDTH, ANN_HEIGHT,      ANN_BG_COLOR };
+Region_Buffer acc_region  = { 0,                            ACC_TOP + ACC_V_MARGIN,   SCREEN_WIDTH, ACC_TEXT_HEIGHT, ACC_BG_COLOR };
+
+Retained_Text ann_memory  = { ANN_H_MARGIN,                 ANN_TOP + ANN_V_MARGIN,          TL_DATUM, ANN_FG_COLOR,   ANN_BG_COLOR,   &ann_region };
+Retained_Text ann_status  = { SCREEN_WIDTH - ANN_H_MARGIN,  ANN_TOP + ANN_V_MARGIN,          TR_DATUM, ANN_FG_COLOR,   ANN_BG_COLOR,   &ann_region };
+Retained_Text acc_text    = { SCREEN_WIDTH - ACC_H_MARGIN,  ACC_TOP + ACC_V_MARGIN,          TR_DATUM, ACC_FG_COLOR,   ACC_BG_COLOR,   &acc_region };
+Retained_Text acc_split   = { SCREEN_WIDTH - ACC_H_MARGIN,  ACC_TOP + ACC_V_MARGIN + ACC_SPLIT_OFFSET, TR_DATUM, ACC_FG_COLOR, ACC_BG_COLOR, &acc_region };
+Retained_Text info_line[INFO_LINES] = {
+                            { SCREEN_H_CENTER,              INFO_TOP + INFO_V_MARGIN,        TC_DATUM, INFO_FG_COLOR,  INFO_BG_COLOR  },
+                            { SCREEN_H_CENTER,              INFO_TOP + INFO_V_MARGIN + 30,   TC_DATUM, INFO_FG_COLOR,  INFO_BG_COLOR  },
+                            { SCREEN_H_CENTER,              INFO_TOP + INFO_V_MARGIN + 55,   TC_DATUM, INFO_FG_COLOR,  INFO_BG_COLOR  }
+};
+Retained_Text label_a     = { LABEL_BTN_A_CENTER,           LABEL_TOP + LABEL_V_MARGIN,      TC_DATUM, LABEL_FG_COLOR, LABEL_BG_COLOR };
+Retained_Text label_b     = { LABEL_BTN_B_CENTER,           LABEL_TOP + LABEL_V_MARGIN,      TC_DATUM, LABEL_FG_COLOR, LABEL_BG_COLOR };
+Retained_Text label_c     = { LABEL_BTN_C_CENTER,           LABEL_TOP + LABEL_V_MARGIN,      TC_DATUM, LABEL_FG_COLOR, LABEL_BG_COLOR };
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Screen Text
+//
+//  The Accumulator, annunciator and Info area are drawn in two steps: the text each
+//  line shows is composed from the state (compose_...()), then shown (display_...()).
+//  The text composed for each workspace is kept with the state it was composed from,
+//  so switching back to a workspace shows its text as it was left, without composing
+//  any area whose part of the state hasn't changed since (see changed_areas()).
+//  Only the glyphs that differ from the workspace shown before are then repainted.
+//  Used only by the renderer.
+//
+struct Shown_Text {
+  uint8_t   font;
+  char      text[RETAINED_TEXT_SIZE + 1];
+};
+
+struct Screen_Text {
+  Shown_Text  acc;
+  Shown_Text  acc_split;                  // Low binary digits under the rest, in programmer mode
+  Shown_Text  ann_status;
+  Shown_Text  ann_memory;
+  Shown_Text  info[INFO_LINES];
+};
+
+struct Workspace_Screen {
+  Calc_State  state;                      // The state the text was composed from
+  Screen_Text text;
+  bool        valid;
+};
+
+Workspace_Screen workspace_screens[WORKSPACES];
+
+static void compose(Shown_Text& shown, const char* text, uint8_t font) {
+  strncpy(shown.text, text, RETAINED_TEXT_SIZE);   // As much as a Retained_Text shows
+  shown.text[RETAINED_TEXT_SIZE] = '\0';
+  shown.font = font;
+}
+
+static void show(Retained_Text& rt, const Shown_Text& shown) {
+  draw_retained_text(rt, shown.text, shown.font);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Paint the background of every area, and forget any text that was on the screen,
+//  and the text composed for every workspace.
 //
-void clear_info() {
-  M5.Lcd.fillRect(0, INFO_TOP, SCREEN_WIDTH, INFO_HEIGHT, INFO_BG_COLOR);
+void display_frame() {
+  PROFILE_SCOPE(PROFILE_DISPLAY_FRAME);
+  M5.Lcd.fillRect(0, ANN_TOP, SCREEN_WIDTH, ANN_HEIGHT, ANN_BG_COLOR);
+  M5.Lcd.fillRect(0, ANN_TOP + ANN_HEIGHT, SCREEN_WIDTH, LABEL_TOP - ANN_TOP - ANN_HEIGHT, BG_COLOR);
+  M5.Lcd.fillRect(0, LABEL_TOP, SCREEN_WIDTH, LABEL_HEIGHT, LABEL_BG_COLOR);
+  region_buffer_clear(ann_region);
+  region_buffer_clear(acc_region);
+  forget_retained_text(ann_memory);
+  forget_retained_text(ann_status);
+  forget_retained_text(acc_text);
+  forget_retained_text(acc_split);
+  for(auto& line : info_line) forget_retained_text(line);
+  forget_retained_text(label_a);
+  forget_retained_text(label_b);
+  forget_retained_text(label_c);
+  for(auto& screen : workspace_screens) screen.valid = false;
+  render_mark(AREA_ALL);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Show info about using the memory command when in memory_mode
+//  Show info about using the memory command when in memory_mode, and the function keys after M .
+//  (the bitwise operators and hex digits in programmer mode.)
+//  Otherwise, in graph mode show how to build a formula, in statistics mode show the statistics;
+//  if a calculation is pending, preview what = would give. Else leave the Info area empty.
+//  While the tape is being scrolled, show it instead.
 //
-void display_memory_info() {
-  if(!memory_mode) return;
-  M5.Lcd.setTextColor(INFO_FG_COLOR, INFO_BG_COLOR);  // Blank space erases background w/ background color set
-  M5.Lcd.drawCentreString("Memory Commands", SCREEN_H_CENTER, INFO_TOP + INFO_V_MARGIN, INFO_FONT);
-  M5.Lcd.drawCentreString("M M  Recall      M =  Save      M AC  Clear", SCREEN_H_CENTER, INFO_TOP + INFO_V_MARGIN + 30, INFO_FONT);
-  M5.Lcd.drawCentreString("Also  M+  M-  M*  M/  M%  to change Memory", SCREEN_H_CENTER, INFO_TOP + INFO_V_MARGIN + 55, INFO_FONT);
+const char* memory_help[INFO_LINES] = {
+  "Memory Commands        M .  Functions",
+  "M M  Recall      M =  Save      M AC  Clear",
+  "Also  M+  M-  M*  M/  M%  to change Memory"
+};
+const char* function_help[INFO_LINES] = {
+  "Functions (deg)   + Stats   - Prog   * Graph",
+  "7 sin    8 cos    9 tan    4 ln    5 e^x    6 log",
+  "1 sqrt    2 x^2    3 x^y    0 1/x"
+};
+const char* programmer_memory_help[INFO_LINES] = {
+  "Memory Commands        M .  Hex Digits",
+  "M M  Recall      M =  Save      M AC  Clear",
+  "M* and   M+ or   M- xor   M% <<   M/ >>"
+};
+const char* programmer_function_help[INFO_LINES] = {
+  "Hex Digits     ` Not     - Leave Programmer",
+  "0 A    1 B    2 C    3 D    4 E    5 F",
+  ". changes the base: DEC HEX BIN OCT"
+};
+const char* graph_help[INFO_LINES] = {
+  "Graph      % types x      = Plot      AC Clear",
+  "M . digits: functions of the operand before",
+  "` negates      B C zoom the plot out and in"
+};
+const char* graph_function_help[INFO_LINES] = {
+  "Functions (deg)           * Leave Graph",
+  "7 sin    8 cos    9 tan    4 ln    5 e^x    6 log",
+  "1 sqrt    2 x^2    3 x^y    0 1/x"
+};
+
+// Programmer mode values in the annunciator and Info area: binary is written in hex there, as 64 digits won't fit
+static void integer_text(char* text, int64_t value, Radix radix) {
+  if(RADIX_BINARY == radix) {
+    *text++ = '0';
+    *text++ = 'x';
+    radix   = RADIX_HEX;
+  }
+  programmer_format(text, value, radix);
+}
+
+// "mean 12.5", rounded to INFO_STAT_DIGITS, or in scientific notation if it's long
+static char* statistic_text(char* p, const char* label, const Decimal& value) {
+  Decimal shown = decimal_round_to(value, INFO_STAT_DIGITS);
+  while(*label) *p++ = *label++;
+  *p++ = ' ';
+  uint8_t n = format_fixed(p, INFO_STAT_DIGITS + 4, shown, display_locale);
+  if(0 == n) n = format_scientific(p, shown, INFO_STAT_DIGITS - 3, display_locale);
+  return p + n;
+}
+
+static void compose_statistics(const Statistics& stats, Screen_Text& shown) {
+  char  line[3 * (FORMAT_SCIENTIFIC_SIZE + 8)];
+  char* p = statistic_text(line, "n", decimal_make(stats.count, 0));
+  strcpy(p, "    ");
+  statistic_text(p + 4, "sum", stats.sum);
+  compose(shown.info[0], line, INFO_FONT);
+  p = statistic_text(line, "mean", statistics_mean(stats));
+  strcpy(p, "    ");
+  statistic_text(p + 4, "sd", statistics_deviation(stats));
+  compose(shown.info[1], line, INFO_FONT);
+  p = statistic_text(line, "min", stats.min);
+  strcpy(p, "    ");
+  statistic_text(p + 4, "max", stats.max);
+  compose(shown.info[2], line, INFO_FONT);
+}
+
+static void compose_info(const Calc_State& state, Screen_Text& shown) {
+  char  preview[2 + NUMBER_TEXT_SIZE] = "";
+  if(state.history_view) {
+    char line[HISTORY_TEXT_SIZE];
+    for(uint8_t i = 0; i < INFO_LINES; i++) {
+      line[0] = '\0';
+      if(i < state.tape_lines) history_entry_text(line, state.tape[i], display_locale);
+      compose(shown.info[i], line, INFO_FONT);
+    }
+    return;
+  }
+  const char** help = nullptr;
+  if(state.memory_mode)   help = state.programmer_mode ? programmer_memory_help : memory_help;
+  if(state.function_mode) help = state.programmer_mode ? programmer_function_help : state.graph_mode ? graph_function_help : function_help;
+  if(!help && state.graph_mode) help = graph_help;
+  if(help) {
+    for(uint8_t i = 0; i < INFO_LINES; i++) compose(shown.info[i], help[i], INFO_FONT);
+    return;
+  }
+  if(state.programmer_mode) {
+    if(state.integer_expression.depth > 0) {
+      strcpy(preview, "= ");
+      integer_text(preview + 2, state.integer_preview, state.radix);
+    }
+  }
+  else if(state.statistics_mode) {
+    compose_statistics(state.statistics, shown);
+    return;
+  }
+  else if(state.expression.depth > 0) {
+    Number value;
+    value.set_decimal(state.preview);
+    strcpy(preview, "= ");
+    value.to_text(preview + 2, display_locale);
+  }
+  compose(shown.info[0], preview, INFO_FONT);
+  compose(shown.info[1], "", INFO_FONT);
+  compose(shown.info[2], "", INFO_FONT);
+}
+
+// The text is composed again only if it is stale
+void display_info(const Calc_State& state, Screen_Text& shown, bool stale) {
+  Stage_Timer timer(STAGE_INFO);
+  PROFILE_SCOPE(PROFILE_DISPLAY_INFO);
+  if(stale) compose_info(state, shown);
+  for(uint8_t i = 0; i < INFO_LINES; i++) show(info_line[i], shown.info[i]);
 }
 
 
@@ -211,71 +527,307 @@ void display_memory_info() {
 //
 //  Show the calculator's status in the annunciator at the top-right of the screen.
 //  Display the Memory in the upper left corner.
-//  On the right, show an 'M' if in memory mode, followed by any operation that may be pending.
-//
-void display_annunciator() {
-  String display = "                ";                        // With background text color set, this does erasing for us.
-  bool memory_is_clear   = memory   == "0" || memory   == ""; // True if nothing stored in memory.
-  bool opperand_is_clear = opperand == "0" || opperand == ""; // True if nothing stored in the operand.
-  M5.Lcd.fillRect(0, 0, SCREEN_WIDTH, ANN_HEIGHT, ANN_BG_COLOR);  // Erase from the top of the screen
-  if(memory_mode) display += "M";                             // Show M if entering a memory command.
-  if(!opperand_is_clear) display += " " + opperand;           // Display the number we're opperating one
-  switch(command) {
-    case ADD:      display += " +"; break;                    // Add any pending operation to the annunciator
-    case SUBTRACT: display += " -"; break;
-    case MULTIPLY: display += " *"; break;
-    case DIVIDE:   display += " /"; break;
-    default:                        break;
-  }
-  M5.Lcd.setTextColor(ANN_FG_COLOR, ANN_BG_COLOR);            // Blank space erases background w/ background color set
-  M5.Lcd.setTextDatum(TR_DATUM);                              // Print right-justified, relative to end of string
-  M5.Lcd.drawString(display, SCREEN_WIDTH - ANN_H_MARGIN, ANN_TOP + ANN_V_MARGIN, ANN_FONT);
-  M5.Lcd.setTextDatum(TL_DATUM);                              // Go back to normal text alignment
-  M5.Lcd.setCursor(ANN_H_MARGIN, ANN_TOP + ANN_V_MARGIN, ANN_FONT);
-  if(!memory_is_clear) {
-    M5.Lcd.print(memory);                                     // Show memory in upper left corner
-  }
-  clear_info();                                               // Erase the area used to display extra info
-  if(memory_mode) display_memory_info();                      // Display help on using memory
-}
-
-
-
-////////////////////////////////////////////////////////////////////////////////
-//
-//  Show the main number of interest near the top of the screen.
-//  If it's too wide to fit, use a smaller font.
-//
-void display_accumulator() {
-  uint8_t   font  = ACC_FONT_1;
-  uint16_t  wid   = SCREEN_WIDTH - (2 * ACC_H_MARGIN);
-  // Select the font that fits the display
-  M5.Lcd.setTextFont(font);
-  if(wid < M5.Lcd.textWidth(accumulator)) {
-    font = ACC_FONT_2;
-    M5.Lcd.setTextFont(font);
-    if(wid < M5.Lcd.textWidth(accumulator)) {
-      font = ACC_FONT_3;
+//  On the right, show any problem with the last calculation, the workspace unless it's the first,
+//  the radix in programmer mode (or STAT in statistics mode, or GRAPH and the plot's window in
+//  graph mode), an 'M' if in memory mode (an 'F' after M .), followed by the calculation that is pending.
+//
+// "x -10 to 10  y -2 to 4 ": the window of a plot
+static char* window_text(char* p, const Graph_Window& w) {
+  Number  bound;
+  Decimal x = graph_x_bound(w);
+  x.negative = true;
+  bound.set_decimal(x);
+  p = stpcpy(p, "x ");
+  bound.to_text(p, display_locale);
+  p = stpcpy(p + strlen(p), " to ");
+  bound.negate();
+  bound.to_text(p, display_locale);
+  p = stpcpy(p + strlen(p), "  y ");
+  bound.set_decimal(graph_y_bound(w, false));
+  bound.to_text(p, display_locale);
+  p = stpcpy(p + strlen(p), " to ");
+  bound.set_decimal(graph_y_bound(w, true));
+  bound.to_text(p, display_locale);
+  return stpcpy(p + strlen(p), " ");
+}
+
+static void compose_annunciator(const Calc_State& state, Screen_Text& shown) {
+  char  display[20 + PROGRAMMER_DEPTH * (NUMBER_TEXT_SIZE + 4)] = "";   // Programmer mode has the deeper expression
+  char  number[NUMBER_TEXT_SIZE]                                = "";
+  char  op[4]                                                   = " ?";
+  Number value;
+  switch(state.status) {
+    case DECIMAL_UNDERFLOW:      strcat(display, "UNDERFLOW "); break;
+    case DECIMAL_OVERFLOW:       strcat(display, "OVERFLOW ");  break;
+    case DECIMAL_DIVIDE_BY_ZERO: strcat(display, "DIV BY 0 ");  break;
+    case DECIMAL_INVALID:        strcat(display, "ERROR ");     break;
+    default:                                                    break;
+  }
+  if(state.workspace > 0) {                                   // W2 or W3: the first workspace goes unmarked
+    char name[] = "W1 ";
+    name[1] += state.workspace;
+    strcat(display, name);
+  }
+  if(state.programmer_mode) {
+    strcat(display, programmer_radix_name(state.radix));
+    strcat(display, " ");
+  }
+  else if(state.graph_mode) {
+    strcat(display, "GRAPH ");
+    if(state.graph_plotted) window_text(display + strlen(display), state.graph_window);
+  }
+  else if(state.statistics_mode) strcat(display, "STAT ");
+  if(state.memory_mode) strcat(display, "M");                 // Show M if entering a memory command.
+  if(state.function_mode) strcat(display, "F");               // Or F if choosing a function.
+  uint8_t depth = state.programmer_mode ? state.integer_expression.depth : state.expression.depth;
+  if(state.graph_mode) depth = 0;                             // The calculation waits until graph mode is left
+  for(uint8_t i = 0; i < depth; i++) {                        // Display each number and the operation pending on it
+    if(state.programmer_mode) {
+      integer_text(number, state.integer_expression.value[i], state.radix);
+      op[1] = state.integer_expression.op[i];
+      op[2] = '<' == op[1] || '>' == op[1] ? op[1] : '\0';     // A shift: << or >>
+    }
+    else {
+      value.set_decimal(state.expression.value[i]);
+      value.to_text(number, display_locale);
+      op[1] = state.expression.op[i];
+    }
+    strcat(display, " ");
+    strcat(display, number);
+    strcat(display, op);
+  }
+  compose(shown.ann_status, display, ANN_FONT);               // Right-justified
+  number[0] = '\0';
+  if(!state.memory.is_clear()) state.memory.to_text(number, display_locale); // Show memory in upper left corner
+  compose(shown.ann_memory, number, ANN_FONT);
+}
+
+void display_annunciator(const Calc_State& state, Screen_Text& shown, bool stale) {
+  Stage_Timer timer(STAGE_ANNUNCIATOR);
+  PROFILE_SCOPE(PROFILE_DISPLAY_ANNUNCIATOR);
+  if(stale) compose_annunciator(state, shown);
+  show(ann_status, shown.ann_status);
+  show(ann_memory, shown.ann_memory);
+  region_buffer_push(ann_region);                             // Send both sides to the panel at once
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Show the main number of interest near the top of the screen, in the largest font it fits.
+//  A result (but not a number being typed) that doesn't fit with plain digits may be
+//  shown in scientific notation instead: 1e12 in a large font rather than 1000000000000 in a small one.
+//  If it still doesn't fit in the smallest font, it is rounded to fewer digits.
+//  The Accumulator keeps its own width in each font up to date (see glyph_width.h), so
+//  fitting a number being typed doesn't measure anything; the locale's point and digit
+//  separators only add a width per glyph. A font without the separator groups digits
+//  with a space instead, so 1 234 567 can stay in the largest.
+//  In programmer mode the integer is shown in the radix instead. Binary too long for one
+//  line in the smallest font is split, with the low ACC_SPLIT_DIGITS digits on a second line
+//  under the rest, so the bits stay in columns.
+//  In graph mode the formula is shown, with the number being typed into it. ACC_FONT_1 has
+//  only digits, so it starts in ACC_FONT_2; if it won't fit in the smallest, the end is shown.
+//
+static const uint8_t acc_fonts[] = { ACC_FONT_1, ACC_FONT_2, ACC_FONT_3 };
+
+// The display locale's separator, or a space in a font without it: ACC_FONT_1 has no comma
+static char font_separator(uint8_t font) {
+  char separator = display_locale.separator;
+  return 0 == separator || glyph_width(separator, font) ? separator : ' ';
+}
+
+static void compose_formula(const Calc_State& state, Screen_Text& shown) {
+  uint16_t  wid     = SCREEN_WIDTH - (2 * ACC_H_MARGIN);
+  char      text[4 + GRAPH_TEXT_SIZE + 1 + NUMBER_TEXT_SIZE] = "y = ";
+  char*     p       = text + 4 + graph_text(text + 4, state.graph_formula, display_locale);
+  if(state.graph_typing) {
+    if(graph_operand_ends(state.graph_formula)) *p++ = '*';   // As it will join the formula
+    state.accumulator.to_text(p, display_locale);
+  }
+  compose(shown.acc_split, "", ACC_FONT_3);
+  const char* start = text;
+  uint8_t     font  = ACC_FONT_2;
+  if(!text_fits(start, font, wid)) {
+    font = ACC_FONT_3;
+    while(strlen(start) > RETAINED_TEXT_SIZE || !text_fits(start, font, wid)) start++;
+  }
+  compose(shown.acc, start, font);
+}
+
+static void compose_integer(const Calc_State& state, Screen_Text& shown) {
+  uint16_t  wid     = SCREEN_WIDTH - (2 * ACC_H_MARGIN);
+  char      text[PROGRAMMER_TEXT_SIZE];
+  uint8_t   length  = programmer_format(text, state.integer, state.radix);
+  for(uint8_t font : acc_fonts) {
+    if(text_fits(text, font, wid)) {
+      compose(shown.acc, text, font);
+      compose(shown.acc_split, "", ACC_FONT_3);
+      return;
     }
   }
-  M5.Lcd.fillRect(0, ACC_TOP, SCREEN_WIDTH, ACC_HEIGHT, ACC_BG_COLOR);
-  M5.Lcd.setTextColor(ACC_FG_COLOR, ACC_BG_COLOR);  // Blank space erases background w/ background color set
-  M5.Lcd.setTextDatum(TR_DATUM);                    // Print right-justified, relative to end of string
-  M5.Lcd.drawString(accumulator, SCREEN_WIDTH - ACC_H_MARGIN, ACC_TOP + ACC_V_MARGIN, font);
-  M5.Lcd.setTextDatum(TL_DATUM);                    // Go back to normal text alignment
+  compose(shown.acc_split, text + length - ACC_SPLIT_DIGITS, ACC_FONT_3);
+  text[length - ACC_SPLIT_DIGITS] = '\0';
+  compose(shown.acc, text, ACC_FONT_3);
+}
+
+static void compose_accumulator(const Calc_State& state, Screen_Text& shown) {
+  uint16_t  wid     = SCREEN_WIDTH - (2 * ACC_H_MARGIN);
+  bool      typing  = state.can_backspace;
+  char      text[NUMBER_TEXT_SIZE];
+  uint8_t   font    = 0;
+
+  if(state.programmer_mode) {
+    compose_integer(state, shown);
+    return;
+  }
+  if(state.graph_mode) {
+    compose_formula(state, shown);
+    return;
+  }
+  compose(shown.acc_split, "", ACC_FONT_3);             // Only programmer mode uses the second line
+  Locale    locale  = display_locale;
+  for(uint8_t i = 0; i < sizeof(acc_fonts); i++) {
+    font = acc_fonts[i];
+    locale.separator = font_separator(font);
+    if(state.accumulator.fits(font, wid, locale)) {
+      state.accumulator.to_text(text, locale);
+      compose(shown.acc, text, font);                     // Right-justified
+      return;
+    }
+    if(!typing) {
+      format_scientific(text, state.accumulator.to_decimal(), DECIMAL_DIGITS, locale);
+      if(text_fits(text, font, wid)) break;
+    }
+  }
+  if(typing) {
+    state.accumulator.to_text(text, locale);              // Can't happen: NUMBER_DIGITS always fit
+  }
+  else {
+    Decimal value   = state.accumulator.to_decimal();
+    for(uint8_t digits = DECIMAL_DIGITS - 1; digits > 0 && !text_fits(text, font, wid); digits--) {
+      format_scientific(text, value, digits, locale);     // Still too wide in the smallest font
+    }
+  }
+  compose(shown.acc, text, font);
+}
+
+// The second line first: the first line may grow over where it was
+void display_accumulator(const Calc_State& state, Screen_Text& shown, bool stale) {
+  Stage_Timer timer(STAGE_ACCUMULATOR);
+  PROFILE_SCOPE(PROFILE_DISPLAY_ACCUMULATOR);
+  if(stale) compose_accumulator(state, shown);
+  show(acc_split, shown.acc_split);
+  show(acc_text, shown.acc);
+  region_buffer_push(acc_region);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 //  Show the button labels, which may be state dependent
+//  After M, A names the workspace it switches to.
 //
-void display_button_labels() {
-  M5.Lcd.setTextColor(LABEL_FG_COLOR, LABEL_BG_COLOR);  // Blank space erases background w/ background color set
-  M5.Lcd.fillRect(0, LABEL_TOP, SCREEN_WIDTH, LABEL_HEIGHT, LABEL_BG_COLOR);
-  if(can_backspace()) M5.Lcd.drawCentreString("BKSPC", LABEL_BTN_A_CENTER, LABEL_TOP + LABEL_V_MARGIN, LABEL_FONT);
-  // M5.Lcd.drawCentreString("V", LABEL_BTN_B_CENTER, LABEL_TOP + LABEL_V_MARGIN, LABEL_FONT);
-  // M5.Lcd.drawCentreString("V", LABEL_BTN_C_CENTER, LABEL_TOP + LABEL_V_MARGIN, LABEL_FONT);
+static const char* workspace_names[WORKSPACES] = { "TO W1", "TO W2", "TO W3" };
+
+void display_button_labels(const Calc_State& state) {
+  Stage_Timer timer(STAGE_LABELS);
+  PROFILE_SCOPE(PROFILE_DISPLAY_BUTTON_LABELS);
+  const char* older = "";
+  const char* newer = "";
+  if(0 == state.history_view)                               older = state.history_count ? "HISTORY" : "";
+  else if(state.history_view + INFO_LINES - 1 < state.history_count) older = "OLDER";
+  if(state.history_view)                                    newer = 1 == state.history_view ? "CLOSE" : "NEWER";
+  const char* back = state.can_backspace ? "BKSPC" : "";
+  if(state.graph_plotted) {
+    older = state.graph_window.zoom + 1 < GRAPH_ZOOMS ? "ZOOM OUT" : "";
+    newer = state.graph_window.zoom > 0               ? "ZOOM IN"  : "";
+  }
+  else if(state.memory_mode && !state.graph_mode) {
+    older = state.can_undo ? "UNDO" : "";
+    newer = state.can_redo ? "REDO" : "";
+    back  = workspace_names[(state.workspace + 1) % WORKSPACES];
+  }
+  draw_retained_text(label_a, back, LABEL_FONT);
+  draw_retained_text(label_b, older, LABEL_FONT);
+  draw_retained_text(label_c, newer, LABEL_FONT);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Plot the formula over the Accumulator and Info areas, straight onto the panel a
+//  column at a time, so the curve appears from the left as its points are worked out.
+//  Each column joins its point to the one before with a vertical line, unless the
+//  curve went off one edge and came back at the other: an asymptote, as of tan.
+//  Leaving the plot paints over it, and forgets the text that was under it.
+//
+void display_graph(const Calc_State& state) {
+  PROFILE_SCOPE(PROFILE_DISPLAY_GRAPH);
+  const Graph_Window& w = state.graph_window;
+  M5.Lcd.fillRect(0, GRAPH_TOP, SCREEN_WIDTH, GRAPH_HEIGHT, GRAPH_BG_COLOR);
+  int16_t axis = graph_row(w, 0, GRAPH_HEIGHT);
+  if(axis >= 0 && axis < GRAPH_HEIGHT) M5.Lcd.drawFastHLine(0, GRAPH_TOP + axis, SCREEN_WIDTH, GRAPH_AXIS_COLOR);
+  M5.Lcd.drawFastVLine(GRAPH_ORIGIN, GRAPH_TOP, GRAPH_HEIGHT, GRAPH_AXIS_COLOR);
+  int16_t last = GRAPH_NO_ROW;
+  for(uint16_t column = 0; column < GRAPH_COLUMNS; column++) {
+    float y;
+    if(!graph_point(state.graph_program, w, column, y)) {
+      last = GRAPH_NO_ROW;
+      continue;
+    }
+    int16_t row   = graph_row(w, y, GRAPH_HEIGHT);
+    int16_t from  = row;                    // From just past the point before, towards this one
+    bool    jump  = (last < 0 && row >= GRAPH_HEIGHT) || (last >= GRAPH_HEIGHT && row < 0);
+    if(GRAPH_NO_ROW != last && !jump) from = last < row ? last + 1 : last > row ? last - 1 : row;
+    int16_t top     = from < row ? from : row;
+    int16_t bottom  = from < row ? row : from;
+    if(top < 0)                 top     = 0;
+    if(bottom >= GRAPH_HEIGHT)  bottom  = GRAPH_HEIGHT - 1;
+    if(top <= bottom) M5.Lcd.drawFastVLine(column, GRAPH_TOP + top, bottom - top + 1, GRAPH_FG_COLOR);
+    last = row;
+  }
+}
+
+void hide_graph() {
+  M5.Lcd.fillRect(0, GRAPH_TOP, SCREEN_WIDTH, GRAPH_HEIGHT, BG_COLOR);
+  region_buffer_clear(acc_region);
+  forget_retained_text(acc_text);
+  forget_retained_text(acc_split);
+  for(auto& line : info_line) forget_retained_text(line);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Draw the latest published state, in the areas marked since the last frame
+//  (see render_schedule.h.) Nothing if none are. Text is composed again only for the
+//  areas that changed since it was last composed for the workspace (see Screen Text.)
+//
+uint8_t changed_areas(const Calc_State& a, const Calc_State& b);   // Under Rendering Task, below
+
+void render() {
+  PROFILE_SCOPE(PROFILE_RENDER);
+  uint8_t areas = render_take();
+  if(0 == areas) return;
+  Calc_State state;
+  published_state.read(state);
+  Workspace_Screen& screen = workspace_screens[state.workspace];
+  uint8_t stale = screen.valid ? changed_areas(screen.state, state) : AREA_ALL;
+  memcpy((void*)&screen.state, (const void*)&state, sizeof(state));
+  screen.valid  = true;
+  areas        |= stale & (AREA_ACCUMULATOR | AREA_ANNUNCIATOR | AREA_INFO);  // Kept up to date, even if unchanged on the screen
+  if(state.graph_plotted) {
+    if(areas & AREA_GRAPH)     display_graph(state);
+    areas &= ~(AREA_ACCUMULATOR | AREA_INFO);           // Under the plot
+  }
+  else if(areas & AREA_GRAPH)  hide_graph();
+  if(areas & AREA_ACCUMULATOR) display_accumulator(state, screen.text, stale & AREA_ACCUMULATOR);
+  if(areas & AREA_ANNUNCIATOR) display_annunciator(state, screen.text, stale & AREA_ANNUNCIATOR);
+  if(areas & AREA_INFO)        display_info(state, screen.text, stale & AREA_INFO);  // Help on using memory, the preview or the tape
+  if(areas & AREA_LABELS)      display_button_labels(state);
+  render_counters.frames++;
+  render_counters.areas += __builtin_popcount(areas);
 }
 
 
@@ -283,358 +835,1451 @@ void display_button_labels() {
 //
 //  Command Processing Routines
 //
-//  Comands respond in two different modes: Normal and Memory
-//  Memory commands are two-key commands, so once M is pressed, the next command is a Memory Command.
-//  At all other times, commands are executed in normal mode.
+//  Each command is an action, picked by the transition table in state_machine.h
+//  from the command and the mode the calculator is in. Every action is a routine
+//  taking the key that was pressed: a digit, or the operator for the operators.
 //  Some are immediate (CLEAR, SIGN, TOTAL) while others are deferred (ADD, SUBTRACT)
+//  Deferred commands are pushed onto the expression, which applies operator precedence.
 //
 ////////////////////////////////////////////////////////////////////////////////
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Do the actual work of calculation by performing a deferred command.
-//  the opperation to perform is in command.
+//  Store the result of a calculation, noting any overflow, underflow or division by zero.
 //
-void perform_operation() {
-  double acc = string_to_double(accumulator);
-  double opp = string_to_double(opperand);
-
-  switch(command) {
-    case ADD:
-      accumulator = double_to_string(opp + acc);
-      restart     = true;   // New numbers replace accumulator rather than add to it.
-      opperand    = "";
-      break;
-    case SUBTRACT:
-      accumulator = double_to_string(opp - acc);
-      restart     = true;
-      opperand    = "";
-      break;
-    case MULTIPLY:
-      accumulator = double_to_string(opp * acc);
-      restart     = true;
-      opperand    = "";
-      break;
-    case DIVIDE:
-      accumulator = double_to_string(opp / acc);
-      restart     = true;
-      opperand    = "";
-      break;
-    case SIGN:
-      if(accumulator == "0") break;   // Special case for zero
-      if(accumulator.startsWith("-"))
-        accumulator.remove(0, 1);
-      else
-        accumulator = String("-") + accumulator;
-      break;
-    default:
-      restart     = true;   // New numbers replace accumulator rather than add to it.
-      break;
-  }
-  command = NO_COMMAND;
-  display_accumulator();    // All these operations affect the display
+void set_result(Number& target, const Decimal& result) {
+  target.set_decimal(result);
+  status = result.status;
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Percentage is a little more complicated than other operations.
-//  If there is no previous command, divide accumulator by 100.
-//  If previous command was * or /, divide accumulator by 100 and perform_operation.
-//  If previous command was + or -, replace accumulator with current accumulator % of opperand and perform_operation.
+//  Keep an operation on the history tape.
 //
-void perform_percentage() {
-  double acc = string_to_double(accumulator);
+void record(const Decimal& left, char op, const Decimal& right, const Decimal& result, uint8_t flags = 0) {
+  History_Entry entry = { left, right, result, op, flags };
+  history_add(entry);
+}
 
-  if(NO_COMMAND == command) {
-    accumulator = double_to_string(acc / 100.0);
-    display_accumulator();
-  }
-  else if(ADD == command || SUBTRACT == command) {
-    double opp = string_to_double(opperand);
-    accumulator = double_to_string(acc / 100.0 * opp);
-    perform_operation();
-  }
-  else if(MULTIPLY == command || DIVIDE == command) {
-    accumulator = double_to_string(acc / 100.0);
-    perform_operation();
-  }
+void record_operation(const Decimal& left, char op, const Decimal& right, const Decimal& result) {
+  record(left, op, right, result);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  If the M key has been pressed, the next command operates on memory, a little unconventionally:
-//  MA (AC) clears memory. The accumulator and opperand are unchanged.
-//  M+ adds the accumulator to memory. The accumulator and opperand are unchanged.
-//  M- subtracts the accumulator from memory. The accumulator and opperand are unchanged.
-//  M* multiplies memory by the accumulator. The accumulator and opperand are unchanged.
-//  M/ divides memory by the accumulator. The accumulator and opperand are unchanged.
-//  M= sets memory to the value of the accumulator. The accumulator and opperand are unchanged.
-//  M% sets memory to memory / accumulator / 100.
-//  MM sets the accumulator to the value of memory. The opperand is unchanged.
-//  Return true if a memory command was processed, else return false.
-//
-void process_memory_command(Calc_Command cmd) {
-  double acc = string_to_double(accumulator);
-  double mem = string_to_double(memory);
-  switch(cmd) {
-    case CLEAR:
-      memory  = "0";
-      display_accumulator();  // Update display immediately
-      restart = true;         // New numbers replace accumulator rather than add to it.
-      break;
-    case ADD:
-      memory  = double_to_string(mem + acc);
-      restart = true;
-      break;
-    case SUBTRACT:
-      memory  = double_to_string(mem - acc);
-      restart = true;
-      break;
-    case MULTIPLY:
-      memory  = double_to_string(mem * acc);
-      restart = true;
-      break;
-    case DIVIDE:
-      memory  = double_to_string(mem / acc);
-      restart = true;
-      break;
-    case PERCENT:
-      memory  = double_to_string(mem / acc / 100.0);
-      restart = true;
-      break;
-    case TOTAL:
-      memory  = accumulator;
-      restart = true;
-      break;
-    case MEMORY:
-      accumulator = memory;   // Memory recall
-      restart     = true;
-      display_accumulator();  // Update display immediately
-      break;
-    default :
-      break;
-  }
+//  A digit key has been typed. Push it into the accumulator.
+//
+void enter_digit(char key) {
+  status   = DECIMAL_OK;                      // A new number clears any error
+  if(restart) accumulator.clear();            // A command was entered; start getting second value
+  accumulator.append_digit((uint8_t)(key - '0')); // Append digit to the end, replacing a plain zero
+  restart = false;                            // Make sure we don't keep clearing the accumulator
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Handle a calculator command.
+//  Add a decimal point, unless the accumulator already has one.
 //
-void process_calculator_command(Calc_Command cmd) {
-  switch(cmd) {
-    case CLEAR:
-      accumulator = "0";        // Special case for the empty number.
-      display_accumulator();    // Unary operator; display immediately.
-      if(CLEAR == previous) {   // If this is a double-AC
-        memory    = "0";        // Clear everything
-        opperand  = "0";
-        command   = NO_COMMAND;
-      }
-      return;
-    case DECIMAL:
-      // Make sure there's not already a decimal point in the accumulator.
-      if(-1 == accumulator.indexOf(dp)) {
-        if(restart) {
-          accumulator = "0.";   // Special case for when we've just entered a number
-          restart     = false;  // terminate restart mode
-        }
-        else {
-          accumulator += dp;    // Normal case: decimal point always goes at the end.
-        }
-        display_accumulator();  // Unary operator; display immediately.
-      }
-      break;
-    case ADD:
-      command   = ADD;          // Command that will be executed upon receiving TOTAL
-      opperand  = accumulator;  // Number that will be acted upon
-      restart   = true;         // New numbers replace accumulator rather than add to it.
-      break;
-    case SUBTRACT:
-      command   = SUBTRACT;
-      opperand  = accumulator;
-      restart   = true;
-      break;
-    case MULTIPLY:
-      command   = MULTIPLY;
-      opperand  = accumulator;
-      restart   = true;
-      break;
-    case DIVIDE:
-      command   = DIVIDE;
-      opperand  = accumulator;
-      restart   = true;
-      break;
-    case MEMORY:
-      memory_mode = true;       // Enter memory mode, which will effect future commands.
-      break;
-    case SIGN:
-      command   = SIGN;
-      perform_operation();      // command set expressly (SIGN)
-      break;
-    case PERCENT:
-      perform_percentage();     // unary command
-      break;
-    case TOTAL:
-      perform_operation();      // command was set by previous input
-      break;
-    default:
-      break;
+void enter_point(char key) {
+  if(accumulator.has_point()) return;
+  if(restart) {
+    accumulator.clear();        // Special case for when we've just entered a number: "0."
+    restart = false;            // terminate restart mode
   }
+  accumulator.append_point();   // Decimal point always goes at the end.
+}
+
+
+void change_sign(char key) {
+  if(!accumulator.is_clear()) accumulator.negate();   // Special case for zero
 }
 
 
+void clear_accumulator(char key) {
+  accumulator.clear();          // Special case for the empty number.
+  status = DECIMAL_OK;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Input Processing
-//
-//  Read keys from Calculator Keyboard, process digits to build accumulator string.
-//  Identify and dispatch commands to command processors.
+//  A second AC in a row clears everything, including the statistics.
 //
+void clear_all(char key) {
+  clear_accumulator(key);
+  memory.clear();
+  expression_clear(expression);
+  statistics_clear(statistics);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
+//
+//  Push the accumulator and the operator onto the expression.
+//  Any work the operator completes is shown in the accumulator: 2 * 3 + shows 6.
+//
+void push_operator(char op) {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  PROFILE_SCOPE(PROFILE_PUSH_OPERATOR);
+  set_result(accumulator, expression_push(expression, accumulator.to_decimal(), op, record_operation));
+  restart = true;           // New numbers replace accumulator rather than add to it.
+}
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Handle a button press
-//  Currently there is only one button action; backspace on the A button
+//  The previous key was also an operator: the new one replaces it.
 //
-void process_button(uint8_t button) {
-  if(BUTTON_A == button && can_backspace()) {
-    accumulator.remove(accumulator.length() - 1);                   // Remove the last character
-    accumulator = double_to_string(string_to_double(accumulator));  // Fixes up misc problems
-    display_accumulator();
-  }
+void replace_operator(char op) {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  PROFILE_SCOPE(PROFILE_REPLACE_OPERATOR);
+  set_result(accumulator, expression_replace(expression, op, record_operation));
+  restart = true;
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Handle a command from user input. Decide which processor gets  the command.
-//  If it's non-memory-mode, determine if we need to execute a pending command
-//  first (for example: 1 + 1 + 1.)
+//  Complete the pending expression with the accumulator, and show the result.
 //
-void process_command(Calc_Command cmd) {
-  // If the M key has been pressed, then this command should be handled specially.
-  if(memory_mode) {
-    process_memory_command(cmd);
-    memory_mode = false;
-  }
-  else {
-    // If the user presses +, then *, allow the processor to change + to *.
-    // Otherwise, we need to see if there's a pending command to execute.
-    if(is_deferred_command(cmd) && !is_deferred_command(previous)) {
-      if(is_deferred_command(command)) {
-        perform_operation();
-      }
-    }
-    // Now continue with the current operation
-    process_calculator_command(cmd);
-    previous = cmd;
+void perform_total(char key) {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  PROFILE_SCOPE(PROFILE_PERFORM_TOTAL);
+  if(expression.depth > 0) {
+    set_result(accumulator, expression_evaluate(expression, accumulator.to_decimal(), record_operation));
+    expression_clear(expression);
   }
+  restart = true;           // New numbers replace accumulator rather than add to it.
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  A digit key has been typed in NORMAL_INPUT or POST_DECIMAL_INPUT mode.
-//  Push it into the accumulator and display it.
+//  Percentage is a little more complicated than other operations.
+//  If there is no pending operation, divide accumulator by 100.
+//  If the last operation is * or /, divide accumulator by 100 and complete the expression.
+//  If the last operation is + or -, replace accumulator with accumulator % of the number
+//  before the operator and complete the expression.
 //
-void process_digit(uint8_t digit) {
-  assert(digit < 10);                         // Make sure we're just getting 0 - 9.
-  previous = NO_COMMAND;                      // Last thing done was not a command.
-  if(accumulator == "0") accumulator = "";    // Special case for the 'empty' number
-  if(restart)            accumulator = "";    // A command was entered; start getting second value
-  accumulator += String(digit);               // Always simply append digit to the end
-  restart = false;                            // Make sure we don't keep clearing the accumulator
-  display_accumulator();                      // Show the new value
+void perform_percentage(char key) {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  PROFILE_SCOPE(PROFILE_PERFORM_PERCENTAGE);
+  Decimal acc = accumulator.to_decimal();
+  Decimal pct = decimal_percent(acc);
+  char    op  = expression_operator(expression);
+
+  record(acc, '%', acc, pct);
+  if('+' == op || '-' == op) {
+    acc = pct;
+    pct = decimal_multiply(acc, expression.value[expression.depth - 1]);
+    record(acc, '*', expression.value[expression.depth - 1], pct);
+  }
+  set_result(accumulator, pct);
+  if(op) perform_total(key);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Return true and change ref to input char if key is available, otherwise returns false.
+//  Memory commands: M then another command operates on memory, a little unconventionally.
+//  The expression is unchanged by all of them.
+//  MA (AC) clears memory. The accumulator is unchanged.
+//  M= sets memory to the value of the accumulator. The accumulator is unchanged.
+//  MM sets the accumulator to the value of memory.
 //
-bool read_key(char& input) {
-  if(digitalRead(KEYBOARD_INT) == LOW) {      // If a character is ready
-    Wire.requestFrom(KEYBOARD_I2C_ADDR, 1);   // request 1 byte from keyboard
-    if(Wire.available()) {
-      char key_val = Wire.read();             // receive a byte as character
-      if(0 != key_val) {
-        input = key_val;
-        return true;
-      }
-    }
-  }
-  return false;
+void memory_clear(char key) {
+  memory.clear();
+  restart = true;           // New numbers replace accumulator rather than add to it.
+}
+
+void memory_store(char key) {
+  memory  = accumulator;
+  restart = true;
+}
+
+void memory_recall(char key) {
+  accumulator = memory;
+  restart     = true;
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Read a key from the keyboard, or a button from the M5Stack.
-//  If it's a digit, push it into the accumulator and display it.
-//  If it's a command, execute it.
+//  M+ adds the accumulator to memory. The accumulator is unchanged.
+//  M- subtracts the accumulator from memory. The accumulator is unchanged.
+//  M* multiplies memory by the accumulator. The accumulator is unchanged.
+//  M/ divides memory by the accumulator. The accumulator is unchanged.
+//  M% sets memory to memory / accumulator / 100.
 //
-bool process_input() {
-  char input;
-  M5.update();
-  if(M5.BtnA.wasReleased()) { process_button(BUTTON_A); return true; }
-  if(M5.BtnB.wasReleased()) { process_button(BUTTON_B); return true; }
-  if(M5.BtnC.wasReleased()) { process_button(BUTTON_C); return true; }
+void record_memory(const Decimal& left, char op, const Decimal& right, const Decimal& result) {
+  record(left, op, right, result, HISTORY_MEMORY);
+  set_result(memory, result);
+}
 
-  if(read_key(input)) {
-    if(is_digit(input)) process_digit((uint8_t)input - '0');
-    else {
-      Calc_Command cmd = input_to_command(input);
-      if(NO_COMMAND != cmd)
-        process_command(cmd);
-      else
-        return false;
-    }
-    return true;  // something was processed
+void memory_operation(char op) {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  PROFILE_SCOPE(PROFILE_MEMORY_OPERATION);
+  Decimal acc = accumulator.to_decimal();
+  Decimal mem = memory.to_decimal();
+  Decimal quotient;
+  switch(op) {
+    case '+': record_memory(mem, '+', acc, decimal_add(mem, acc));       break;
+    case '-': record_memory(mem, '-', acc, decimal_subtract(mem, acc));  break;
+    case '*': record_memory(mem, '*', acc, decimal_multiply(mem, acc));  break;
+    case '/': record_memory(mem, '/', acc, decimal_divide(mem, acc));    break;
+    default:
+      quotient = decimal_divide(mem, acc);
+      record(mem, '/', acc, quotient, HISTORY_MEMORY);
+      record_memory(quotient, '%', quotient, decimal_percent(quotient));
+      break;
   }
-  return false;
+  restart = true;
 }
 
 
-
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Arduino Runtime: setup() and loop()
+//  Replace the accumulator with a function of it. key is the FUNCTION_ character.
+//  The pending calculation is unchanged, so 2 + 9 sqrt = gives 5.
 //
+void perform_function(char key) {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  PROFILE_SCOPE(PROFILE_PERFORM_FUNCTION);
+  Decimal x      = accumulator.to_decimal();
+  Decimal result = scientific_function(key, x);
+  record(x, key, x, result);
+  set_result(accumulator, result);
+  restart = true;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
+//
+//  Statistics mode: M . + turns it on or off, and while it is on + adds the
+//  accumulator to the statistics, which the Info area shows. Turning it off keeps
+//  the statistics; AC AC clears them.
+//
+void add_to_statistics(char key) {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  PROFILE_SCOPE(PROFILE_ADD_TO_STATISTICS);
+  Decimal x = accumulator.to_decimal();
+  statistics_add(statistics, x);
+  record(x, STATISTICS_ADD, x, decimal_make(statistics.count, 0));
+  restart = true;
+}
+
+void toggle_statistics(char key) {
+  statistics_mode = !statistics_mode;
+  restart         = true;
+}
+
+
+void do_nothing(char key) {}
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Standard Arduino program initialization function.
+//  Programmer mode: M . - turns it on or off. The accumulator carries across, cut
+//  to its whole part going in; a pending calculation is dropped, as the two modes
+//  can't share one. Memory is kept as a Number, which holds any 64 bit integer exactly.
 //
-void setup() {
-  M5.begin();
-  Wire.begin();
-  M5.Lcd.setTextFont(4);
-  pinMode(KEYBOARD_INT, INPUT_PULLUP);
-  M5.Lcd.fillScreen(BG_COLOR);
-  display_accumulator();
-  display_annunciator();
-  display_button_labels();
+void toggle_programmer(char key) {
+  status = DECIMAL_OK;
+  if(programmer_mode) programmer_to_number(accumulator, integer);
+  else                integer = programmer_from_number(accumulator, status);
+  programmer_mode = !programmer_mode;
+  expression_clear(expression);
+  programmer_clear(integer_expression);
+  restart = true;
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  Standard Arduino program loop
-//  Continually look for input and process it.
+//  The programmer mode actions: the same commands, on the integer accumulator.
+//  Operations go on the tape with their 64 bit values (see history.h.)
 //
-void loop() {
-  // If anything happend, make sure the annunciator is updated
-  if(process_input()) {
-    display_annunciator();
-    display_button_labels();
+Decimal integer_bits(int64_t value) {
+  Decimal bits = { (uint64_t)value, 0, false, DECIMAL_OK };
+  return bits;
+}
+
+void record_integer(int64_t left, char op, int64_t right, int64_t result) {
+  uint8_t flags = HISTORY_INTEGER | (RADIX_DECIMAL == radix ? 0 : HISTORY_HEX);
+  record(integer_bits(left), op, integer_bits(right), integer_bits(result), flags);
+}
+
+void integer_digit(char key) {
+  int64_t value = restart ? 0 : integer;
+  if(!programmer_append_digit(value, (uint8_t)programmer_digit_value(key), radix)) return;  // Not a digit of the radix, or no room
+  integer = value;
+  status  = DECIMAL_OK;
+  restart = false;
+}
+
+void change_radix(char key) {
+  radix = (Radix)((radix + 1) % RADIX_COUNT);
+}
+
+void integer_sign(char key) {
+  integer = (int64_t)(0 - (uint64_t)integer);
+}
+
+void integer_clear(char key) {
+  integer = 0;
+  status  = DECIMAL_OK;
+}
+
+void integer_clear_all(char key) {
+  clear_all(key);
+  integer_clear(key);
+  programmer_clear(integer_expression);
+}
+
+void integer_push(char op) {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  PROFILE_SCOPE(PROFILE_PUSH_OPERATOR);
+  status  = DECIMAL_OK;
+  integer = programmer_push(integer_expression, integer, op, status, record_integer);
+  restart = true;
+}
+
+void integer_replace(char op) {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  PROFILE_SCOPE(PROFILE_REPLACE_OPERATOR);
+  status  = DECIMAL_OK;
+  integer = programmer_replace(integer_expression, op, status, record_integer);
+  restart = true;
+}
+
+void integer_total(char key) {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  PROFILE_SCOPE(PROFILE_PERFORM_TOTAL);
+  if(integer_expression.depth > 0) {
+    status  = DECIMAL_OK;
+    integer = programmer_evaluate(integer_expression, integer, status, record_integer);
+    programmer_clear(integer_expression);
+  }
+  restart = true;
+}
+
+void integer_memory_store(char key) {
+  programmer_to_number(memory, integer);
+  restart = true;
+}
+
+void integer_memory_recall(char key) {
+  status  = DECIMAL_OK;
+  integer = programmer_from_number(memory, status);
+  restart = true;
+}
+
+void integer_not(char key) {
+  record_integer(integer, PROGRAMMER_NOT, integer, ~integer);
+  integer = ~integer;
+  restart = true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Graph mode: M . * turns it on or off (see graph.h.) The accumulator is put aside
+//  going in and comes back going out. Meanwhile it holds the number being typed
+//  into the formula, which joins the formula with the next key that isn't part of
+//  it. % types x, ` negates, = plots and AC clears the formula, or leaves the plot.
+//  Editing the formula leaves the plot too. Memory can be cleared, saved to and
+//  recalled without disturbing the number being typed; the memory operations do nothing.
+//
+void toggle_graph(char key) {
+  if(graph_mode) accumulator = graph_stash;
+  else {
+    graph_stash = accumulator;
+    accumulator.clear();
+    graph_clear(graph_formula);
+    graph_window.zoom = GRAPH_ZOOM_DEFAULT;
+  }
+  graph_mode    = !graph_mode;
+  graph_plotted = false;
+  status        = DECIMAL_OK;
+  restart       = true;
+}
+
+void graph_commit() {
+  if(restart) return;
+  graph_append_number(graph_formula, accumulator.to_decimal());   // There was room when typing it began
+  accumulator.clear();
+  restart = true;
+}
+
+// A key that goes into the number being typed, or starts one if there is room
+bool graph_typing() {
+  if(restart && !graph_has_room(graph_formula, GRAPH_NUMBER)) return false;
+  graph_plotted = false;
+  return true;
+}
+
+void graph_enter_digit(char key) {
+  if(graph_typing()) enter_digit(key);
+}
+
+void graph_enter_point(char key) {
+  if(graph_typing()) enter_point(key);
+}
+
+void graph_memory_recall(char key) {
+  if(!graph_typing()) return;
+  accumulator = memory;
+  restart     = false;
+}
+
+void graph_memory_clear(char key) {
+  memory.clear();
+}
+
+void graph_memory_store(char key) {
+  if(!restart) memory = accumulator;
+}
+
+void graph_token(char token) {
+  graph_commit();
+  graph_append(graph_formula, token);
+  graph_plotted = false;
+}
+
+void graph_x(char key) {
+  graph_token(GRAPH_X);
+}
+
+void graph_sign(char key) {
+  if(restart) graph_token(GRAPH_NEGATE);
+  else        change_sign(key);
+}
+
+void graph_clear_formula(char key) {
+  if(graph_plotted) {
+    graph_plotted = false;
+    return;
+  }
+  graph_clear(graph_formula);
+  clear_accumulator(key);
+  restart = true;
+}
+
+void plot_graph(char key) {
+  PROFILE_SCOPE(PROFILE_PLOT_GRAPH);
+  graph_commit();
+  status = DECIMAL_OK;
+  if(!graph_compile(graph_formula, graph_program)) {
+    status = DECIMAL_INVALID;
+    return;
+  }
+  graph_scale(graph_window, graph_program, graph_window.zoom);
+  graph_plotted = true;
+}
+
+void zoom_graph(bool in) {
+  uint8_t zoom = graph_window.zoom;
+  if(in ? 0 == zoom : GRAPH_ZOOMS - 1 == zoom) return;
+  graph_scale(graph_window, graph_program, in ? zoom - 1 : zoom + 1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The action routines, in Calc_Action order: one table for each mode of arithmetic.
+//  In programmer mode % does nothing, and the memory and statistics operations can't
+//  be reached: after M the operators are the bitwise ones. Graph mode can be turned on
+//  only from the Decimal arithmetic, and the other modes only outside it.
+//
+typedef void (*Calc_Handler)(char key);
+
+const Calc_Handler handlers[] = {
+  do_nothing,             // DO_NOTHING
+  enter_digit,            // DO_DIGIT
+  enter_point,            // DO_POINT
+  change_sign,            // DO_SIGN
+  clear_accumulator,      // DO_CLEAR
+  clear_all,              // DO_CLEAR_ALL
+  push_operator,          // DO_PUSH
+  replace_operator,       // DO_REPLACE
+  perform_percentage,     // DO_PERCENT
+  perform_total,          // DO_TOTAL
+  memory_clear,           // DO_MEMORY_CLEAR
+  memory_store,           // DO_MEMORY_STORE
+  memory_recall,          // DO_MEMORY_RECALL
+  memory_operation,       // DO_MEMORY_OPERATION
+  perform_function,       // DO_FUNCTION
+  add_to_statistics,      // DO_ADD_TO_STATISTICS
+  toggle_statistics,      // DO_TOGGLE_STATISTICS
+  toggle_programmer,      // DO_TOGGLE_PROGRAMMER
+  toggle_graph            // DO_TOGGLE_GRAPH
+};
+static_assert(sizeof(handlers) / sizeof(handlers[0]) == ACTION_COUNT, "One handler per Calc_Action");
+
+const Calc_Handler programmer_handlers[] = {
+  do_nothing,             // DO_NOTHING
+  integer_digit,          // DO_DIGIT
+  change_radix,           // DO_POINT
+  integer_sign,           // DO_SIGN
+  integer_clear,          // DO_CLEAR
+  integer_clear_all,      // DO_CLEAR_ALL
+  integer_push,           // DO_PUSH
+  integer_replace,        // DO_REPLACE
+  do_nothing,             // DO_PERCENT
+  integer_total,          // DO_TOTAL
+  memory_clear,           // DO_MEMORY_CLEAR
+  integer_memory_store,   // DO_MEMORY_STORE
+  integer_memory_recall,  // DO_MEMORY_RECALL
+  do_nothing,             // DO_MEMORY_OPERATION
+  integer_not,            // DO_FUNCTION
+  do_nothing,             // DO_ADD_TO_STATISTICS
+  do_nothing,             // DO_TOGGLE_STATISTICS
+  toggle_programmer,      // DO_TOGGLE_PROGRAMMER
+  do_nothing              // DO_TOGGLE_GRAPH
+};
+static_assert(sizeof(programmer_handlers) / sizeof(programmer_handlers[0]) == ACTION_COUNT, "One handler per Calc_Action");
+
+const Calc_Handler graph_handlers[] = {
+  do_nothing,             // DO_NOTHING
+  graph_enter_digit,      // DO_DIGIT
+  graph_enter_point,      // DO_POINT
+  graph_sign,             // DO_SIGN
+  graph_clear_formula,    // DO_CLEAR
+  graph_clear_formula,    // DO_CLEAR_ALL
+  graph_token,            // DO_PUSH
+  graph_token,            // DO_REPLACE
+  graph_x,                // DO_PERCENT
+  plot_graph,             // DO_TOTAL
+  graph_memory_clear,     // DO_MEMORY_CLEAR
+  graph_memory_store,     // DO_MEMORY_STORE
+  graph_memory_recall,    // DO_MEMORY_RECALL
+  do_nothing,             // DO_MEMORY_OPERATION
+  graph_token,            // DO_FUNCTION
+  do_nothing,             // DO_ADD_TO_STATISTICS
+  do_nothing,             // DO_TOGGLE_STATISTICS
+  do_nothing,             // DO_TOGGLE_PROGRAMMER
+  toggle_graph            // DO_TOGGLE_GRAPH
+};
+static_assert(sizeof(graph_handlers) / sizeof(graph_handlers[0]) == ACTION_COUNT, "One handler per Calc_Action");
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Handle a command from user input: take the action the mode calls for, and move to the next mode.
+//
+void process_command(Calc_Command cmd, char key) {
+  Stage_Timer timer(STAGE_PROCESS);
+  Calc_Transition transition = calc_transitions[calc_mode][cmd];
+  (programmer_mode ? programmer_handlers : graph_mode ? graph_handlers : handlers)[transition.action](key);
+  calc_mode = (Calc_Mode)transition.next;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Input Processing
+//
+//  Read keys from Calculator Keyboard, process digits to build accumulator string.
+//  Identify and dispatch commands to command processors.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Undo and Redo (see undo.h)
+//
+//  Each key that changes the state, and each backspace, is a step that M B undoes
+//  and M C redoes. Steps start outside memory and function modes, so M AC or M . 7
+//  is one step, and the M before B or C isn't a step of its own.
+//  The state is snapshotted as a step starts, and recorded as it ends if it changed.
+//  The history tape isn't part of the state: undoing a calculation leaves it on the tape.
+//  Nor is graph mode: its keys aren't steps, and after M, B and C scroll the tape there.
+//
+Undo_Snapshot undo_before;                // The state as the current step started, if valid
+
+void get_saved_state(Saved_State& state);   // Under Saving State, below
+void set_saved_state(const Saved_State& state);
+
+bool in_prefix() {
+  return MODE_MEMORY == calc_mode || MODE_FUNCTION == calc_mode;
+}
+
+// Zeroed first, so snapshots of the same state are the same bytes
+void take_snapshot(Undo_Snapshot& snapshot) {
+  memset((void*)&snapshot, 0, sizeof(snapshot));
+  get_saved_state(snapshot.state);
+  snapshot.mode   = (uint8_t)calc_mode;
+  snapshot.valid  = true;
+}
+
+void begin_step() {
+  if(!in_prefix() && !graph_mode) take_snapshot(undo_before);
+}
+
+void end_step() {
+  if(in_prefix() || graph_mode || !undo_before.valid) return;
+  Undo_Snapshot after;
+  take_snapshot(after);
+  if(0 != memcmp((const void*)&after, (const void*)&undo_before, sizeof(after))) undo_record(undo_before);
+}
+
+// M B or M C. The live state is the one memory mode was entered from, which undo_before still holds.
+void step(bool forward) {
+  if(!undo_before.valid) return;
+  if(forward ? !redo_step(undo_before) : !undo_step(undo_before)) return;
+  set_saved_state(undo_before.state);
+  calc_mode = (Calc_Mode)undo_before.mode;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Workspaces (see workspace.h)
+//
+//  M then A parks the calculation showing, and shows the next workspace's as it was left.
+//  The workspace left resumes in the mode M was pressed in, so 5 + then M A round every
+//  workspace and back, then 3 =, gives 8.
+//  Undo steps are forgotten: they belong to the workspace left. The history tape is
+//  shared. Graph mode isn't part of a workspace, so there M A backspaces as before.
+//
+void switch_workspace(uint8_t to) {
+  Workspace live;
+  memset((void*)&live, 0, sizeof(live));
+  get_saved_state(live.state);
+  live.mode = undo_before.valid ? undo_before.mode : (uint8_t)MODE_READY;
+  workspace_switch(live, to);
+  set_saved_state(live.state);
+  calc_mode         = (Calc_Mode)live.mode;
+  history_view      = 0;
+  undo_clear();
+  undo_before.valid = false;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Handle a button press
+//  The A button is backspace. The B and C buttons scroll the history tape in the
+//  Info area to older and newer entries; scrolling past the newest closes it.
+//  After M, A switches to the next workspace, and B and C are undo and redo instead.
+//  While a graph is plotted B and C zoom it out and in.
+//
+void process_button(uint8_t button) {
+  Stage_Timer timer(STAGE_PROCESS);
+  render_counters.keys++;
+  if(graph_plotted && (BUTTON_B == button || BUTTON_C == button)) {
+    zoom_graph(BUTTON_C == button);
+    return;
+  }
+  if(MODE_MEMORY == calc_mode && !graph_mode) {
+    if(BUTTON_A == button) switch_workspace((workspace_current() + 1) % WORKSPACES);
+    else                   step(BUTTON_C == button);
+    return;
+  }
+  begin_step();
+  if(BUTTON_A == button && can_backspace() && programmer_mode) {
+    integer = programmer_backspace(integer, radix);
+  }
+  else if(BUTTON_A == button && can_backspace()) {
+    accumulator.backspace();                                        // Remove the last character, and tidy what is left
+  }
+  else if(BUTTON_B == button) {
+    if(0 == history_view)                                    history_view = history_count() ? 1 : 0;
+    else if(history_view + INFO_LINES - 1 < history_count()) history_view++;
+  }
+  else if(BUTTON_C == button && history_view) {
+    history_view--;
+  }
+  end_step();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Move every key the Calculator FACE has waiting into the key queue.
+//  The FACE holds KEYBOARD_INT low while it has a key to send.
+//  If the queue is full the key is dropped (and counted by the queue.)
+//
+void drain_keyboard() {
+  while(digitalRead(KEYBOARD_INT) == LOW) {   // While a character is ready
+    Wire.requestFrom(KEYBOARD_I2C_ADDR, 1);   // request 1 byte from keyboard
+    if(!Wire.available()) break;
+    char key_val = Wire.read();               // receive a byte as character
+    if(0 == key_val) break;
+    key_queue_push(key_val);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Put each front button released into the key queue, as 'a', 'b' or 'c' (the letters
+//  traces and k requests use), so buttons and keys are handled in the order they came.
+//
+void read_buttons() {
+  M5.update();
+  if(M5.BtnA.wasReleased()) key_queue_push('a');
+  if(M5.BtnB.wasReleased()) key_queue_push('b');
+  if(M5.BtnC.wasReleased()) key_queue_push('c');
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  KEYBOARD_INT interrupt handling.
+//  I2C can't be used from an interrupt, so the interrupt wakes a task that drains the keyboard.
+//  The task also wakes every INPUT_POLL_MS to read the front buttons, and in case a key
+//  arrived while it was draining (KEYBOARD_INT stays low, so there would be no new falling edge.)
+//  It is the key queue's only producer, so the buttons are read there too.
+//  Once keys are queued it wakes loop(), in case it is waiting for them (see nap().)
+//  On the host there are no tasks: the simulated interrupt drains the keyboard itself,
+//  and poll_input() does what the task does when it wakes.
+//
+#ifdef NATIVE_BUILD
+void keyboard_isr() {
+  drain_keyboard();
+}
+
+void begin_keyboard_task() {}
+
+void poll_input() {
+  read_buttons();
+  drain_keyboard();
+}
+#else
+TaskHandle_t keyboard_task_handle = nullptr;
+TaskHandle_t loop_task_handle     = nullptr;
+
+void IRAM_ATTR keyboard_isr() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(keyboard_task_handle, &woken);
+  if(woken) portYIELD_FROM_ISR();
+}
+
+void keyboard_task(void* param) {
+  for(;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(INPUT_POLL_MS));
+    read_buttons();
+    drain_keyboard();
+    if(key_queue_depth() > 0) xTaskNotifyGive(loop_task_handle);
+  }
+}
+
+void begin_keyboard_task() {
+  loop_task_handle = xTaskGetCurrentTaskHandle();   // Called from setup(), which runs on the loop() task
+  xTaskCreatePinnedToCore(keyboard_task, "keyboard", 2048, nullptr, KEYBOARD_TASK_PRIO, &keyboard_task_handle, INPUT_CORE);
+}
+
+void poll_input() {}                        // The keyboard task reads the input
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Start reading the keyboard in the background.
+//
+void begin_keyboard() {
+  pinMode(KEYBOARD_INT, INPUT_PULLUP);
+  begin_keyboard_task();
+  attachInterrupt(digitalPinToInterrupt(KEYBOARD_INT), keyboard_isr, FALLING);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Return true and change ref to input char if key is available, otherwise returns false.
+//
+bool read_key(char& input) {
+  Stage_Timer timer(STAGE_DECODE);
+  return key_queue_pop(input);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Handle a key, from the keyboard or a serial batch request.
+//  If it's a digit, push it into the accumulator (or after M ., apply its function.)
+//  If it's a command, execute it.
+//  Return false if it isn't a key the calculator knows.
+//
+bool process_key(char input) {
+  trace_event(input);
+  history_view = 0;                         // Typing closes the tape
+  char          key = decode_key(input);
+  Calc_Command  cmd = input_to_command(key);
+  if(NO_COMMAND == cmd) return false;
+  render_counters.keys++;
+  begin_step();
+  process_command(cmd, key);
+  end_step();
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Handle a key, or a front button as 'a', 'b' or 'c'. Return false if it isn't a
+//  key the calculator knows.
+//
+bool process_event(char input) {
+  switch(input) {
+    case 'a': trace_event('a'); process_button(BUTTON_A); return true;
+    case 'b': trace_event('b'); process_button(BUTTON_B); return true;
+    case 'c': trace_event('c'); process_button(BUTTON_C); return true;
+    default:  return process_key(input);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Handle every key and button waiting in the key queue, in the order they came.
+//  Return true if anything was processed.
+//
+bool process_input() {
+  poll_input();
+  if(0 == key_queue_depth()) return false;  // Most calls: nothing to profile
+  PROFILE_SCOPE(PROFILE_PROCESS_INPUT);
+  char input;
+  bool processed = false;
+  while(read_key(input)) {
+    if(process_event(input)) processed = true;
+  }
+  return processed;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Serial Batch Requests (see serial_batch.h)
+//
+//  Keys in k requests are typed through process_key() and process_button(), as if
+//  from the keyboard and the front buttons, so a trace replays them exactly.
+//  e requests are worked out apart from the keys, so no mode changes what they mean;
+//  one that changes the calculator is traced as 'e', its expression, then '='.
+//
+Serial_Batch_Line batch_line;             // The request being received
+
+
+void type_batch_keys(const char* keys) {
+  for(; *keys; keys++) {
+    if(' ' != *keys) process_event(*keys);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The accumulator as the display shows it, but in locale_plain, so it reads back:
+//  in programmer mode, in the radix.
+//
+void accumulator_text(char* text) {
+  if(programmer_mode) programmer_format(text, integer, radix);
+  else                accumulator.to_text(text, locale_plain);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Read a whole number of seconds, up to a million. Return false if text isn't one.
+//
+bool parse_seconds(const char* text, uint32_t& seconds) {
+  seconds = 0;
+  for(uint8_t i = 0; i < 7; i++) {
+    if('\0' == text[i]) return i > 0 && seconds <= 1000000;
+    if(!is_digit(text[i])) return false;
+    seconds = seconds * 10 + (text[i] - '0');
+  }
+  return false;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Carry out an e request and write the reply.
+//  The calculator leaves M or M . (which do nothing more), completes any pending
+//  calculation and shows the result, as one step to undo. The operations go on the
+//  history tape. Programmer mode works on 64 bit integers, and graph mode's keys
+//  build the formula, so in those the value is only replied.
+//
+uint8_t perform_expression(const char* text, char* reply) {
+  char shown[NUMBER_TEXT_SIZE];
+  if(!serial_batch_is_expression(text)) {
+    strcpy(reply, "error bad expression\n");
+    return (uint8_t)strlen(reply);
+  }
+  if(programmer_mode || graph_mode) {
+    Number  value;
+    Decimal result = serial_batch_evaluate(text);
+    value.set_decimal(result);
+    value.to_text(shown, locale_plain);
+    return serial_batch_reply(reply, shown, result.status);
+  }
+  trace_event('e');
+  for(const char* p = text; *p; p++) if(' ' != *p) trace_event(*p);
+  trace_event('=');
+  history_view  = 0;
+  calc_mode     = MODE_READY;
+  begin_step();
+  perform_total('=');
+  set_result(accumulator, serial_batch_evaluate(text, record_operation));
+  end_step();
+  accumulator.to_text(shown, locale_plain);
+  return serial_batch_reply(reply, shown, status);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Carry out a request and write the reply.
+//
+uint8_t perform_batch_request(const char* request, bool overflow, char* reply) {
+  char      text[PROGRAMMER_TEXT_SIZE];
+  uint32_t  seconds;
+  if(overflow) {
+    strcpy(reply, "error line too long\n");
+  }
+  else if('k' == request[0] && (' ' == request[1] || '\0' == request[1])) {
+    type_batch_keys(request + 1);
+    accumulator_text(text);
+    return serial_batch_reply(reply, text, status);
+  }
+  else if('e' == request[0] && ' ' == request[1]) {
+    return perform_expression(request + 2, reply);
+  }
+  else if('r' == request[0] && ' ' == request[1] && ('0' == request[2] || '1' == request[2]) && '\0' == request[3]) {
+    batch_render = '1' == request[2];
+    strcpy(reply, "ok\n");
+  }
+  else if('d' == request[0] && ' ' == request[1] && parse_seconds(request + 2, seconds)) {
+    idle_dim_ms = seconds * 1000;
+    strcpy(reply, "ok\n");
+  }
+  else if('i' == request[0] && '\0' == request[1]) {
+    return idle_report(reply);
+  }
+  else if('f' == request[0] && '\0' == request[1]) {
+    char* p = reply;
+    p = stpcpy(p, "frames ");
+    p += format_digits(p, render_counters.frames);
+    p = stpcpy(p, " keys ");
+    p += format_digits(p, render_counters.keys);
+    p = stpcpy(p, " areas ");
+    p += format_digits(p, render_counters.areas);
+    p = stpcpy(p, "\n");
+    return (uint8_t)(p - reply);
+  }
+  else {
+    strcpy(reply, "error unknown request\n");
+  }
+  return (uint8_t)strlen(reply);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Carry out every request waiting on the serial port. Return true if there were any.
+//  Nothing with PROFILE defined, as the port carries the profile stream then.
+//
+bool process_serial() {
+#ifdef PROFILE
+  return false;
+#else
+  char reply[SERIAL_BATCH_REPLY_SIZE];
+  bool processed = false;
+  while(Serial.available() > 0) {
+    if(!serial_batch_receive(batch_line, (char)Serial.read())) continue;
+    if(!batch_line.overflow && '\0' == batch_line.text[0]) continue;   // A blank line, as sent to wake the calculator
+    uint8_t size = perform_batch_request(batch_line.text, batch_line.overflow, reply);
+    Serial.write((const uint8_t*)reply, size);
+    processed = true;
+  }
+  return processed;
+#endif
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Rendering Task
+//
+//  The calculator publishes its state and wakes the render task on RENDER_CORE,
+//  so drawing never delays reading and calculating the next key. The render task
+//  draws at most one frame every RENDER_FRAME_MS, of the areas that changed
+//  (see render_schedule.h.)
+//  On the host there are no tasks, and loop() renders in line, every time.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Return what = would show now. Straight after an operator key, that's the value
+//  of the expression without it: 10 + 4 * previews 14.
+//
+Decimal preview() {
+  Stage_Timer timer(STAGE_ARITHMETIC);
+  Expression  pending = expression;
+  Decimal     last    = accumulator.to_decimal();
+  if(MODE_OPERATOR == calc_mode && pending.depth > 0) {
+    pending.depth--;
+    last = pending.value[pending.depth];
+  }
+  return expression_evaluate(pending, last);
+}
+
+int64_t integer_preview() {
+  Stage_Timer           timer(STAGE_ARITHMETIC);
+  Programmer_Expression pending = integer_expression;
+  int64_t               last    = integer;
+  Decimal_Status        ignored = DECIMAL_OK;
+  if(MODE_OPERATOR == calc_mode && pending.depth > 0) {
+    pending.depth--;
+    last = pending.value[pending.depth];
+  }
+  return programmer_evaluate(pending, last, ignored);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Return the areas of the screen that show something different in state b.
+//  Parts are compared byte for byte, which is exact as states are zeroed before
+//  they are filled in: bytes left over from an earlier value can only make an
+//  area look changed when it isn't, which costs a redraw of unchanged text.
+//
+template<typename T> static bool same(const T& a, const T& b) {
+  return 0 == memcmp((const void*)&a, (const void*)&b, sizeof(T));
+}
+
+uint8_t changed_areas(const Calc_State& a, const Calc_State& b) {
+  uint8_t areas   = 0;
+  bool    modes   = a.memory_mode != b.memory_mode || a.function_mode != b.function_mode || a.statistics_mode != b.statistics_mode ||
+                    a.programmer_mode != b.programmer_mode || a.radix != b.radix || a.graph_mode != b.graph_mode ||
+                    a.graph_plotted != b.graph_plotted;
+  bool    plot    = !same(a.graph_program, b.graph_program) || !same(a.graph_window, b.graph_window);
+  bool    pending = !same(a.expression, b.expression) || !same(a.integer_expression, b.integer_expression);
+  if(modes || !same(a.accumulator, b.accumulator) || a.integer != b.integer || a.can_backspace != b.can_backspace ||
+     a.graph_typing != b.graph_typing || !same(a.graph_formula, b.graph_formula)) {
+    areas |= AREA_ACCUMULATOR;
+  }
+  if(modes || pending || plot || a.status != b.status || !same(a.memory, b.memory) || a.workspace != b.workspace) {
+    areas |= AREA_ANNUNCIATOR;
+  }
+  if(modes || pending || !same(a.preview, b.preview) || a.integer_preview != b.integer_preview || !same(a.statistics, b.statistics) ||
+     a.history_view != b.history_view || a.tape_lines != b.tape_lines || !same(a.tape, b.tape)) {
+    areas |= AREA_INFO;
+  }
+  if(a.history_view != b.history_view || a.history_count != b.history_count || a.can_backspace != b.can_backspace ||
+     a.memory_mode != b.memory_mode || a.can_undo != b.can_undo || a.can_redo != b.can_redo || a.workspace != b.workspace ||
+     modes || plot) {
+    areas |= AREA_LABELS;
+  }
+  if(a.graph_plotted != b.graph_plotted || plot) areas |= AREA_GRAPH;   // The plot appeared, went or changed: not for other modes
+  return areas;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Publish a copy of everything the display shows, and mark the areas that changed.
+//  Nothing if none did.
+//
+void publish_state() {
+  PROFILE_SCOPE(PROFILE_PUBLISH_STATE);
+  static Calc_State published;              // The state published last
+  Calc_State state;
+  memset((void*)&state, 0, sizeof(state));  // Padding and unused entries compare equal (see changed_areas())
+  state.accumulator     = accumulator;
+  state.memory          = memory;
+  state.expression      = expression;
+  state.preview         = programmer_mode || graph_mode ? decimal_make(0, 0) : preview();
+  state.memory_mode     = MODE_MEMORY == calc_mode;
+  state.function_mode   = MODE_FUNCTION == calc_mode;
+  state.statistics_mode = statistics_mode;
+  state.statistics      = statistics;
+  state.programmer_mode = programmer_mode;
+  state.radix           = radix;
+  state.integer         = integer;
+  state.integer_expression = integer_expression;
+  state.integer_preview = programmer_mode ? integer_preview() : 0;
+  state.can_backspace   = can_backspace();
+  state.can_undo        = undo_count() > 0;
+  state.can_redo        = redo_count() > 0;
+  state.graph_mode      = graph_mode;
+  state.graph_plotted   = graph_plotted;
+  state.graph_typing    = graph_mode && !restart;
+  if(graph_mode)    state.graph_formula = graph_formula;
+  if(graph_plotted) {
+    state.graph_program = graph_program;
+    state.graph_window  = graph_window;
+  }
+  state.status          = status;
+  state.workspace       = workspace_current();
+  state.history_view    = history_view;
+  state.history_count   = history_count();
+  state.tape_lines      = 0;
+  for(uint32_t age = history_view + INFO_LINES - 2; history_view && age + 1 >= history_view; age--) {
+    if(history_get(age, state.tape[state.tape_lines])) state.tape_lines++;
+  }
+  uint8_t areas = changed_areas(published, state);
+  if(0 == areas) return;
+  memcpy((void*)&published, (const void*)&state, sizeof(state));
+  published_state.write(state);
+  render_mark(areas);
+  render_counters.publishes++;
+}
+
+
+#ifdef NATIVE_BUILD
+void begin_render_task() {}
+void wake_renderer()     { render(); }
+#else
+TaskHandle_t render_task_handle = nullptr;
+
+void render_task(void* param) {
+  uint32_t frame_ms = 0;                    // millis() when the last frame started
+  for(;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // Sleep until there is something new to draw
+    uint32_t wait_ms = render_wait_ms(millis(), frame_ms);
+    if(wait_ms) vTaskDelay(pdMS_TO_TICKS(wait_ms));  // Keys handled meanwhile join this frame
+    frame_ms = millis();
+    render();
+  }
+}
+
+void begin_render_task() {
+  xTaskCreatePinnedToCore(render_task, "render", 4096, nullptr, RENDER_TASK_PRIO, &render_task_handle, RENDER_CORE);
+}
+
+void wake_renderer() {
+  xTaskNotifyGive(render_task_handle);
+}
+#endif
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Saving State
+//
+//  The accumulator, memory and pending calculation, and the parked workspaces, are
+//  saved in flash once the keyboard has been idle for SAVED_STATE_IDLE_MS, and
+//  restored at boot, so power-cycling the calculator loses nothing (see saved_state.h.)
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+// In graph mode, the accumulator it was entered with
+void get_saved_state(Saved_State& state) {
+  state.accumulator     = graph_mode ? graph_stash : accumulator;
+  state.memory          = memory;
+  state.expression      = expression;
+  state.status          = status;
+  state.restart         = restart || graph_mode;
+  state.statistics_mode = statistics_mode;
+  state.statistics      = statistics;
+  state.programmer_mode = programmer_mode;
+  state.radix           = radix;
+  state.integer         = integer;
+  state.integer_expression = integer_expression;
+}
+
+
+void set_saved_state(const Saved_State& state) {
+  accumulator     = state.accumulator;
+  memory          = state.memory;
+  expression      = state.expression;
+  status          = state.status;
+  restart         = state.restart;
+  statistics_mode = state.statistics_mode;
+  statistics      = state.statistics;
+  programmer_mode = state.programmer_mode;
+  radix           = state.radix;
+  integer         = state.integer;
+  integer_expression = state.integer_expression;
+}
+
+
+void save_state() {
+  Saved_State state;
+  get_saved_state(state);
+  saved_state_save(state);
+}
+
+
+// The parked workspaces come back too, or are cleared if they can't
+void restore_state() {
+  Saved_State state;
+  workspace_clear();
+  if(saved_state_load(state)) set_saved_state(state);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Tracing
+//
+//  Every key and button handled is recorded in flash with its time (see trace.h.)
+//  A trace starts with a snapshot of everything that decides what the keys do:
+//    the size of the saved state's record (1), the record (saved_state_pack),
+//    the mode (1), graph mode (1): 0 off, 1 on, 2 plotted,
+//    in graph mode the zoom (1), restart (1), the number being typed (Number::pack)
+//    and the formula (graph_pack), then the workspaces (workspace_pack)
+//  Replaying the trace into the snapshot (native/bench.cpp -r) reproduces the
+//  calculation exactly; only the history tape may differ, as it isn't in the
+//  snapshot. Undo starts afresh, so a trace that undoes a step from before it
+//  started replays differently.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#define SNAPSHOT_SIZE         (1 + SAVED_STATE_SIZE + 4 + NUMBER_PACKED_SIZE + GRAPH_PACKED_SIZE + WORKSPACE_PACKED_SIZE)
+#define SNAPSHOT_GRAPH        1             // Graph mode byte: graph mode is on
+#define SNAPSHOT_PLOTTED      2             // Graph mode byte: the formula is plotted
+
+
+void begin_trace() {
+  uint8_t     snapshot[SNAPSHOT_SIZE];
+  uint8_t*    p = snapshot;
+  Saved_State state;
+  get_saved_state(state);
+  p[0]  = saved_state_pack(p + 1, state);
+  p    += 1 + p[0];
+  *p++  = (uint8_t)calc_mode;
+  *p++  = graph_plotted ? SNAPSHOT_PLOTTED : graph_mode ? SNAPSHOT_GRAPH : 0;
+  if(graph_mode) {
+    *p++  = graph_window.zoom;
+    *p++  = restart ? 1 : 0;
+    p    += accumulator.pack(p);
+    p    += graph_pack(p, graph_formula);
+  }
+  p += workspace_pack(p);
+  trace_begin(snapshot, (uint16_t)(p - snapshot));
+}
+
+
+//  The bytes from p to end, as the size given to an unpack function; it needs no more than 255.
+static uint8_t left(const uint8_t* p, const uint8_t* end) {
+  return end - p < 255 ? (uint8_t)(end - p) : 255;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Put the calculator in the state a trace started from. Return false if the snapshot is not valid.
+//  The undo steps are forgotten: they aren't part of the snapshot.
+//
+bool restore_snapshot(const uint8_t* snapshot, uint16_t size) {
+  const uint8_t*  p   = snapshot;
+  const uint8_t*  end = snapshot + size;
+  Saved_State     state;
+  uint8_t         n;
+  if(size < 3 || end - p - 1 < p[0] + 2 || !saved_state_unpack(p + 1, p[0], state)) return false;
+  p += 1 + p[0];
+  if(p[0] >= MODE_COUNT || p[1] > SNAPSHOT_PLOTTED) return false;
+  set_saved_state(state);
+  calc_mode     = (Calc_Mode)p[0];
+  graph_mode    = 0 != p[1];
+  graph_plotted = false;
+  p += 2;
+  if(graph_mode) {
+    if(end - p < 2 || p[0] >= GRAPH_ZOOMS) return false;
+    graph_stash       = accumulator;
+    graph_window.zoom = p[0];
+    restart           = 0 != p[1];
+    p += 2;
+    if(0 == (n = accumulator.unpack(p, left(p, end)))) return false;
+    p += n;
+    if(0 == (n = graph_unpack(p, left(p, end), graph_formula))) return false;
+    p += n;
+    if(SNAPSHOT_PLOTTED == snapshot[1 + snapshot[0] + 1]) {
+      if(!graph_compile(graph_formula, graph_program)) return false;
+      graph_scale(graph_window, graph_program, graph_window.zoom);
+      graph_plotted = true;
+    }
+  }
+  if(end - p != workspace_unpack(p, (uint16_t)(end - p))) return false;
+  history_view  = 0;
+  undo_clear();
+  undo_before.valid = false;
+  return true;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Send waiting profile events over the serial port (see profiler.h), as many
+//  packets as it can take without waiting. Nothing without PROFILE defined.
+//
+void stream_profile() {
+#ifdef PROFILE
+  static uint8_t packet[PROFILE_PACKET_SIZE];
+  static uint8_t size = 0;                  // A packet not sent yet
+  for(;;) {
+    if(0 == size) size = profile_packet(packet);
+    if(0 == size || Serial.availableForWrite() < size) return;
+    Serial.write(packet, size);
+    size = 0;
+  }
+#endif
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Idling (see idle.h)
+//
+//  Light sleep stops both cores and keeps everything in RAM, and millis() and
+//  micros() keep counting through it. The render task has long finished drawing
+//  by the time there has been no input for IDLE_SLEEP_MS.
+//  On the host nothing sleeps or waits, so loop() runs flat out for the benchmarks.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef NATIVE_BUILD
+void nap()                    {}
+void light_sleep(uint32_t ms) {}
+#else
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Wait up to IDLE_NAP_MS for the keyboard task to queue a key, rather than spinning.
+//
+void nap() {
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IDLE_NAP_MS));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Sleep for up to ms (or IDLE_FOREVER), until a key or front button pulls its pin
+//  low or a byte arrives on the serial port. The bytes that wake the UART are lost
+//  (see serial_batch.h.) Nothing if a key or button is down already.
+//  Waking on a low level needs the keyboard pin's falling edge interrupt turned off,
+//  or it would interrupt continually until the key was read. The falling edge came
+//  while asleep, so after a wake by a pin the keyboard task is woken directly.
+//
+static const gpio_num_t wake_pins[] = {
+  (gpio_num_t)KEYBOARD_INT, (gpio_num_t)BUTTON_A_PIN, (gpio_num_t)BUTTON_B_PIN, (gpio_num_t)BUTTON_C_PIN
+};
+
+void light_sleep(uint32_t ms) {
+  for(gpio_num_t pin : wake_pins) {
+    if(LOW == digitalRead(pin)) return;
+  }
+  gpio_intr_disable((gpio_num_t)KEYBOARD_INT);
+  for(gpio_num_t pin : wake_pins) gpio_wakeup_enable(pin, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  uart_set_wakeup_threshold(UART_NUM_0, 3);   // Rising edges on RX: a newline has 3
+  esp_sleep_enable_uart_wakeup(0);
+  if(IDLE_FOREVER != ms) esp_sleep_enable_timer_wakeup(ms * 1000ULL);
+  Serial.flush();                             // Output still in the UART would be cut short
+
+  uint32_t start_us = micros();
+  esp_light_sleep_start();
+  uint32_t now_us   = micros();
+
+  bool by_pin = ESP_SLEEP_WAKEUP_GPIO == esp_sleep_get_wakeup_cause();
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+  for(gpio_num_t pin : wake_pins) gpio_wakeup_disable(pin);
+  gpio_set_intr_type((gpio_num_t)KEYBOARD_INT, GPIO_INTR_NEGEDGE);
+  gpio_intr_enable((gpio_num_t)KEYBOARD_INT);
+  if(by_pin) xTaskNotifyGive(keyboard_task_handle);
+  idle_slept(now_us - start_us, by_pin, now_us);
+}
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Dim the backlight, or bring it back.
+//
+void set_dimmed(bool dim) {
+  if(dim == dimmed) return;
+  M5.Lcd.setBrightness(dim ? DIM_BRIGHTNESS : BRIGHTNESS);
+  dimmed = dim;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Arduino Runtime: setup() and loop()
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Standard Arduino program initialization function.
+//  The saved state is restored before the first frame, so the calculator comes back
+//  as it was. The time from reset to the first frame is logged on the serial port.
+//
+void setup() {
+  Serial.setRxBufferSize(SERIAL_BATCH_RX_BUFFER);  // Room for pipelined requests. Before begin(): a running port can't be resized.
+  M5.begin(true, false, true);              // No SD card: it isn't used, and mounting it slows the boot
+  M5.Lcd.setBrightness(BRIGHTNESS);
+  Wire.begin();
+  M5.Lcd.setTextFont(4);
+  begin_keyboard();
+  region_buffer_begin(acc_region);          // The Accumulator gets first call on sprite RAM
+  region_buffer_begin(ann_region);
+  SPIFFS.begin(true);                       // Formats the flash on first use
+  restore_state();
+  history_begin();
+  display_frame();
+  publish_state();
+  render();                                 // Draw the first frame before the render task takes over
+  boot_us = micros();
+  Serial.printf("Boot to first frame: %u ms%s\n", (unsigned)(boot_us / 1000), boot_us > BOOT_BUDGET_MS * 1000UL ? " (over budget)" : "");
+  begin_trace();                            // After the first frame: it renames and creates files
+  begin_render_task();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Standard Arduino program loop (on INPUT_CORE)
+//  Look for input and process it. When there is none, wait for it: briefly at
+//  first, then in light sleep (see idle.h.)
+//
+void loop() {
+  // If anything happend, have the renderer show the new state
+  bool keyed  = process_input();
+  bool served = process_serial();
+  if(keyed || (served && batch_render)) {
+    publish_state();
+    wake_renderer();
+  }
+  if(keyed) idle_handled(micros());
+  if(keyed || served) {
+    last_input_ms = millis();
+    state_changed = true;
+    set_dimmed(false);
+  }
+  // Flash writes come after the display is updated, so they don't delay it
+  uint32_t idle_ms = millis() - last_input_ms;
+  if(history_flush_due(idle_ms))   history_flush();
+  if(history_restart_due(idle_ms)) history_restart();
+  if(trace_flush_due(idle_ms))     trace_flush();
+  if(trace_restart_due(idle_ms))   begin_trace();
+  stream_profile();
+  if(state_changed && idle_ms >= SAVED_STATE_IDLE_MS) {
+    save_state();
+    state_changed = false;
   }
+  if(idle_dim_due(idle_ms)) set_dimmed(true);
+  if(keyed || served) return;
+  uint32_t sleep_ms = idle_sleep_ms(idle_ms);
+  if(sleep_ms) light_sleep(sleep_ms);
+  else         nap();
 }
@@ -0,0 +1,266 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Number: fixed-capacity storage for the accumulator, opperand and memory.
+//  Nothing in this file allocates memory; all text is built in stack buffers.
+//
+#include "number.h"
+#include "format.h"
+#include <string.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Set to plain zero, the value shown after AC.
+//
+void Number::clear() {
+  digits[0] = '0';
+  digits[1] = '\0';
+  length    = 1;
+  point     = -1;
+  negative  = false;
+  exponent  = 0;
+  error     = false;
+  width.clear();
+  width.add('0');
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Return true if this is plain zero: no sign, no decimal point, no exponent.
+//
+bool Number::is_clear() const {
+  return 1 == length && '0' == digits[0] && point < 0 && !negative && 0 == exponent && !error;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Add a digit to the end of the number. A plain zero is replaced by the digit.
+//
+bool Number::append_digit(uint8_t digit) {
+  if(is_clear() || error) {
+    clear();
+    length = 0;
+    width.clear();
+  }
+  if(NUMBER_DIGITS == length) return false;
+  digits[length++] = '0' + digit;
+  digits[length]   = '\0';
+  width.add(digits[length - 1]);
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Put a decimal point after the last digit.
+//
+void Number::append_point() {
+  if(error) clear();
+  if(!has_point()) {
+    point = length;
+    width.add('.');
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Remove the last thing typed. If that was the only digit, the number becomes plain zero.
+//  What is left is then tidied as set_decimal() would write it: no zeros ending the
+//  fraction or leading the digits, no point at the end, and zero has no sign. Each
+//  character goes with its own width, so nothing is measured again.
+//
+void Number::backspace() {
+  if(point == length) {
+    point = -1;                             // The decimal point was last
+    width.remove('.');
+  }
+  else if(length > 1) {
+    width.remove(digits[--length]);
+  }
+  else {
+    clear();
+    return;
+  }
+  while(has_point() && length > point && '0' == digits[length - 1]) width.remove(digits[--length]);   // 1.50
+  if(point == length) {
+    point = -1;                             // 1.
+    width.remove('.');
+  }
+  uint8_t zeros = 0;                        // -05
+  while(zeros + 1 < length && '0' == digits[zeros] && (!has_point() || zeros + 1 < point)) width.remove(digits[zeros++]);
+  if(zeros) {
+    memmove(digits, digits + zeros, length - zeros);
+    length -= zeros;
+    if(has_point()) point -= zeros;
+  }
+  digits[length] = '\0';
+  if(1 == length && '0' == digits[0] && !has_point()) clear();      // -0
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Reverse the sign
+//
+void Number::negate() {
+  if(error) return;
+  negative = !negative;
+  if(negative) width.add('-');
+  else         width.remove('-');
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Convert to a Decimal. Digits beyond DECIMAL_DIGITS are rounded off.
+//
+Decimal Number::to_decimal() const {
+  if(error) return decimal_error(DECIMAL_INVALID);
+  uint64_t  mantissa    = 0;
+  int32_t   scale       = exponent - (has_point() ? length - point : 0);
+  uint8_t   significant = 0;
+  uint8_t   i           = 0;
+  for(; i < length && significant < DECIMAL_DIGITS; i++) {
+    mantissa = mantissa * 10 + (digits[i] - '0');
+    if(mantissa) significant++;             // Leading zeros don't count
+  }
+  scale += length - i;                      // Digits not used still count toward the magnitude
+  if(i < length && digits[i] >= '5') mantissa++;
+  return decimal_make(negative ? -(int64_t)mantissa : (int64_t)mantissa, (int16_t)scale);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Set from a Decimal.
+//  The value is shown with plain digits if they fit in NUMBER_DIGITS
+//  ("1200", "0.0015"), else in scientific notation ("1.2e30").
+//
+void Number::set_decimal(const Decimal& value) {
+  char      mantissa[24];
+  uint8_t   n         = format_digits(mantissa, value.mantissa);
+  int32_t   integers  = n + value.exponent;     // Digits before the decimal point
+  uint8_t   i;
+
+  clear();
+  if(decimal_is_error(value)) {
+    error = true;
+    measure();
+    return;
+  }
+  if(0 == value.mantissa) return;
+  negative = value.negative;
+  length   = 0;
+  if(value.exponent >= 0 && integers <= NUMBER_DIGITS) {
+    for(i = 0; i < n; i++)        digits[length++] = mantissa[i];   // 1200
+    for(i = 0; i < value.exponent; i++) digits[length++] = '0';
+  }
+  else if(value.exponent < 0 && integers > 0) {
+    for(i = 0; i < n; i++)        digits[length++] = mantissa[i];   // 12.5
+    point = (int8_t)integers;
+  }
+  else if(value.exponent < 0 && 1 - integers + n <= NUMBER_DIGITS) {
+    digits[length++] = '0';                                         // 0.0015
+    for(i = 0; i < -integers; i++) digits[length++] = '0';
+    for(i = 0; i < n; i++)        digits[length++] = mantissa[i];
+    point = 1;
+  }
+  else {
+    for(i = 0; i < n; i++)        digits[length++] = mantissa[i];   // 1.25e30
+    if(n > 1) point = 1;
+    exponent = (int16_t)(integers - 1);
+  }
+  digits[length] = '\0';
+  measure();
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Write the text shown on the display, for example "-1,234.5" or "1.2345e20".
+//
+void Number::to_text(char* text, const Locale& locale) const {
+  char* p = text;
+  if(error) {
+    strcpy(text, "Error");
+    return;
+  }
+  if(negative) *p++ = '-';
+  uint8_t integers = has_point() ? point : length;
+  p = format_grouped(p, digits, integers, integers, locale);
+  if(has_point()) {
+    *p++ = locale.point;
+    memcpy(p, digits + integers, length - integers);
+    p += length - integers;
+  }
+  *p = '\0';
+  if(0 != exponent) {
+    *p++ = 'e';
+    format_integer(p, exponent);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  width is kept for locale_plain; the locale changes it by the width of its point
+//  instead of '.', and of its separators. A font without their glyphs can't show it.
+//
+bool Number::fits(uint8_t font, uint16_t room, const Locale& locale) const {
+  if(error) return width.fits(font, room);
+  int32_t separators  = format_separators(has_point() ? point : length, locale);
+  uint8_t point_width = glyph_width(locale.point, font);
+  uint8_t separator   = glyph_width(locale.separator, font);
+  if((has_point() && 0 == point_width) || (separators && 0 == separator)) return false;
+  int32_t left        = room - separators * separator;
+  if(has_point()) left += glyph_width('.', font) - point_width;
+  return left >= 0 && width.fits(font, (uint16_t)left);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Packed form: flags (bit 0 negative, bit 1 error), length, point,
+//  exponent (2, little-endian), then the ASCII digits.
+//
+uint8_t Number::pack(uint8_t* p) const {
+  p[0] = (uint8_t)((negative ? 0x01 : 0) | (error ? 0x02 : 0));
+  p[1] = length;
+  p[2] = (uint8_t)point;
+  p[3] = (uint8_t)exponent;
+  p[4] = (uint8_t)((uint16_t)exponent >> 8);
+  memcpy(p + 5, digits, length);
+  return 5 + length;
+}
+
+uint8_t Number::unpack(const uint8_t* p, uint8_t size) {
+  clear();
+  if(size < 5 || 0 == p[1] || p[1] > NUMBER_DIGITS || size < 5 + p[1]) return 0;
+  if((int8_t)p[2] > (int8_t)p[1] || (int8_t)p[2] < -1) return 0;
+  for(uint8_t i = 0; i < p[1]; i++) {
+    if(p[5 + i] < '0' || p[5 + i] > '9') return 0;
+  }
+  negative  = 0 != (p[0] & 0x01);
+  error     = 0 != (p[0] & 0x02);
+  length    = p[1];
+  point     = (int8_t)p[2];
+  exponent  = (int16_t)(p[3] | (p[4] << 8));
+  memcpy(digits, p + 5, length);
+  digits[length] = '\0';
+  measure();
+  return 5 + length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Measure the whole text, after it has been replaced rather than typed.
+//
+void Number::measure() {
+  char text[NUMBER_TEXT_SIZE];
+  to_text(text, locale_plain);
+  width.clear();
+  width.add(text);
+}
@@ -0,0 +1,49 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Number: fixed-capacity storage for the accumulator, opperand and memory.
+//
+//  A Number holds a value exactly as it is displayed (including a trailing decimal
+//  point or trailing zeros while the user is typing) in a small inline buffer,
+//  so entering digits and performing operations never touches the heap.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "decimal.h"
+#include "format.h"
+#include "glyph_width.h"
+
+#define NUMBER_DIGITS         24            // Maximum number of digits a Number can hold
+#define NUMBER_TEXT_SIZE      40            // Buffer size needed by Number::to_text(): sign, digits, separators, point, exponent, NUL
+#define NUMBER_PACKED_SIZE    (5 + NUMBER_DIGITS)   // Most bytes written by Number::pack()
+
+
+struct Number {
+  char      digits[NUMBER_DIGITS + 1];      // ASCII digits, most significant first, NUL terminated. Never empty.
+  uint8_t   length;                         // Number of digits in digits[]
+  int8_t    point;                          // Number of digits before the decimal point, or -1 if there is no decimal point
+  bool      negative;                       // True if a minus sign is shown
+  int16_t   exponent;                       // Power of ten the digits are scaled by (only for results too large to hold)
+  bool      error;                          // True if the value is not a finite number (after dividing by zero, for example)
+  Text_Width width;                         // Width of the text to_text() writes in locale_plain, kept up to date
+
+  Number()  { clear(); }
+
+  void      clear();                        // Set to plain zero: "0"
+  bool      is_clear() const;               // True if the number is plain zero, as set by clear()
+  bool      has_point() const { return point >= 0; }
+  bool      append_digit(uint8_t digit);    // Add a digit to the end. Return false if there is no room.
+  void      append_point();                 // Add a decimal point to the end, if there is not one already
+  void      backspace();                    // Remove the last digit or decimal point shown, and tidy what is left
+  void      negate();                       // Toggle the minus sign
+  Decimal   to_decimal() const;             // Convert to a Decimal, rounding to DECIMAL_DIGITS digits
+  void      set_decimal(const Decimal& value);  // Set from a Decimal: plain digits if they fit, else scientific
+  void      to_text(char* text, const Locale& locale) const;  // Write the display text into a NUMBER_TEXT_SIZE buffer
+  bool      fits(uint8_t font, uint16_t room, const Locale& locale) const;  // True if to_text() in the locale fits in room pixels of font
+  uint8_t   pack(uint8_t* p) const;         // Store compactly, for flash. Return the number of bytes written.
+  uint8_t   unpack(const uint8_t* p, uint8_t size);   // Restore what pack() stored. Return the bytes used, or 0 (and clear) if they aren't valid.
+
+  private:
+  void      measure();                      // Recalculate width from scratch
+};
@@ -0,0 +1,141 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Profiler: trace rings and packets. See profiler.h.
+//
+#include "profiler.h"
+#include <M5Stack.h>
+#include <atomic>
+
+#define HEADER_SIZE           3
+#define CHECKSUM_SEED         0x5A
+#define VARINT_SIZE_MAX       5
+
+const char* profile_point_name[PROFILE_POINTS] = {
+  "process_input",
+  "push_operator",
+  "replace_operator",
+  "perform_total",
+  "perform_percentage",
+  "perform_function",
+  "add_to_statistics",
+  "memory_operation",
+  "publish_state",
+  "render",
+  "display_frame",
+  "display_accumulator",
+  "display_annunciator",
+  "display_info",
+  "display_button_labels",
+  "display_graph",
+  "plot_graph"
+};
+
+
+static uint8_t checksum(const uint8_t* data, uint8_t size) {
+  uint8_t sum = CHECKSUM_SEED;
+  for(uint8_t i = 0; i < size; i++) sum += data[i];
+  return sum;
+}
+
+
+bool profile_parse(const uint8_t* data, size_t size, Profile_Packet& packet, size_t& packet_size) {
+  if(size < HEADER_SIZE || 'P' != data[0] || 'F' != data[1]) return false;
+  uint8_t length = data[2];
+  if(length < 6 || size < HEADER_SIZE + length + 1u || checksum(data + HEADER_SIZE, length) != data[HEADER_SIZE + length]) return false;
+
+  const uint8_t*  p       = data + HEADER_SIZE;
+  const uint8_t*  end     = p + length;
+  packet.core     = *p++;
+  packet.dropped  = *p++;
+  uint32_t cycles = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  p += 4;
+  packet.count    = 0;
+  while(p < end) {
+    if(packet.count == PROFILE_PACKET_EVENTS) return false;
+    uint8_t   tag   = *p++;
+    uint32_t  delta = 0;
+    uint8_t   shift = 0;
+    do {
+      if(p == end || shift > 28) return false;
+      delta |= (uint32_t)(*p & 0x7F) << shift;
+      shift += 7;
+    } while(*p++ & 0x80);
+    cycles += delta;
+    packet.event[packet.count].cycles = cycles;
+    packet.event[packet.count].tag    = tag;
+    packet.count++;
+  }
+  packet_size = HEADER_SIZE + length + 1;
+  return packet.core < PROFILE_CORES;
+}
+
+
+#ifdef PROFILE
+struct Profile_Ring {
+  std::atomic<uint32_t> head;               // Written only by the core's traced task
+  std::atomic<uint32_t> tail;               // Written only by profile_packet()
+  std::atomic<uint32_t> dropped;
+  Profile_Event         event[PROFILE_RING_SIZE];
+};
+
+static Profile_Ring rings[PROFILE_CORES];
+
+
+void profile_record(uint8_t tag) {
+  uint32_t      cycles  = ESP.getCycleCount();
+  Profile_Ring& ring    = rings[xPortGetCoreID()];
+  uint32_t      head    = ring.head.load(std::memory_order_relaxed);
+  if(head - ring.tail.load(std::memory_order_acquire) >= PROFILE_RING_SIZE) {
+    ring.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring.event[head & (PROFILE_RING_SIZE - 1)].cycles = cycles;
+  ring.event[head & (PROFILE_RING_SIZE - 1)].tag    = tag;
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Pack as many waiting events as fit, taking the cores in turn.
+//
+uint8_t profile_packet(uint8_t* packet) {
+  static uint8_t next_core = 0;
+  for(uint8_t n = 0; n < PROFILE_CORES; n++) {
+    uint8_t       core  = next_core;
+    Profile_Ring& ring  = rings[core];
+    next_core = (next_core + 1) % PROFILE_CORES;
+    uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint32_t head = ring.head.load(std::memory_order_acquire);
+    if(tail == head) continue;
+
+    uint32_t  dropped = ring.dropped.exchange(0, std::memory_order_relaxed);
+    uint32_t  last    = ring.event[tail & (PROFILE_RING_SIZE - 1)].cycles;
+    uint8_t*  p       = packet + HEADER_SIZE;
+    *p++ = core;
+    *p++ = dropped > 255 ? 255 : (uint8_t)dropped;
+    for(uint8_t i = 0; i < 4; i++) *p++ = (uint8_t)(last >> (8 * i));
+    while(tail != head && p + 1 + VARINT_SIZE_MAX + 1 <= packet + PROFILE_PACKET_SIZE) {
+      const Profile_Event& event = ring.event[tail & (PROFILE_RING_SIZE - 1)];
+      uint32_t delta = event.cycles - last;
+      last = event.cycles;
+      *p++ = event.tag;
+      while(delta >= 0x80) {
+        *p++ = (uint8_t)(delta | 0x80);
+        delta >>= 7;
+      }
+      *p++ = (uint8_t)delta;
+      tail++;
+    }
+    ring.tail.store(tail, std::memory_order_release);
+
+    uint8_t length = (uint8_t)(p - packet - HEADER_SIZE);
+    packet[0] = 'P';
+    packet[1] = 'F';
+    packet[2] = length;
+    *p = checksum(packet + HEADER_SIZE, length);
+    return (uint8_t)(HEADER_SIZE + length + 1);
+  }
+  return 0;
+}
+#endif
@@ -0,0 +1,94 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Profiler: cycle-counted trace points, streamed over the serial port.
+//
+//  PROFILE_SCOPE(point) at the top of a routine records an event when it is entered
+//  and another when it returns, each stamped with ESP.getCycleCount(). Without
+//  PROFILE defined (see the -profile environments in platformio.ini) it is nothing.
+//
+//  Events go into a lock-free ring for the core they happen on. Only one task is
+//  traced on each core (loop() on the input core, the render task on the other),
+//  so each ring has one producer, and one consumer: profile_packet(), called from
+//  loop(). A full ring drops events, and counts them.
+//
+//  profile_packet() packs waiting events from one core for the serial port:
+//    'P', 'F', payload length (1)
+//    payload: core (1), events dropped since the last packet (1, at most 255),
+//             cycle count of the first event (4, little-endian), then for each
+//             event: tag (1), cycles since the event before (7 bits per byte,
+//             low bits first, high bit set on all but the last byte)
+//    checksum (1)
+//  A reader finds packets by their start and checksum, so text printed to the
+//  port between them does no harm. native/profile_fold.cpp turns a capture into
+//  folded stacks for flame graphs.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROFILE_CORES         2
+#define PROFILE_RING_SIZE     512           // Events held per core. Must be a power of two.
+#define PROFILE_PACKET_SIZE   128           // Largest packet: the ESP32's UART transmit FIFO
+#define PROFILE_PACKET_EVENTS ((PROFILE_PACKET_SIZE - 10) / 2)  // Most events a packet can hold
+#define PROFILE_EXIT          0x80          // Tag bit: the routine returned
+
+
+enum Profile_Point {
+  PROFILE_PROCESS_INPUT,
+  PROFILE_PUSH_OPERATOR,
+  PROFILE_REPLACE_OPERATOR,
+  PROFILE_PERFORM_TOTAL,
+  PROFILE_PERFORM_PERCENTAGE,
+  PROFILE_PERFORM_FUNCTION,
+  PROFILE_ADD_TO_STATISTICS,
+  PROFILE_MEMORY_OPERATION,
+  PROFILE_PUBLISH_STATE,
+  PROFILE_RENDER,
+  PROFILE_DISPLAY_FRAME,
+  PROFILE_DISPLAY_ACCUMULATOR,
+  PROFILE_DISPLAY_ANNUNCIATOR,
+  PROFILE_DISPLAY_INFO,
+  PROFILE_DISPLAY_BUTTON_LABELS,
+  PROFILE_DISPLAY_GRAPH,
+  PROFILE_PLOT_GRAPH,
+  PROFILE_POINTS
+};
+
+
+struct Profile_Event {
+  uint32_t  cycles;
+  uint8_t   tag;                            // Profile_Point, with PROFILE_EXIT set for a return
+};
+
+
+struct Profile_Packet {
+  uint8_t       core;
+  uint8_t       dropped;
+  uint8_t       count;
+  Profile_Event event[PROFILE_PACKET_EVENTS];
+};
+
+
+extern const char* profile_point_name[PROFILE_POINTS];
+
+bool  profile_parse(const uint8_t* data, size_t size, Profile_Packet& packet, size_t& packet_size);  // Return false unless a whole, valid packet starts at data
+
+
+#ifdef PROFILE
+void    profile_record(uint8_t tag);
+uint8_t profile_packet(uint8_t* packet);    // Fill packet (PROFILE_PACKET_SIZE bytes) from one core's ring. Return its size, or 0 if no events are waiting.
+
+class Profile_Scope {
+  public:
+    explicit Profile_Scope(Profile_Point point) : point(point)   { profile_record(point); }
+    ~Profile_Scope()                                            { profile_record(point | PROFILE_EXIT); }
+
+  private:
+    uint8_t point;
+};
+
+#define PROFILE_SCOPE(point)  Profile_Scope profile_scope(point)
+#else
+#define PROFILE_SCOPE(point)
+#endif
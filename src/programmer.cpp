@@ -0,0 +1,226 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Programmer: 64 bit integer arithmetic and radix conversion. See programmer.h.
+//
+#include "programmer.h"
+#include "format.h"
+#include <string.h>
+
+static const uint8_t  radix_bits[RADIX_COUNT]   = { 0, 4, 1, 3 };         // Bits per digit, for the powers of two
+static const char*    radix_names[RADIX_COUNT]  = { "DEC", "HEX", "BIN", "OCT" };
+static const char     hex_digits[]              = "0123456789ABCDEF";
+static const char     nibble_bits[16][5]        = {
+  "0000", "0001", "0010", "0011", "0100", "0101", "0110", "0111",
+  "1000", "1001", "1010", "1011", "1100", "1101", "1110", "1111"
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Operator helpers
+//
+static uint8_t precedence(char op) {
+  switch(op) {
+    case '*': case '/': return 6;
+    case '+': case '-': return 5;
+    case '<': case '>': return 4;
+    case '&':           return 3;
+    case '^':           return 2;
+    default:            return 1;
+  }
+}
+
+// Shift left by count bits, or right (keeping the sign) if count is negative
+static int64_t shift(int64_t value, int64_t count) {
+  uint64_t bits = (uint64_t)value;
+  if(count >= 64)  return 0;
+  if(count >= 0)   return (int64_t)(bits << count);
+  if(count <= -64) return value < 0 ? -1 : 0;
+  return value < 0 ? (int64_t)~(~bits >> -count) : (int64_t)(bits >> -count);
+}
+
+static int64_t apply(int64_t left, char op, int64_t right, Decimal_Status& status, Programmer_Listener listener) {
+  uint64_t  a     = (uint64_t)left;         // Wrapping arithmetic is only defined on unsigned integers
+  uint64_t  b     = (uint64_t)right;
+  int64_t   count = right < -64 ? -64 : right > 64 ? 64 : right;
+  int64_t   result;
+  switch(op) {
+    case '+': result = (int64_t)(a + b);    break;
+    case '-': result = (int64_t)(a - b);    break;
+    case '*': result = (int64_t)(a * b);    break;
+    case '<': result = shift(left, count);  break;
+    case '>': result = shift(left, -count); break;
+    case '&': result = (int64_t)(a & b);    break;
+    case '^': result = (int64_t)(a ^ b);    break;
+    case '|': result = (int64_t)(a | b);    break;
+    default:
+      if(0 == right) {
+        status = DECIMAL_DIVIDE_BY_ZERO;
+        result = 0;
+      }
+      else {
+        result = -1 == right ? (int64_t)(0 - a) : left / right;   // The most negative value / -1 wraps
+      }
+      break;
+  }
+  if(listener) listener(left, op, right, result);
+  return result;
+}
+
+
+void programmer_clear(Programmer_Expression& e) {
+  e.depth = 0;
+}
+
+
+int64_t programmer_push(Programmer_Expression& e, int64_t value, char op, Decimal_Status& status, Programmer_Listener listener) {
+  int64_t left = value;
+  while(e.depth > 0 && precedence(e.op[e.depth - 1]) >= precedence(op)) {
+    e.depth--;
+    left = apply(e.value[e.depth], e.op[e.depth], left, status, listener);
+  }
+  e.value[e.depth]  = left;
+  e.op[e.depth]     = op;
+  e.depth++;
+  return left;
+}
+
+
+int64_t programmer_replace(Programmer_Expression& e, char op, Decimal_Status& status, Programmer_Listener listener) {
+  if(0 == e.depth) return 0;
+  e.depth--;
+  return programmer_push(e, e.value[e.depth], op, status, listener);
+}
+
+
+int64_t programmer_evaluate(const Programmer_Expression& e, int64_t last, Decimal_Status& status, Programmer_Listener listener) {
+  int64_t right = last;
+  for(uint8_t i = e.depth; i > 0; i--) {
+    right = apply(e.value[i - 1], e.op[i - 1], right, status, listener);
+  }
+  return right;
+}
+
+
+bool programmer_is_operator(char op) {
+  return 0 != op && nullptr != strchr("*/+-<>&^|", op);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Write the value in the radix, most significant digit first, without leading zeros.
+//  The number of digits follows from the highest bit set, so every digit is written
+//  straight into place.
+//
+uint8_t programmer_format(char* text, int64_t value, Radix radix) {
+  uint64_t  bits  = (uint64_t)value;
+  char*     p     = text;
+  if(RADIX_DECIMAL == radix) {
+    if(value < 0) {
+      *p++  = '-';
+      bits  = 0 - bits;
+    }
+    return (uint8_t)(p - text) + format_digits(p, bits);
+  }
+
+  int8_t used = bits ? (int8_t)(64 - __builtin_clzll(bits)) : 1;        // Significant bits
+  if(RADIX_BINARY == radix) {
+    int8_t      at    = (used - 1) & ~3;                                // Lowest bit of the top nibble
+    const char* first = nibble_bits[(bits >> at) & 15] + 4 - (used - at);  // Just its significant digits
+    while(*first) *p++ = *first++;
+    for(at -= 4; at >= 0; at -= 4) {
+      memcpy(p, nibble_bits[(bits >> at) & 15], 4);
+      p += 4;
+    }
+  }
+  else {
+    uint8_t width = radix_bits[radix];
+    uint8_t mask  = (1 << width) - 1;
+    for(int8_t at = (used - 1) / width * width; at >= 0; at -= width) *p++ = hex_digits[(bits >> at) & mask];
+  }
+  *p = '\0';
+  return (uint8_t)(p - text);
+}
+
+
+const char* programmer_radix_name(Radix radix) {
+  return radix < RADIX_COUNT ? radix_names[radix] : "";
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Typing a number.
+//  Decimal grows the magnitude, keeping the sign: -12 then 3 is -123.
+//  The other radixes shift the digit in at the bottom of the 64 bits, so typing
+//  16 F's in hex gives -1; a digit that would push set bits out the top is refused.
+//
+int8_t programmer_digit_value(char key) {
+  if(key >= '0' && key <= '9') return (int8_t)(key - '0');
+  if(key >= PROGRAMMER_HEX_DIGIT + 10 && key <= PROGRAMMER_HEX_DIGIT + 15) return (int8_t)(key - PROGRAMMER_HEX_DIGIT);
+  return -1;
+}
+
+
+bool programmer_append_digit(int64_t& value, uint8_t digit, Radix radix) {
+  if(RADIX_DECIMAL != radix) {
+    uint8_t width = radix_bits[radix];
+    if(digit >> width || (uint64_t)value >> (64 - width)) return false;
+    value = (int64_t)(((uint64_t)value << width) | digit);
+    return true;
+  }
+  if(digit > 9) return false;
+  if(value >= 0) {
+    if(value > (INT64_MAX - digit) / 10) return false;
+    value = value * 10 + digit;
+  }
+  else {
+    if(value < (INT64_MIN + digit) / 10) return false;
+    value = value * 10 - digit;
+  }
+  return true;
+}
+
+
+int64_t programmer_backspace(int64_t value, Radix radix) {
+  if(RADIX_DECIMAL == radix) return value / 10;
+  return (int64_t)((uint64_t)value >> radix_bits[radix]);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Moving values between programmer mode and the Numbers the rest of the calculator keeps.
+//  A Number has an exponent only below 1 or from 25 digits up, so otherwise its
+//  digits before the point are the whole part, exactly.
+//
+int64_t programmer_from_number(const Number& n, Decimal_Status& status) {
+  if(n.error) {
+    status = DECIMAL_INVALID;
+    return 0;
+  }
+  if(n.exponent < 0) return 0;              // Below 1
+  uint64_t  limit     = n.negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+  uint64_t  magnitude = 0;
+  uint8_t   whole     = n.has_point() ? (uint8_t)n.point : n.length;
+  for(uint8_t i = 0; i < whole; i++) {
+    uint8_t digit = (uint8_t)(n.digits[i] - '0');
+    if(0 != n.exponent || magnitude > (limit - digit) / 10) {
+      status = DECIMAL_OVERFLOW;
+      return 0;
+    }
+    magnitude = magnitude * 10 + digit;
+  }
+  return n.negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+}
+
+
+void programmer_to_number(Number& n, int64_t value) {
+  char      digits[24];
+  uint64_t  magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  format_digits(digits, magnitude);
+  n.clear();
+  for(const char* p = digits; *p; p++) n.append_digit((uint8_t)(*p - '0'));
+  if(value < 0) n.negate();
+}
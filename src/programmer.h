@@ -0,0 +1,66 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Programmer: 64 bit integer arithmetic, shown in decimal, hex, binary or octal.
+//
+//  In programmer mode (M . - on the keypad) the calculator keeps its values as
+//  64 bit two's complement integers instead of Decimals: no rounding, no
+//  fractions, and the bitwise operators and shifts alongside + - * /.
+//  Arithmetic wraps around as it does in C; only dividing by zero is an error.
+//  Decimal shows the value signed, and the other radixes show its 64 bits.
+//
+//  The calculation typed so far is evaluated with C's operator precedence, by
+//  the same one-key-at-a-time shunting-yard as expression.h:
+//    * /   then  + -   then  << >>   then  &   then  ^   then  |
+//  so there is at most one pending operator per level.
+//
+//  Text is written from tables, a whole digit per lookup: hex and octal take
+//  4 and 3 bits at a time, binary writes 4 digits per nibble, and decimal uses
+//  format_digits().
+//
+#pragma once
+
+#include <stdint.h>
+#include "decimal.h"
+#include "number.h"
+
+#define PROGRAMMER_DEPTH      6             // Pending operators: one per precedence level
+#define PROGRAMMER_TEXT_SIZE  66            // Buffer size programmer_format() needs: sign or 64 binary digits, NUL
+
+#define PROGRAMMER_MODE       '@'           // M . -: turn programmer mode on or off
+#define PROGRAMMER_NOT        '~'           // M . ` in programmer mode: flip every bit
+#define PROGRAMMER_HEX_DIGIT  0x10          // M . 0 - M . 5 in programmer mode arrive as 0x1A - 0x1F: hex digits A - F
+
+
+enum Radix : uint8_t {
+  RADIX_DECIMAL,
+  RADIX_HEX,
+  RADIX_BINARY,
+  RADIX_OCTAL,
+  RADIX_COUNT                               // The . key steps through them in this order
+};
+
+
+struct Programmer_Expression {
+  int64_t   value[PROGRAMMER_DEPTH];        // value[i] is the left side of op[i]
+  char      op[PROGRAMMER_DEPTH];           // '*', '/', '+', '-', '<' (<<), '>' (>>), '&', '^', '|'
+  uint8_t   depth;                          // Number of pending operators
+};
+
+
+typedef void (*Programmer_Listener)(int64_t left, char op, int64_t right, int64_t result);
+
+
+void    programmer_clear(Programmer_Expression& e);
+int64_t programmer_push(Programmer_Expression& e, int64_t value, char op, Decimal_Status& status, Programmer_Listener listener = nullptr);  // Return the new left side of op
+int64_t programmer_replace(Programmer_Expression& e, char op, Decimal_Status& status, Programmer_Listener listener = nullptr);   // Change the last operator
+int64_t programmer_evaluate(const Programmer_Expression& e, int64_t last, Decimal_Status& status, Programmer_Listener listener = nullptr);  // The value if last completes the expression
+bool    programmer_is_operator(char op);                    // One of the operators above
+
+uint8_t     programmer_format(char* text, int64_t value, Radix radix);  // "FF", "-12". Return the number of characters written, not counting the NUL.
+const char* programmer_radix_name(Radix radix);             // "HEX"
+int8_t      programmer_digit_value(char key);               // 0 - 15 for the digit keys and PROGRAMMER_HEX_DIGIT + 10 - 15, else -1
+bool        programmer_append_digit(int64_t& value, uint8_t digit, Radix radix);  // Type a digit. Return false if it isn't one of the radix's, or there is no room.
+int64_t     programmer_backspace(int64_t value, Radix radix);                     // Drop the last digit typed
+
+int64_t     programmer_from_number(const Number& n, Decimal_Status& status);      // The whole part. DECIMAL_OVERFLOW (and 0) if it needs more than 64 bits.
+void        programmer_to_number(Number& n, int64_t value);                       // Exactly: a Number holds 24 digits
@@ -0,0 +1,104 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Region_Buffer: off-screen sprites for areas of the screen. See region_buffer.h.
+//
+#include "region_buffer.h"
+
+static size_t ram_used = 0;                 // Bytes of SPRITE_RAM_BUDGET allocated so far
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Allocate the region's sprites. With DMA, try for two, so one can be drawn
+//  while the other is being sent; otherwise one is enough.
+//
+void region_buffer_begin(Region_Buffer& rb) {
+#ifdef SPRITE_DMA
+  const uint8_t wanted = 2;
+  M5.Lcd.initDMA();
+#else
+  const uint8_t wanted = 1;
+#endif
+  size_t bytes = (size_t)rb.w * rb.h * sizeof(uint16_t);
+  rb.count = 0;
+  rb.back  = 0;
+  rb.dirty = false;
+  while(rb.count < wanted && ram_used + bytes <= SPRITE_RAM_BUDGET) {
+    TFT_eSprite* sprite = new TFT_eSprite(&M5.Lcd);
+    sprite->setColorDepth(16);
+    if(nullptr == sprite->createSprite(rb.w, rb.h)) {
+      delete sprite;                        // Out of memory: live with what we have
+      break;
+    }
+    rb.sprite[rb.count++] = sprite;
+    ram_used += bytes;
+  }
+  region_buffer_clear(rb);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Fill every sprite with the background color, matching a freshly painted screen.
+//
+void region_buffer_clear(Region_Buffer& rb) {
+  for(uint8_t i = 0; i < rb.count; i++) rb.sprite[i]->fillSprite(rb.bg_color);
+  rb.dirty = false;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Return the surface to draw the region on: its back sprite, or the LCD if it has none.
+//  dx, dy are the offset from screen coordinates to the surface's coordinates.
+//
+TFT_eSPI& region_buffer_canvas(Region_Buffer& rb, int16_t& dx, int16_t& dy) {
+  if(0 == rb.count) {
+    dx = dy = 0;
+    return M5.Lcd;
+  }
+#ifdef SPRITE_DMA
+  if(1 == rb.count && !rb.dirty) M5.Lcd.dmaWait();  // The only sprite may still be streaming out
+#endif
+  dx       = rb.x;
+  dy       = rb.y;
+  rb.dirty = true;
+  return *rb.sprite[rb.back];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Send the back sprite to the panel if anything was drawn into it.
+//  With two sprites the one just sent becomes the front, and is copied into the other
+//  so the next frame starts from what is on the screen.
+//
+void region_buffer_push(Region_Buffer& rb) {
+  if(!rb.dirty) return;
+  rb.dirty = false;
+#ifdef SPRITE_DMA
+  M5.Lcd.dmaWait();                         // The previous frame must be out before the panel window moves
+  bool swap = M5.Lcd.getSwapBytes();
+  M5.Lcd.setSwapBytes(false);               // Sprites already hold pixels in panel byte order
+  M5.Lcd.startWrite();
+  M5.Lcd.pushImageDMA(rb.x, rb.y, rb.w, rb.h, (uint16_t*)rb.sprite[rb.back]->getPointer());
+  M5.Lcd.endWrite();
+  M5.Lcd.setSwapBytes(swap);
+  if(2 == rb.count) {
+    uint8_t front = rb.back;
+    rb.back = 1 - rb.back;
+    memcpy(rb.sprite[rb.back]->getPointer(), rb.sprite[front]->getPointer(), (size_t)rb.w * rb.h * sizeof(uint16_t));
+  }
+#else
+  rb.sprite[rb.back]->pushSprite(rb.x, rb.y);
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Report how much of SPRITE_RAM_BUDGET is allocated.
+//
+size_t region_buffer_ram_used() {
+  return ram_used;
+}
@@ -0,0 +1,43 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Region_Buffer: an off-screen copy of one area of the screen.
+//
+//  Text for the area is drawn into a sprite in RAM, and the sprite is pushed to
+//  the panel in one transfer, so the panel never shows a half-erased area.
+//
+//  With SPRITE_DMA defined (needs a TFT_eSPI with DMA support, 2.2 or later) the
+//  push is started with DMA and the CPU goes back to decoding keys while it streams
+//  out. The region then gets a second sprite to draw the next frame into while the
+//  first one is still being sent.
+//
+//  All sprites share a RAM budget of SPRITE_RAM_BUDGET bytes. A region that does not
+//  fit in what is left is drawn directly on the LCD, as before.
+//
+#pragma once
+
+#include <M5Stack.h>
+
+#ifndef SPRITE_RAM_BUDGET
+#define SPRITE_RAM_BUDGET     98304         // Bytes of RAM all Region_Buffer sprites may use together
+#endif
+
+
+struct Region_Buffer {
+  int16_t       x;                          // Area of the screen covered
+  int16_t       y;
+  int16_t       w;
+  int16_t       h;
+  uint16_t      bg_color;                   // Background color of the area
+
+  uint8_t       count;                      // Number of sprites allocated: 0 means draw directly on the LCD
+  uint8_t       back;                       // Index of the sprite being drawn into
+  bool          dirty;                      // Something was drawn since the last push
+  TFT_eSprite*  sprite[2];
+};
+
+
+void      region_buffer_begin(Region_Buffer& rb);                           // Allocate sprites from what is left of the budget
+void      region_buffer_clear(Region_Buffer& rb);                           // Fill the sprites with the background color
+TFT_eSPI& region_buffer_canvas(Region_Buffer& rb, int16_t& dx, int16_t& dy); // Surface to draw on; subtract dx, dy from screen coordinates
+void      region_buffer_push(Region_Buffer& rb);                            // Send what was drawn to the panel
+size_t    region_buffer_ram_used();                                         // Bytes of the budget in use
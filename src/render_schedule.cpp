@@ -0,0 +1,25 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Render_Schedule: which areas of the screen need drawing, and when. See render_schedule.h.
+//
+#include "render_schedule.h"
+#include <atomic>
+
+Render_Counters               render_counters;
+static std::atomic<uint8_t>   marked(0);
+
+
+void render_mark(uint8_t areas) {
+  marked.fetch_or(areas, std::memory_order_release);
+}
+
+
+uint8_t render_take() {
+  return marked.exchange(0, std::memory_order_acquire);
+}
+
+
+uint32_t render_wait_ms(uint32_t now_ms, uint32_t frame_ms) {
+  uint32_t since = now_ms - frame_ms;
+  return since < RENDER_FRAME_MS ? RENDER_FRAME_MS - since : 0;
+}
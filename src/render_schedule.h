@@ -0,0 +1,47 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Render_Schedule: which areas of the screen need drawing, and when.
+//
+//  Each time the calculator publishes its state it marks the areas whose part of
+//  the state changed. The renderer takes the marks when it starts a frame and
+//  draws only those areas. Marks from states it never saw add up, so a burst of
+//  keys handled while a frame is being drawn becomes one frame, of every area
+//  any of them changed.
+//
+//  Frames are paced: one starts no sooner than RENDER_FRAME_MS after the last,
+//  and keys handled while it waits join it. The renderer runs on its own core,
+//  so neither drawing nor waiting delays handling the next key.
+//
+//  The marks are the only thing shared: the calculator only sets them and the
+//  renderer only clears them, with one atomic operation each.
+//
+#pragma once
+
+#include <stdint.h>
+
+#define RENDER_FRAME_MS       16            // Shortest time from one frame to the next: about 60 frames a second at most
+
+
+enum Render_Area : uint8_t {
+  AREA_ACCUMULATOR  = 0x01,
+  AREA_ANNUNCIATOR  = 0x02,
+  AREA_INFO         = 0x04,
+  AREA_LABELS       = 0x08,
+  AREA_GRAPH        = 0x10,                 // The plot in graph mode, over the Accumulator and Info areas
+  AREA_ALL          = 0x1F
+};
+
+
+struct Render_Counters {
+  uint32_t  keys;                           // Keys and buttons handled
+  uint32_t  publishes;                      // States published with something new to draw
+  uint32_t  frames;                         // Frames drawn
+  uint32_t  areas;                          // Areas drawn, over all the frames
+};
+
+
+extern Render_Counters render_counters;     // keys and publishes are written by the calculator; frames and areas by the renderer
+
+void      render_mark(uint8_t areas);       // Calculator: these areas have something new to show
+uint8_t   render_take();                    // Renderer: the areas to draw now, which are no longer marked
+uint32_t  render_wait_ms(uint32_t now_ms, uint32_t frame_ms);  // How long to wait before a frame, if the last started at frame_ms
@@ -0,0 +1,107 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Retained_Text: repaint only the glyphs that changed. See retained_text.h.
+//
+#include "retained_text.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Erase the horizontal span [x0, x1) of a line of text. Coordinates are relative to the canvas.
+//
+static void erase_span(TFT_eSPI& canvas, int16_t y, int16_t x0, int16_t x1, int16_t height, uint16_t color) {
+  if(x1 > x0) canvas.fillRect(x0, y, x1 - x0, height, color);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Draw text in place of whatever the Retained_Text showed before.
+//  A glyph is left alone if the same character is already on the screen at the same place
+//  in the same font. Runs of changed glyphs are drawn with one drawString() each.
+//
+void draw_retained_text(Retained_Text& rt, const char* text, uint8_t font) {
+  char      glyph[2]  = { 0, 0 };
+  int16_t   nx[RETAINED_TEXT_SIZE + 1];     // Left edge of each new glyph
+  uint8_t   length    = 0;
+  int16_t   width     = 0;
+
+  // Lay out the new text
+  while(text[length] && length < RETAINED_TEXT_SIZE) {
+    glyph[0] = text[length];
+    nx[length++] = width;
+    width += M5.Lcd.textWidth(glyph, font);
+  }
+  nx[length] = width;
+  int16_t left = rt.anchor;
+  if(TC_DATUM == rt.datum) left -= width / 2;
+  if(TR_DATUM == rt.datum) left -= width;
+  for(uint8_t i = 0; i <= length; i++) nx[i] += left;
+
+  // Nothing to do if the same text is already in the same place, or there was and is no text
+  bool same_font = font == rt.font;
+  if(0 == length && 0 == rt.length) return;
+  if(same_font && length == rt.length && nx[0] == rt.x[0] && 0 == memcmp(text, rt.text, length)) return;
+
+  int16_t   dx      = 0;                    // Offset from screen to canvas coordinates
+  int16_t   dy      = 0;
+  TFT_eSPI& canvas  = rt.region ? region_buffer_canvas(*rt.region, dx, dy) : M5.Lcd;
+  int16_t   top     = rt.y - dy;
+
+  // Erase whatever part of the old text the new text will not cover.
+  // If the font changed, nothing on the screen can be reused.
+  if(0 != rt.font && 0 != rt.length) {
+    int16_t old_height = M5.Lcd.fontHeight(rt.font);
+    int16_t old_left   = rt.x[0];
+    int16_t old_right  = rt.x[rt.length];
+    if(!same_font || 0 == length) {
+      erase_span(canvas, top, old_left - dx, old_right - dx, old_height, rt.bg_color);
+    }
+    else {
+      erase_span(canvas, top, old_left - dx, min(old_right, nx[0]) - dx, old_height, rt.bg_color);
+      erase_span(canvas, top, max(old_left, nx[length]) - dx, old_right - dx, old_height, rt.bg_color);
+    }
+  }
+
+  // Draw runs of changed glyphs
+  canvas.setTextColor(rt.fg_color, rt.bg_color);  // Background color set: glyphs erase what is under them
+  canvas.setTextDatum(TL_DATUM);
+  uint8_t j = 0;                                  // Walks the old glyphs, which are also sorted by x
+  uint8_t i = 0;
+  while(i < length) {
+    uint8_t start = i;
+    while(i < length) {
+      while(same_font && j < rt.length && rt.x[j] < nx[i]) j++;
+      bool unchanged = same_font && j < rt.length && rt.x[j] == nx[i] && rt.text[j] == text[i];
+      if(unchanged) break;
+      i++;
+    }
+    if(i > start) {
+      char run[RETAINED_TEXT_SIZE + 1];
+      memcpy(run, text + start, i - start);
+      run[i - start] = '\0';
+      canvas.drawString(run, nx[start] - dx, top, font);
+    }
+    while(i < length && same_font && j < rt.length && rt.x[j] == nx[i] && rt.text[j] == text[i]) {
+      i++;                                        // Skip the glyphs that are already on the screen
+      j++;
+    }
+  }
+
+  // Remember what is on the screen
+  rt.font   = font;
+  rt.length = length;
+  memcpy(rt.text, text, length);
+  rt.text[length] = '\0';
+  memcpy(rt.x, nx, sizeof(nx[0]) * (length + 1));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Something else painted over the text, so nothing on the screen can be reused.
+//
+void forget_retained_text(Retained_Text& rt) {
+  rt.font   = 0;
+  rt.length = 0;
+}
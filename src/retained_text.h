@@ -0,0 +1,36 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Retained_Text: a line of text on the screen that remembers what it shows.
+//
+//  Drawing new text compares it glyph by glyph with what is already on the screen.
+//  Only glyphs whose character or position changed are redrawn (in runs, with
+//  the background color set so they erase what was under them), and only the
+//  part of the old text not covered by the new text is erased.
+//
+#pragma once
+
+#include <M5Stack.h>
+#include "region_buffer.h"
+
+#define RETAINED_TEXT_SIZE    64            // Longest text a Retained_Text can show
+
+
+struct Retained_Text {
+  // Where and how the text is drawn: set once, before the first draw
+  int16_t   anchor;                         // X coordinate the datum refers to
+  int16_t   y;                              // Top of the text
+  uint8_t   datum;                          // TL_DATUM, TC_DATUM or TR_DATUM
+  uint16_t  fg_color;                       // Text color
+  uint16_t  bg_color;                       // Background color of the area the text is drawn on
+  Region_Buffer*  region;                   // Off-screen buffer for the area, or nullptr to draw on the LCD
+
+  // What is on the screen now
+  uint8_t   font;                           // Font of the text shown, or 0 if nothing has been drawn
+  uint8_t   length;                         // Number of glyphs shown
+  char      text[RETAINED_TEXT_SIZE + 1];   // The glyphs shown
+  int16_t   x[RETAINED_TEXT_SIZE + 1];      // Left edge of each glyph; x[length] is the right edge of the text
+};
+
+
+void  draw_retained_text(Retained_Text& rt, const char* text, uint8_t font);  // Show text, repainting only what changed
+void  forget_retained_text(Retained_Text& rt);                                // The area was painted over; redraw everything next time
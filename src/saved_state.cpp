@@ -0,0 +1,169 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Saved_State: the calculator's state in flash. See saved_state.h.
+//
+//  The record is:
+//    'C', 'S', SAVED_STATE_VERSION, payload length (1)
+//    payload: accumulator and memory (Number::pack), expression depth (1),
+//             then op (1) and value (decimal_pack) for each pending operator,
+//             status (1), restart (1), statistics mode (1), statistics (statistics_pack),
+//             programmer mode (1), radix (1), integer accumulator (8), programmer expression
+//             depth (1), then op (1) and value (8) for each pending operator
+//             (integers are little-endian)
+//    checksum (1)
+//  The file is the live state's record, then workspace_pack().
+//
+#include "saved_state.h"
+#include "workspace.h"
+#include <SPIFFS.h>
+#include <string.h>
+
+#define HEADER_SIZE           4
+#define CHECKSUM_SEED         0x5A
+#define FILE_SIZE             (SAVED_STATE_SIZE + WORKSPACE_PACKED_SIZE)
+
+static uint8_t  saved[FILE_SIZE];           // The file in flash, to skip writing it again
+static uint16_t saved_size = 0;
+
+
+static uint8_t* pack_integer(uint8_t* p, int64_t value) {
+  for(uint8_t i = 0; i < 8; i++) *p++ = (uint8_t)((uint64_t)value >> (8 * i));
+  return p;
+}
+
+static int64_t unpack_integer(const uint8_t* p) {
+  uint64_t value = 0;
+  for(uint8_t i = 0; i < 8; i++) value |= (uint64_t)p[i] << (8 * i);
+  return (int64_t)value;
+}
+
+
+static uint8_t checksum(const uint8_t* record, uint8_t size) {
+  uint8_t sum = CHECKSUM_SEED;
+  for(uint8_t i = 0; i < size; i++) sum += record[i];
+  return sum;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Build the record. Return its size.
+//
+uint8_t saved_state_pack(uint8_t* record, const Saved_State& state) {
+  uint8_t* p = record + HEADER_SIZE;
+  p += state.accumulator.pack(p);
+  p += state.memory.pack(p);
+  *p++ = state.expression.depth;
+  for(uint8_t i = 0; i < state.expression.depth; i++) {
+    *p++ = (uint8_t)state.expression.op[i];
+    decimal_pack(p, state.expression.value[i]);
+    p += DECIMAL_PACKED_SIZE;
+  }
+  *p++ = state.status;
+  *p++ = state.restart ? 1 : 0;
+  *p++ = state.statistics_mode ? 1 : 0;
+  statistics_pack(p, state.statistics);
+  p += STATISTICS_PACKED_SIZE;
+  *p++ = state.programmer_mode ? 1 : 0;
+  *p++ = state.radix;
+  p    = pack_integer(p, state.integer);
+  *p++ = state.integer_expression.depth;
+  for(uint8_t i = 0; i < state.integer_expression.depth; i++) {
+    *p++ = (uint8_t)state.integer_expression.op[i];
+    p    = pack_integer(p, state.integer_expression.value[i]);
+  }
+
+  record[0] = 'C';
+  record[1] = 'S';
+  record[2] = SAVED_STATE_VERSION;
+  record[3] = (uint8_t)(p - record - HEADER_SIZE);
+  *p = checksum(record, (uint8_t)(p - record));
+  return (uint8_t)(p - record + 1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Check and unpack a record. Return false if any part of it is not valid.
+//
+bool saved_state_unpack(const uint8_t* record, uint8_t size, Saved_State& state) {
+  if(size < HEADER_SIZE + 1 || 'C' != record[0] || 'S' != record[1] || SAVED_STATE_VERSION != record[2]) return false;
+  uint8_t payload = record[3];
+  if(size != HEADER_SIZE + payload + 1 || checksum(record, size - 1) != record[size - 1]) return false;
+
+  const uint8_t*  p   = record + HEADER_SIZE;
+  const uint8_t*  end = p + payload;
+  uint8_t         n;
+  if(0 == (n = state.accumulator.unpack(p, end - p))) return false;
+  p += n;
+  if(0 == (n = state.memory.unpack(p, end - p))) return false;
+  p += n;
+  if(p >= end || *p > EXPRESSION_DEPTH) return false;
+  state.expression.depth = *p++;
+  for(uint8_t i = 0; i < state.expression.depth; i++) {
+    if(end - p < 1 + DECIMAL_PACKED_SIZE) return false;
+    char op = (char)*p++;
+    if('+' != op && '-' != op && '*' != op && '/' != op && '^' != op) return false;
+    state.expression.op[i]    = op;
+    state.expression.value[i] = decimal_unpack(p);
+    p += DECIMAL_PACKED_SIZE;
+  }
+  if(end - p < 3 + STATISTICS_PACKED_SIZE + 11 || p[0] > DECIMAL_INVALID) return false;
+  state.status          = (Decimal_Status)p[0];
+  state.restart         = 0 != p[1];
+  state.statistics_mode = 0 != p[2];
+  statistics_unpack(p + 3, state.statistics);
+  p += 3 + STATISTICS_PACKED_SIZE;
+  if(p[1] >= RADIX_COUNT || p[10] > PROGRAMMER_DEPTH || end - p != 11 + p[10] * 9) return false;
+  state.programmer_mode          = 0 != p[0];
+  state.radix                    = (Radix)p[1];
+  state.integer                  = unpack_integer(p + 2);
+  state.integer_expression.depth = p[10];
+  p += 11;
+  for(uint8_t i = 0; i < state.integer_expression.depth; i++, p += 9) {
+    if(!programmer_is_operator((char)p[0])) return false;
+    state.integer_expression.op[i]    = (char)p[0];
+    state.integer_expression.value[i] = unpack_integer(p + 1);
+  }
+  return true;
+}
+
+
+bool saved_state_load(Saved_State& state) {
+  uint8_t record[FILE_SIZE];
+  if(!SPIFFS.exists(SAVED_STATE_PATH) && SPIFFS.exists(SAVED_STATE_NEW_PATH)) {
+    SPIFFS.rename(SAVED_STATE_NEW_PATH, SAVED_STATE_PATH);    // Power was cut while saving
+  }
+  File file = SPIFFS.open(SAVED_STATE_PATH, FILE_READ);
+  if(!file) return false;
+  uint16_t size = (uint16_t)file.read(record, sizeof(record));
+  file.close();
+  uint16_t live = size > HEADER_SIZE ? HEADER_SIZE + record[3] + 1 : 0;
+  if(0 == live || live >= size || !saved_state_unpack(record, (uint8_t)live, state)) return false;
+  if(size - live != workspace_unpack(record + live, size - live)) return false;
+  memcpy(saved, record, size);
+  saved_size = size;
+  return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Write the file under a new name, then replace the old file with it.
+//
+void saved_state_save(const Saved_State& state) {
+  uint8_t   record[FILE_SIZE];
+  uint16_t  size = saved_state_pack(record, state);
+  size += workspace_pack(record + size);
+  if(size == saved_size && 0 == memcmp(record, saved, size)) return;
+
+  File file = SPIFFS.open(SAVED_STATE_NEW_PATH, FILE_WRITE);
+  if(!file) return;
+  bool written = size == file.write(record, size);
+  file.close();
+  if(!written) return;
+  SPIFFS.remove(SAVED_STATE_PATH);
+  SPIFFS.rename(SAVED_STATE_NEW_PATH, SAVED_STATE_PATH);
+  memcpy(saved, record, size);
+  saved_size = size;
+}
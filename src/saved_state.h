@@ -0,0 +1,48 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Saved_State: the calculator's state, kept in flash across power cycles.
+//
+//  The state is written as one small versioned binary record (SPIFFS file
+//  SAVED_STATE_PATH), and read back in setup() before the first frame is drawn.
+//  The file holds the record of the workspace showing, followed by the parked
+//  workspaces and which one is showing (workspace.h), so every running total
+//  survives a restart.
+//  The caller decides when to save; a record identical to the one already in
+//  flash is not written again. A record with another version, a bad checksum or
+//  invalid contents is ignored, and the calculator starts fresh.
+//
+#pragma once
+
+#include "expression.h"
+#include "number.h"
+#include "programmer.h"
+#include "statistics.h"
+
+#define SAVED_STATE_PATH      "/state.bin"
+#define SAVED_STATE_NEW_PATH  "/state.new"  // Written first, then renamed, so a power cut leaves one complete record
+#define SAVED_STATE_VERSION   4             // Change whenever the record layout changes
+#define SAVED_STATE_IDLE_MS   3000          // Save once the keyboard has been idle this long, so typing doesn't wear the flash
+#define SAVED_STATE_SIZE      (5 + 2 * NUMBER_PACKED_SIZE + 1 + EXPRESSION_DEPTH * (1 + DECIMAL_PACKED_SIZE) + 3 + STATISTICS_PACKED_SIZE \
+                               + 11 + PROGRAMMER_DEPTH * 9)
+
+
+struct Saved_State {
+  Number          accumulator;
+  Number          memory;
+  Expression      expression;
+  Decimal_Status  status;
+  bool            restart;                  // The next digit starts a new number
+  bool            statistics_mode;          // The + key adds to the statistics
+  Statistics      statistics;
+  bool            programmer_mode;          // Values are 64 bit integers (see programmer.h)
+  Radix           radix;
+  int64_t         integer;                  // The accumulator in programmer mode
+  Programmer_Expression integer_expression;
+};
+
+
+bool  saved_state_load(Saved_State& state);          // Return false if there is no valid saved state. Also restores the parked workspaces. Call after SPIFFS.begin().
+void  saved_state_save(const Saved_State& state);    // Write the state and the parked workspaces, unless flash already holds the same
+
+uint8_t saved_state_pack(uint8_t* record, const Saved_State& state);              // Build the record (SAVED_STATE_SIZE bytes at most). Return its size.
+bool    saved_state_unpack(const uint8_t* record, uint8_t size, Saved_State& state);  // Return false if the record is not valid
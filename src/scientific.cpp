@@ -0,0 +1,458 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Scientific: fixed-point kernels for the scientific functions. See scientific.h.
+//
+#include "scientific.h"
+#include <math.h>
+
+#define FIXED_ONE             1000000000000000000LL   // 1 in fixed point: 18 decimal places
+#define CORDIC_STEPS          58            // Rotations: the last is by less than 1e-17 of 45 degrees
+#define CORDIC_GAIN           607252935008881256LL    // Starting length, so the rotations stretch the vector to 1
+#define LOG_STEPS             60            // Factors (1 + 1/2^i): ln of the last is 2e-18
+#define LN2_FIXED             693147180559945309LL
+#define NEWTON_STEPS          2             // Each one doubles the correct digits of a square root
+#define SMALL_ANGLE           3             // Degrees below which a series gives sin and cos
+
+
+// atan(1/2^i), in units of 45 degrees
+static const int64_t cordic_angle[CORDIC_STEPS] = {
+  1000000000000000000LL,  590334470601733097LL,   311916521509477302LL,   158333696642262168LL,
+  79474097222163356LL,    39775791294357096LL,    19892749115801651LL,    9946981574678957LL,
+  4973566674856402LL,     2486792823693486LL,     1243397597640082LL,     621698947044526LL,
+  310849492050334LL,      155424748341176LL,      77712374460089LL,       38856187266232LL,
+  19428093637640LL,       9714046819385LL,        4857023409763LL,        2428511704890LL,
+  1214255852446LL,        607127926223LL,         303563963112LL,         151781981556LL,
+  75890990778LL,          37945495389LL,          18972747694LL,          9486373847LL,
+  4743186924LL,           2371593462LL,           1185796731LL,           592898365LL,
+  296449183LL,            148224591LL,            74112296LL,             37056148LL,
+  18528074LL,             9264037LL,              4632018LL,              2316009LL,
+  1158005LL,              579002LL,               289501LL,               144751LL,
+  72375LL,                36188LL,                18094LL,                9047LL,
+  4523LL,                 2262LL,                 1131LL,                 565LL,
+  283LL,                  141LL,                  71LL,                   35LL,
+  18LL,                   9LL
+};
+
+// ln(1 + 1/2^i)
+static const int64_t log_factor[LOG_STEPS] = {
+  693147180559945309LL,   405465108108164382LL,   223143551314209756LL,   117783035656383455LL,
+  60624621816434843LL,    30771658666753688LL,    15504186535965254LL,    7782140442054949LL,
+  3898640415657323LL,     1951220131261749LL,     976085973055459LL,      488162079501351LL,
+  244110827527363LL,      122062862525677LL,      61033293680639LL,       30517112473186LL,
+  15258672648362LL,       7629365427568LL,        3814689989686LL,        1907346813825LL,
+  953673861659LL,         476837044516LL,         238418550680LL,         119209282445LL,
+  59604642999LL,          29802321944LL,          14901161083LL,          7450580569LL,
+  3725290292LL,           1862645147LL,           931322574LL,            465661287LL,
+  232830644LL,            116415322LL,            58207661LL,             29103830LL,
+  14551915LL,             7275958LL,              3637979LL,              1818989LL,
+  909495LL,               454747LL,               227374LL,               113687LL,
+  56843LL,                28422LL,                14211LL,                7105LL,
+  3553LL,                 1776LL,                 888LL,                  444LL,
+  222LL,                  111LL,                  56LL,                   28LL,
+  14LL,                   7LL,                    3LL,                    2LL
+};
+
+static const Decimal one                = { 1,                      0,   false, DECIMAL_OK };
+static const Decimal half               = { 5,                      -1,  false, DECIMAL_OK };
+static const Decimal forty_five         = { 45,                     0,   false, DECIMAL_OK };
+static const Decimal ninety             = { 9,                      1,   false, DECIMAL_OK };
+static const Decimal small_angle        = { SMALL_ANGLE,            0,   false, DECIMAL_OK };
+static const Decimal series_low         = { 9,                      -1,  false, DECIMAL_OK };  // ln x for x from series_low
+static const Decimal series_high        = { 11,                     -1,  false, DECIMAL_OK };  // to series_high comes from a series
+static const Decimal ln10               = { 230258509299404568ULL,  -17, false, DECIMAL_OK };
+static const Decimal log10_e            = { 434294481903251828ULL,  -18, false, DECIMAL_OK };  // 1 / ln 10
+static const Decimal per_45_degrees     = { 222222222222222222ULL,  -19, false, DECIMAL_OK };  // 1 / 45
+static const Decimal radians_per_degree = { 174532925199432958ULL,  -19, false, DECIMAL_OK };
+
+// Series coefficients, in the order Horner's rule uses them (see small_sin_cos() and ln_series())
+static const Decimal sin_coefficient[] = {                                                    // -1/3!, 1/5!, -1/7!, 1/9!
+  { 166666666666666667ULL, -18, true,  DECIMAL_OK }, { 833333333333333333ULL, -20, false, DECIMAL_OK },
+  { 198412698412698413ULL, -21, true,  DECIMAL_OK }, { 275573192239858907ULL, -23, false, DECIMAL_OK }
+};
+static const Decimal cos_coefficient[] = {                                                    // -1/2!, 1/4!, -1/6!, 1/8!
+  { 5,                     -1,  true,  DECIMAL_OK }, { 416666666666666667ULL, -19, false, DECIMAL_OK },
+  { 138888888888888889ULL, -20, true,  DECIMAL_OK }, { 248015873015873016ULL, -22, false, DECIMAL_OK }
+};
+static const Decimal atanh_coefficient[] = {                                                  // 1/3, 1/5 ... 1/17
+  { 333333333333333333ULL, -18, false, DECIMAL_OK }, { 2,                     -1,  false, DECIMAL_OK },
+  { 142857142857142857ULL, -18, false, DECIMAL_OK }, { 111111111111111111ULL, -18, false, DECIMAL_OK },
+  { 909090909090909091ULL, -19, false, DECIMAL_OK }, { 769230769230769231ULL, -19, false, DECIMAL_OK },
+  { 666666666666666667ULL, -19, false, DECIMAL_OK }, { 588235294117647059ULL, -19, false, DECIMAL_OK }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Decimal helpers
+//
+static int32_t magnitude(const Decimal& d) {                // Power of ten of the leading digit
+  return d.exponent + decimal_count_digits(d.mantissa) - 1;
+}
+
+static int compare(const Decimal& a, const Decimal& b) {
+  Decimal difference = decimal_subtract(a, b);
+  if(0 == difference.mantissa) return 0;
+  return difference.negative ? -1 : 1;
+}
+
+static Decimal negate(Decimal d) {
+  if(0 != d.mantissa) d.negative = !d.negative;
+  return d;
+}
+
+// c[0] + x (c[1] + x (c[2] ... + x c[count - 1]))
+static Decimal polynomial(const Decimal* c, uint8_t count, const Decimal& x) {
+  Decimal sum = c[count - 1];
+  for(uint8_t i = count - 1; i > 0; i--) sum = decimal_add(c[i - 1], decimal_multiply(x, sum));
+  return sum;
+}
+
+// The whole part of a value below 2^31 in magnitude
+static int32_t to_integer(const Decimal& d) {
+  uint64_t value = d.mantissa;
+  for(int16_t e = d.exponent; e < 0 && 0 != value; e++) value /= 10;
+  for(int16_t e = d.exponent; e > 0; e--) value *= 10;
+  return d.negative ? -(int32_t)value : (int32_t)value;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Fixed point conversions. to_fixed() takes a value from 0 to 18.
+//
+static uint64_t to_fixed(const Decimal& d) {
+  uint64_t  value   = d.mantissa;
+  int32_t   shift   = d.exponent + 18;
+  uint32_t  dropped = 0;                    // The last digit dropped decides the rounding
+  for(; shift > 0; shift--) value *= 10;
+  for(; shift < 0 && 0 != value; shift++) {
+    dropped = value % 10;
+    value  /= 10;
+  }
+  return value + (dropped >= 5 ? 1 : 0);
+}
+
+static Decimal from_fixed(uint64_t value, bool negative) {
+  int16_t exponent = -18;
+  if(value > INT64_MAX) {
+    value = (value + 5) / 10;
+    exponent++;
+  }
+  return decimal_make(negative ? -(int64_t)value : (int64_t)value, exponent);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Kernels: shifts and adds on fixed-point numbers.
+//
+//  CORDIC turns the vector (CORDIC_GAIN, 0) through angle in steps of +/- atan(1/2^i),
+//  each of which is a shift and add of x and y. It ends up at (cos, sin).
+//  angle is from 0 to 1: 0 to 45 degrees.
+//
+static void cordic(int64_t angle, int64_t& sine, int64_t& cosine) {
+  int64_t x = CORDIC_GAIN;
+  int64_t y = 0;
+  int64_t z = angle;
+  for(uint8_t i = 0; i < CORDIC_STEPS; i++) {
+    int64_t dx = y >> i;
+    int64_t dy = x >> i;
+    if(z >= 0) { x -= dx;  y += dy;  z -= cordic_angle[i]; }
+    else       { x += dx;  y -= dy;  z += cordic_angle[i]; }
+  }
+  sine   = y;
+  cosine = x;
+}
+
+//  e^r: take the logarithms of the factors (1 + 1/2^i) out of r, largest first,
+//  and multiply 1 by each factor taken. r is from 0 to ln 10, so the result is below 11.
+//
+static uint64_t exp_kernel(uint64_t r) {
+  uint64_t y = FIXED_ONE;
+  for(uint8_t i = 0; i < LOG_STEPS; i++) {
+    while(r >= (uint64_t)log_factor[i]) {
+      r -= log_factor[i];
+      y += y >> i;
+    }
+  }
+  return y;
+}
+
+//  ln m: the reverse. Build m up from 1 with the same factors, adding up their logarithms.
+//  m is from 1 to 2.
+//
+static int64_t ln_kernel(uint64_t m) {
+  uint64_t  w   = FIXED_ONE;
+  int64_t   sum = 0;
+  for(uint8_t i = 1; i < LOG_STEPS; i++) {
+    uint64_t next;
+    while((next = w + (w >> i)) <= m) {
+      w    = next;
+      sum += log_factor[i];
+    }
+  }
+  return sum;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Natural logarithm of x > 0, to about DECIMAL_DIGITS digits.
+//  x = m * 10^e, and m = f * 2^k with f from 1 to 2, so ln x = ln f + k ln 2 + e ln 10.
+//  Near 1 the kernel's error would be large next to the result, so a series is used:
+//  ln x = 2 atanh(s) = 2 (s + s^3/3 + s^5/5 ...), where s = (x - 1) / (x + 1) is below 0.053.
+//
+static Decimal ln_series(const Decimal& x) {
+  Decimal s     = decimal_divide(decimal_subtract(x, one), decimal_add(x, one));
+  Decimal s2    = decimal_multiply(s, s);
+  Decimal atanh = decimal_add(s, decimal_multiply(decimal_multiply(s, s2), polynomial(atanh_coefficient, 8, s2)));
+  return decimal_add(atanh, atanh);
+}
+
+static Decimal ln_decimal(const Decimal& x) {
+  if(compare(x, series_low) >= 0 && compare(x, series_high) <= 0) return ln_series(x);
+  Decimal   m = x;
+  m.exponent  = 1 - decimal_count_digits(x.mantissa);      // From 1 to 10
+  uint64_t  f = to_fixed(m);
+  uint8_t   k = 0;
+  while(f >= 2 * (uint64_t)FIXED_ONE) {
+    f >>= 1;
+    k++;
+  }
+  Decimal ln_m = from_fixed(ln_kernel(f) + k * LN2_FIXED, false);
+  return decimal_add(ln_m, decimal_multiply(decimal_make(magnitude(x), 0), ln10));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  e^x, to about DECIMAL_DIGITS digits.
+//  x = k ln 10 + r with r from 0 to ln 10, so e^x = e^r * 10^k.
+//
+static Decimal exp_decimal(const Decimal& x) {
+  if(decimal_is_error(x)) return x;
+  if(magnitude(x) >= 3) return decimal_error(x.negative ? DECIMAL_UNDERFLOW : DECIMAL_OVERFLOW);  // Far out of range
+  int32_t k = to_integer(decimal_multiply(x, log10_e));
+  Decimal r = decimal_subtract(x, decimal_multiply(decimal_make(k, 0), ln10));
+  if(r.negative) {
+    r = decimal_add(r, ln10);
+    k--;
+  }
+  else if(compare(r, ln10) >= 0) {
+    r = decimal_subtract(r, ln10);
+    k++;
+  }
+  Decimal e_r = from_fixed(exp_kernel(to_fixed(r)), false);
+  return decimal_make((int64_t)e_r.mantissa, (int16_t)(e_r.exponent + k));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  x to a whole power n, by repeated squaring: exact while the digits fit.
+//
+static Decimal integer_power(const Decimal& x, uint64_t n) {
+  Decimal base   = x;
+  Decimal result = one;
+  for(;;) {
+    if(n & 1) result = decimal_multiply(result, base);
+    n >>= 1;
+    if(0 == n || decimal_is_error(result) || 0 == result.mantissa) return result;
+    base = decimal_multiply(base, base);
+    if(decimal_is_error(base) || 0 == base.mantissa) return base;     // Overflow, or underflow to zero
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  sin and cos of an angle in degrees, to about DECIMAL_DIGITS digits.
+//  The angle is reduced exactly: its magnitude modulo 360, then into the first
+//  quadrant, then to 45 degrees at most. Small angles use a series, the rest CORDIC.
+//
+static Decimal reduce_degrees(const Decimal& degrees) {    // |degrees| modulo 360
+  if(degrees.exponent >= 0) {
+    uint64_t remainder = degrees.mantissa % 360;
+    for(int16_t e = 0; e < degrees.exponent; e++) remainder = remainder * 10 % 360;
+    return decimal_make((int64_t)remainder, 0);
+  }
+  Decimal reduced   = degrees;
+  reduced.negative  = false;
+  if(degrees.exponent < -16) return reduced;                // Below 10 already
+  uint64_t full_turn = 360;                                 // 360 in units of the last digit
+  for(int16_t e = degrees.exponent; e < 0; e++) full_turn *= 10;
+  return decimal_make((int64_t)(degrees.mantissa % full_turn), degrees.exponent);
+}
+
+// sin t = t - t^3/3! + t^5/5! ...   cos t = 1 - t^2/2! + t^4/4! ...   for t in radians, below 0.053
+static void small_sin_cos(const Decimal& t, Decimal& sine, Decimal& cosine) {
+  Decimal t2 = decimal_multiply(t, t);
+  sine   = decimal_add(t, decimal_multiply(decimal_multiply(t, t2), polynomial(sin_coefficient, 4, t2)));
+  cosine = decimal_add(one, decimal_multiply(t2, polynomial(cos_coefficient, 4, t2)));
+}
+
+static void sin_cos(const Decimal& degrees, Decimal& sine, Decimal& cosine) {
+  Decimal r        = reduce_degrees(degrees);
+  uint8_t quadrant = 0;
+  while(compare(r, ninety) >= 0) {
+    r = decimal_subtract(r, ninety);
+    quadrant++;
+  }
+  bool complement = compare(r, forty_five) > 0;
+  if(complement) r = decimal_subtract(ninety, r);
+
+  Decimal s, c;
+  if(0 == r.mantissa) {
+    s = decimal_make(0, 0);
+    c = one;
+  }
+  else if(compare(r, small_angle) < 0) {
+    small_sin_cos(decimal_multiply(r, radians_per_degree), s, c);
+  }
+  else {
+    int64_t fixed_sin, fixed_cos;
+    cordic((int64_t)to_fixed(decimal_multiply(r, per_45_degrees)), fixed_sin, fixed_cos);
+    s = from_fixed(fixed_sin, false);
+    c = from_fixed(fixed_cos, false);
+  }
+  if(complement) {
+    Decimal t = s;
+    s = c;
+    c = t;
+  }
+  switch(quadrant) {
+    case 0:  sine = s;          cosine = c;          break;
+    case 1:  sine = c;          cosine = negate(s);  break;
+    case 2:  sine = negate(s);  cosine = negate(c);  break;
+    default: sine = negate(c);  cosine = s;          break;
+  }
+  if(degrees.negative) sine = negate(sine);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Square root: Newton's method, from a float guess good to about 7 digits.
+//  x = f * 10^e with f from 1 to 100 and e even, so the guess is sqrt(f) * 10^(e/2).
+//
+Decimal scientific_sqrt(const Decimal& x) {
+  if(decimal_is_error(x) || 0 == x.mantissa) return x;
+  if(x.negative) return decimal_error(DECIMAL_INVALID);
+  uint8_t digits = decimal_count_digits(x.mantissa);
+  int32_t e      = magnitude(x);
+  float   f      = (float)x.mantissa;
+  for(uint8_t i = 1; i < digits; i++) f /= 10;
+  if(e & 1) {
+    f *= 10;
+    e -= 1;
+  }
+  Decimal root = decimal_make((int64_t)(sqrtf(f) * 1e6f), (int16_t)(e / 2 - 6));
+  for(uint8_t i = 0; i < NEWTON_STEPS; i++) {
+    root = decimal_multiply(decimal_add(root, decimal_divide(x, root)), half);
+  }
+  return decimal_round_to(root, SCIENTIFIC_DIGITS);
+}
+
+
+Decimal scientific_ln(const Decimal& x) {
+  if(decimal_is_error(x)) return x;
+  if(x.negative || 0 == x.mantissa) return decimal_error(DECIMAL_INVALID);
+  return decimal_round_to(ln_decimal(x), SCIENTIFIC_DIGITS);
+}
+
+
+Decimal scientific_log(const Decimal& x) {
+  if(decimal_is_error(x)) return x;
+  if(x.negative || 0 == x.mantissa) return decimal_error(DECIMAL_INVALID);
+  if(1 == x.mantissa) return decimal_make(x.exponent, 0);  // Powers of ten are exact
+  return decimal_round_to(decimal_multiply(ln_decimal(x), log10_e), SCIENTIFIC_DIGITS);
+}
+
+
+Decimal scientific_exp(const Decimal& x) {
+  return decimal_round_to(exp_decimal(x), SCIENTIFIC_DIGITS);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  x^y. Whole powers are found by multiplying, so 2^10 is exactly 1024 and (-2)^3 is -8.
+//  Others are e^(y ln x), which needs x > 0.
+//
+Decimal scientific_power(const Decimal& x, const Decimal& y) {
+  if(decimal_is_error(x)) return x;
+  if(decimal_is_error(y)) return y;
+  if(0 == y.mantissa) return one;
+  if(0 == x.mantissa) return y.negative ? decimal_error(DECIMAL_DIVIDE_BY_ZERO) : decimal_make(0, 0);
+  if(y.exponent >= 0 && magnitude(y) <= 18) {
+    uint64_t n = y.mantissa;
+    for(int16_t e = 0; e < y.exponent; e++) n *= 10;
+    Decimal power = integer_power(x, n);
+    if(!y.negative) return power;
+    if(DECIMAL_OVERFLOW == power.status) return decimal_error(DECIMAL_UNDERFLOW);
+    if(0 == power.mantissa)              return decimal_error(DECIMAL_OVERFLOW);
+    return decimal_divide(one, power);
+  }
+  if(x.negative) return decimal_error(DECIMAL_INVALID);
+  return decimal_round_to(exp_decimal(decimal_multiply(y, ln_decimal(x))), SCIENTIFIC_DIGITS);
+}
+
+
+Decimal scientific_sin(const Decimal& degrees) {
+  if(decimal_is_error(degrees)) return degrees;
+  Decimal sine, cosine;
+  sin_cos(degrees, sine, cosine);
+  return decimal_round_to(sine, SCIENTIFIC_DIGITS);
+}
+
+
+Decimal scientific_cos(const Decimal& degrees) {
+  if(decimal_is_error(degrees)) return degrees;
+  Decimal sine, cosine;
+  sin_cos(degrees, sine, cosine);
+  return decimal_round_to(cosine, SCIENTIFIC_DIGITS);
+}
+
+
+Decimal scientific_tan(const Decimal& degrees) {
+  if(decimal_is_error(degrees)) return degrees;
+  Decimal sine, cosine;
+  sin_cos(degrees, sine, cosine);
+  return decimal_round_to(decimal_divide(sine, cosine), SCIENTIFIC_DIGITS);  // tan 90 divides by zero
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  By key
+//
+Decimal scientific_function(char function, const Decimal& x) {
+  switch(function) {
+    case FUNCTION_SQRT:       return scientific_sqrt(x);
+    case FUNCTION_SQUARE:     return decimal_multiply(x, x);
+    case FUNCTION_RECIPROCAL: return decimal_divide(one, x);
+    case FUNCTION_LN:         return scientific_ln(x);
+    case FUNCTION_LOG:        return scientific_log(x);
+    case FUNCTION_EXP:        return scientific_exp(x);
+    case FUNCTION_SIN:        return scientific_sin(x);
+    case FUNCTION_COS:        return scientific_cos(x);
+    case FUNCTION_TAN:        return scientific_tan(x);
+    default:                  return decimal_error(DECIMAL_INVALID);
+  }
+}
+
+
+const char* scientific_name(char function) {
+  switch(function) {
+    case FUNCTION_SQRT:       return "sqrt";
+    case FUNCTION_SQUARE:     return "sqr";
+    case FUNCTION_RECIPROCAL: return "1/x";
+    case FUNCTION_LN:         return "ln";
+    case FUNCTION_LOG:        return "log";
+    case FUNCTION_EXP:        return "exp";
+    case FUNCTION_SIN:        return "sin";
+    case FUNCTION_COS:        return "cos";
+    case FUNCTION_TAN:        return "tan";
+    default:                  return nullptr;
+  }
+}
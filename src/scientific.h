@@ -0,0 +1,49 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Scientific: square roots, powers, logarithms and trigonometry on Decimals.
+//
+//  The ESP32 has no hardware for doubles, so these never use them. The kernels
+//  work on 64 bit fixed-point numbers with 18 decimal places, using only shifts,
+//  adds and small tables:
+//    sin, cos    CORDIC rotation, by the angles whose tangents are 1/2^i
+//    ln, exp     multiplying by (1 + 1/2^i) factors, whose logarithms are tabled
+//    sqrt        Newton's method in Decimal arithmetic, from a single-precision
+//                float guess (the ESP32 has hardware for floats)
+//  Arguments are reduced exactly in Decimal arithmetic first (angles modulo 360
+//  degrees, powers of ten out of logarithms and exponentials), and short series
+//  take over near the points where a fixed-point kernel would lose digits.
+//  The kernels are good to 15 or 16 digits; results are rounded to
+//  SCIENTIFIC_DIGITS so every digit shown is right.
+//
+//  Angles are in degrees. Functions are identified by the characters that stand
+//  for their keys (see main.cpp), which are also the operator of a history entry.
+//
+#pragma once
+
+#include "decimal.h"
+
+#define SCIENTIFIC_DIGITS     14            // Significant digits in a transcendental result
+
+#define FUNCTION_SQRT         'r'           // Square root
+#define FUNCTION_SQUARE       'q'
+#define FUNCTION_RECIPROCAL   'i'           // 1/x
+#define FUNCTION_LN           'l'           // Natural logarithm
+#define FUNCTION_LOG          'g'           // Base 10 logarithm
+#define FUNCTION_EXP          'e'           // e to the x
+#define FUNCTION_SIN          's'
+#define FUNCTION_COS          'c'
+#define FUNCTION_TAN          't'
+#define FUNCTION_POWER        '^'           // x to the y: an operator in the expression
+
+
+Decimal     scientific_sqrt(const Decimal& x);
+Decimal     scientific_ln(const Decimal& x);
+Decimal     scientific_log(const Decimal& x);
+Decimal     scientific_exp(const Decimal& x);
+Decimal     scientific_power(const Decimal& x, const Decimal& y);
+Decimal     scientific_sin(const Decimal& degrees);
+Decimal     scientific_cos(const Decimal& degrees);
+Decimal     scientific_tan(const Decimal& degrees);
+
+Decimal     scientific_function(char function, const Decimal& x);  // Apply one of the FUNCTION_ characters, other than FUNCTION_POWER
+const char* scientific_name(char function); // "sin", or nullptr if function isn't a FUNCTION_ character for a single number
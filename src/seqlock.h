@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Seqlock: share a small struct between one writer and any number of readers
+//  (for example on different cores) without locks.
+//
+//  The writer makes the sequence number odd while it copies, and even again when
+//  it is done. A reader copies the struct and retries if the sequence number was
+//  odd or changed while it copied, so it always ends up with a consistent copy.
+//  The writer never waits; a reader only waits for a copy in progress.
+//
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+
+template<typename T>
+class Seqlock {
+  public:
+    Seqlock() : seq(0), data() {}
+
+    ////////////////////////////////////////////////////////////////////////////
+    //
+    //  Publish a new value. Only one writer may call this.
+    //
+    void write(const T& value) {
+      uint32_t s = seq.load(std::memory_order_relaxed);
+      seq.store(s + 1, std::memory_order_relaxed);        // Odd: copy in progress
+      std::atomic_thread_fence(std::memory_order_release);
+      memcpy((void*)&data, (const void*)&value, sizeof(T));
+      seq.store(s + 2, std::memory_order_release);        // Even: copy complete
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    //
+    //  Copy out the latest value. Return its sequence number, which changes every time a value is written.
+    //
+    uint32_t read(T& value) const {
+      for(;;) {
+        uint32_t before = seq.load(std::memory_order_acquire);
+        if(before & 1) continue;                          // Writer is mid-copy
+        memcpy((void*)&value, (const void*)&data, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(before == seq.load(std::memory_order_relaxed)) return before;
+      }
+    }
+
+  private:
+    std::atomic<uint32_t> seq;
+    T                     data;
+};
@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Serial Batch: assembling request lines and writing replies. See serial_batch.h.
+//  The requests themselves are carried out in main.cpp.
+//
+#include "serial_batch.h"
+#include "number.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Add a character to the line. '\r' is ignored, so either line ending works.
+//  A complete line is NUL terminated, and stays so until the next character.
+//
+bool serial_batch_receive(Serial_Batch_Line& line, char c) {
+  if('\r' == c) return false;
+  if(0 == line.length) line.overflow = false;             // A new line
+  if('\n' == c) {
+    line.text[line.length] = '\0';
+    line.length = 0;
+    return true;
+  }
+  if(line.length + 1 < SERIAL_BATCH_LINE_SIZE) line.text[line.length++] = c;
+  else                                         line.overflow = true;
+  return false;
+}
+
+
+const char* serial_batch_status_name(Decimal_Status status) {
+  switch(status) {
+    case DECIMAL_UNDERFLOW:      return "underflow";
+    case DECIMAL_OVERFLOW:       return "overflow";
+    case DECIMAL_DIVIDE_BY_ZERO: return "divide-by-zero";
+    case DECIMAL_INVALID:        return "invalid";
+    default:                     return "";
+  }
+}
+
+
+uint8_t serial_batch_reply(char* reply, const char* accumulator, Decimal_Status status) {
+  const char* problem = serial_batch_status_name(status);
+  char*       p       = reply;
+  *p++ = '=';
+  *p++ = ' ';
+  while(*accumulator) *p++ = *accumulator++;
+  if(*problem) {
+    *p++ = ' ';
+    while(*problem) *p++ = *problem++;
+  }
+  *p++ = '\n';
+  *p   = '\0';
+  return (uint8_t)(p - reply);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  e request expressions: numbers joined by + - * /. A number is read as if typed,
+//  so it has at most NUMBER_DIGITS digits, and spaces are ignored as in k requests.
+//  Leave p at the character after the number. Return false if there is no number there.
+//
+static bool read_number(const char*& p, Number& value) {
+  bool digits = false;
+  value.clear();
+  for(;; p++) {
+    if(' ' == *p) continue;
+    if(*p >= '0' && *p <= '9') {
+      if(!value.append_digit((uint8_t)(*p - '0'))) return false;
+      digits = true;
+    }
+    else if('.' == *p && !value.has_point()) value.append_point();
+    else return digits;
+  }
+}
+
+static bool is_operator(char c) {
+  return '+' == c || '-' == c || '*' == c || '/' == c;
+}
+
+
+// Nothing is worked out, so a request that isn't an expression changes nothing
+bool serial_batch_is_expression(const char* text) {
+  Number value;
+  for(;;) {
+    if(!read_number(text, value)) return false;
+    if('\0' == *text) return true;
+    if(!is_operator(*text++))     return false;
+  }
+}
+
+
+Decimal serial_batch_evaluate(const char* text, Expression_Listener listener) {
+  Expression  e;
+  Number      value;
+  expression_clear(e);
+  for(;; text++) {
+    read_number(text, value);
+    if('\0' == *text) return expression_evaluate(e, value.to_decimal(), listener);
+    expression_push(e, value.to_decimal(), *text, listener);
+  }
+}
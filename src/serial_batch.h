@@ -0,0 +1,61 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Serial Batch: drive the calculator from a host over the serial port.
+//
+//  The host sends requests as lines of text and gets back one line for each, in
+//  order. It needn't wait for a reply before sending the next request: requests
+//  are handled as fast as they arrive, and the screen is redrawn once for all
+//  the requests that were waiting, not once for each. Up to SERIAL_BATCH_RX_BUFFER
+//  bytes of requests may be in flight.
+//
+//  Requests:
+//    k <keys>        Type keys: the Calculator FACE characters (0-9 . A M % / * - + ` =),
+//                    and a, b, c for the front buttons. Spaces are ignored.
+//    e <expression>  Work out numbers joined by + - * / with operator precedence, on
+//                    Decimals: "e 10+4*2" replies "= 18", whatever mode the calculator
+//                    is in. The calculator completes any pending calculation and shows
+//                    the result, as = would; in programmer and graph modes it is left
+//                    as it was.
+//    r 0, r 1        Stop or start drawing the results of requests. Without drawing,
+//                    requests are limited only by the arithmetic (and the port.)
+//    d <seconds>     Dim the backlight after this long without input; 0 never dims (see idle.h.)
+//    i               Report the time spent asleep and the latency of waking (see idle.h.)
+//    f               Report the frames drawn, keys handled and areas drawn (see render_schedule.h.)
+//  Replies:
+//    = <accumulator>             to k and e, followed by the problem, if there is one:
+//                                "= Error divide-by-zero"
+//    ok                          to r and d
+//    idle <statistics>           to i: "idle 12 sleeps 3456 ms asleep 9 wakes 380 us mean 1250 us max"
+//    frames <n> keys <n> areas <n>  to f
+//    error <reason>                "error bad expression" to an e request that isn't one
+//  Blank lines are ignored. After IDLE_SLEEP_MS without input the calculator sleeps,
+//  and the bytes that wake it are lost: a host that has been quiet sends a blank line,
+//  and waits a few milliseconds before its next request.
+//
+//  Keys from k requests are handled by the same routines as keys from the keyboard,
+//  so they behave exactly the same (in statistics mode + adds to the statistics).
+//  They, and e requests that change what the calculator shows, are traced (see trace.h.)
+//
+#pragma once
+
+#include <stdint.h>
+#include "decimal.h"
+#include "expression.h"
+
+#define SERIAL_BATCH_LINE_SIZE  128         // Longest request, with its NUL
+#define SERIAL_BATCH_REPLY_SIZE 112         // Longest reply, with its newline and NUL: the idle report (idle.h)
+#define SERIAL_BATCH_RX_BUFFER  1024        // Bytes the port holds for requests not yet read
+
+
+struct Serial_Batch_Line {
+  char      text[SERIAL_BATCH_LINE_SIZE];
+  uint8_t   length;
+  bool      overflow;                       // The line is too long: the rest of it is dropped
+};
+
+
+bool        serial_batch_receive(Serial_Batch_Line& line, char c);  // Add a received character. Return true when the line is complete.
+uint8_t     serial_batch_reply(char* reply, const char* accumulator, Decimal_Status status);  // "= 18\n". Return its length.
+const char* serial_batch_status_name(Decimal_Status status);        // "overflow", or "" for DECIMAL_OK
+bool        serial_batch_is_expression(const char* text);           // True if text is an e request's expression: "10+4*2"
+Decimal     serial_batch_evaluate(const char* text, Expression_Listener listener = nullptr);  // Work out an expression serial_batch_is_expression() accepts
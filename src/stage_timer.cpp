@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Stage_Timer: latency histograms. See stage_timer.h.
+//
+#include "stage_timer.h"
+#include <M5Stack.h>
+#include <string.h>
+#ifdef NATIVE_BUILD
+#include <chrono>
+#endif
+
+bool            stage_timing = false;
+bool            stage_running[STAGE_COUNT];
+Stage_Histogram stage_histogram[STAGE_COUNT];
+const char*     stage_name[STAGE_COUNT] = {
+  "decode",
+  "process",
+  "arithmetic",
+  "display_accumulator",
+  "display_annunciator",
+  "display_info",
+  "display_button_labels"
+};
+
+
+uint32_t stage_clock_ns() {
+#ifdef NATIVE_BUILD
+  static const auto start = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+#else
+  return micros() * 1000;
+#endif
+}
+
+
+void stage_record(Stage stage, uint32_t ns) {
+  Stage_Histogram& h = stage_histogram[stage];
+  h.bucket[ns ? 32 - __builtin_clz(ns) : 0]++;
+  h.count++;
+  h.total_ns += ns;
+  if(ns > h.max_ns) h.max_ns = ns;
+}
+
+
+void stage_reset() {
+  memset(stage_histogram, 0, sizeof(stage_histogram));
+}
+
+
+uint32_t Stage_Histogram::percentile(double pct) const {
+  uint64_t  wanted  = (uint64_t)(pct / 100.0 * count + 0.5);
+  uint64_t  seen    = 0;
+  for(uint8_t i = 0; i < STAGE_BUCKETS; i++) {
+    seen += bucket[i];
+    if(seen >= wanted && seen > 0) return i ? (uint32_t)((1ULL << i) - 1) : 0;
+  }
+  return max_ns;
+}
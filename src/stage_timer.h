@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Stage_Timer: latency histograms for the stages of handling a key.
+//
+//  A Stage_Timer declared at the top of a routine adds the routine's run time to
+//  its stage's histogram when it returns. Buckets are powers of two of nanoseconds,
+//  so a histogram is a fixed, small table however many keys are timed.
+//  A routine called from inside another of the same stage is counted once, in the outer one.
+//
+//  Timing is off until stage_timing is set, and then costs a clock read at each end.
+//  The histograms are not protected from other threads: time on the host, where
+//  input and drawing run on one thread.
+//
+#pragma once
+
+#include <stdint.h>
+
+#define STAGE_BUCKETS         33            // Bucket 0 counts 0 ns; bucket i, times of 2^(i-1) to 2^i - 1 ns
+
+
+enum Stage {
+  STAGE_DECODE,                             // Taking a key from the queue
+  STAGE_PROCESS,                            // Handling a digit, command or button, including the arithmetic
+  STAGE_ARITHMETIC,                         // Calculations, including the preview
+  STAGE_ACCUMULATOR,                        // display_accumulator()
+  STAGE_ANNUNCIATOR,                        // display_annunciator()
+  STAGE_INFO,                               // display_info()
+  STAGE_LABELS,                             // display_button_labels()
+  STAGE_COUNT
+};
+
+
+struct Stage_Histogram {
+  uint32_t  bucket[STAGE_BUCKETS];
+  uint32_t  count;
+  uint64_t  total_ns;
+  uint32_t  max_ns;
+
+  uint32_t  percentile(double pct) const;   // Upper bound of the bucket holding the given percentile
+};
+
+
+extern bool             stage_timing;       // Set to collect times
+extern bool             stage_running[STAGE_COUNT];
+extern Stage_Histogram  stage_histogram[STAGE_COUNT];
+extern const char*      stage_name[STAGE_COUNT];
+
+uint32_t  stage_clock_ns();
+void      stage_record(Stage stage, uint32_t ns);
+void      stage_reset();                    // Empty every histogram
+
+
+class Stage_Timer {
+  public:
+    explicit Stage_Timer(Stage stage) : stage(stage), running(stage_timing && !stage_running[stage]) {
+      if(running) {
+        stage_running[stage] = true;
+        start = stage_clock_ns();
+      }
+    }
+
+    ~Stage_Timer() {
+      if(running) {
+        stage_record(stage, stage_clock_ns() - start);
+        stage_running[stage] = false;
+      }
+    }
+
+  private:
+    Stage     stage;
+    bool      running;
+    uint32_t  start = 0;
+};
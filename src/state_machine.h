@@ -0,0 +1,182 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  State Machine: what each key does in each mode of the calculator.
+//
+//  A key is first turned into a Calc_Command. What the command does then depends
+//  only on the mode: after AC a second AC clears everything, after an operator
+//  another operator replaces it, after M the next command operates on memory, and
+//  after M . the digits are the function keys.
+//  Statistics mode (see statistics.h) is not a mode here: it lasts until it is
+//  turned off, across any number of these. The + key arrives as its own command
+//  while it is on. Programmer mode (see programmer.h) isn't a mode here either:
+//  it has its own routine for each action, working on 64 bit integers, and after
+//  M the operator keys arrive as the bitwise operators. Graph mode (see graph.h)
+//  has a routine for each action too, which builds the formula instead.
+//  calc_transitions[mode][command] gives the action to take and the next mode,
+//  so handling a key is two table lookups and one call, whatever the mode.
+//  The actions themselves are routines in main.cpp, listed in Calc_Action order.
+//
+#pragma once
+
+#include <stdint.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Calculator Commands
+//
+enum Calc_Command {
+  NO_COMMAND,   // Not a key the calculator knows
+  CLEAR,        // Clear the accumulator; a second AC also clears memory and the pending calculation
+  TOTAL,        // Complete the expression and set the accumulator to the result
+  MEMORY,       // The next command operates on memory
+  DECIMAL,      // If the accumulator does not contain a decimal point, add a decimal point
+  ADD,          // Push the accumulator and + onto the expression
+  SUBTRACT,     // Push the accumulator and - onto the expression
+  MULTIPLY,     // Push the accumulator and * onto the expression
+  DIVIDE,       // Push the accumulator and / onto the expression
+  PERCENT,      // Depends on the pending operator; see perform_percentage()
+  SIGN,         // Reverse the sign of the accumulator
+  DIGIT,        // 0 - 9: add the digit to the accumulator
+  SQUARE_ROOT,  // The functions (see scientific.h): replace the accumulator with the function of it
+  SQUARE,
+  RECIPROCAL,
+  LN,
+  LOG,
+  EXP,
+  SIN,
+  COS,
+  TAN,
+  POWER,        // Push the accumulator and ^ onto the expression: x to the y, or exclusive or in programmer mode
+  ADD_TO_STATISTICS,  // + in statistics mode: add the accumulator to the statistics
+  TOGGLE_STATISTICS,  // M . +: turn statistics mode on or off
+  BIT_AND,      // Programmer mode: push the accumulator and & onto the expression
+  BIT_OR,       // |
+  SHIFT_LEFT,   // <<
+  SHIFT_RIGHT,  // >>
+  BIT_NOT,      // Flip every bit of the accumulator
+  HEX_DIGIT,    // A - F: add the digit to the accumulator
+  TOGGLE_PROGRAMMER,  // M . -: turn programmer mode on or off
+  TOGGLE_GRAPH, // M . *: turn graph mode on or off
+  COMMAND_COUNT
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Modes: what the last command leaves behind that changes what the next one does
+//
+enum Calc_Mode {
+  MODE_READY,                               // Nothing special
+  MODE_CLEARED,                             // AC was the last command
+  MODE_OPERATOR,                            // An operator was the last command: another one replaces it
+  MODE_MEMORY,                              // M was pressed: the next command operates on memory
+  MODE_FUNCTION,                            // M . was pressed: the next digit is a function key
+  MODE_COUNT
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Actions: one routine each in main.cpp. The key pressed is passed to the routine.
+//
+enum Calc_Action {
+  DO_NOTHING,
+  DO_DIGIT,                                 // Append the digit
+  DO_POINT,                                 // Append a decimal point
+  DO_SIGN,                                  // Change the accumulator's sign
+  DO_CLEAR,                                 // Clear the accumulator
+  DO_CLEAR_ALL,                             // Clear the accumulator, memory and expression
+  DO_PUSH,                                  // Push the accumulator and the operator
+  DO_REPLACE,                               // Replace the last operator
+  DO_PERCENT,
+  DO_TOTAL,
+  DO_MEMORY_CLEAR,                          // M AC
+  DO_MEMORY_STORE,                          // M =
+  DO_MEMORY_RECALL,                         // M M
+  DO_MEMORY_OPERATION,                      // M +, M -, M *, M /, M %
+  DO_FUNCTION,                              // Replace the accumulator with a function of it
+  DO_ADD_TO_STATISTICS,
+  DO_TOGGLE_STATISTICS,
+  DO_TOGGLE_PROGRAMMER,
+  DO_TOGGLE_GRAPH,
+  ACTION_COUNT
+};
+
+
+struct Calc_Transition {
+  uint8_t   action;                         // Calc_Action
+  uint8_t   next;                           // Calc_Mode
+};
+
+
+//  Columns are in Calc_Command order:
+//    NO_COMMAND, CLEAR, TOTAL, MEMORY, DECIMAL, ADD, SUBTRACT, MULTIPLY, DIVIDE, PERCENT, SIGN, DIGIT,
+//    SQUARE_ROOT, SQUARE, RECIPROCAL, LN, LOG, EXP, SIN, COS, TAN, POWER, ADD_TO_STATISTICS, TOGGLE_STATISTICS,
+//    BIT_AND, BIT_OR, SHIFT_LEFT, SHIFT_RIGHT, BIT_NOT, HEX_DIGIT, TOGGLE_PROGRAMMER, TOGGLE_GRAPH
+//
+constexpr Calc_Transition calc_transitions[MODE_COUNT][COMMAND_COUNT] = {
+  { // MODE_READY
+    { DO_NOTHING, MODE_READY }, { DO_CLEAR, MODE_CLEARED }, { DO_TOTAL, MODE_READY }, { DO_NOTHING, MODE_MEMORY },
+    { DO_POINT, MODE_READY },
+    { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR },
+    { DO_PERCENT, MODE_READY }, { DO_SIGN, MODE_READY }, { DO_DIGIT, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_PUSH, MODE_OPERATOR },
+    { DO_ADD_TO_STATISTICS, MODE_READY }, { DO_NOTHING, MODE_READY },
+    { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR },
+    { DO_FUNCTION, MODE_READY }, { DO_DIGIT, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }
+  },
+  { // MODE_CLEARED
+    { DO_NOTHING, MODE_READY }, { DO_CLEAR_ALL, MODE_CLEARED }, { DO_TOTAL, MODE_READY }, { DO_NOTHING, MODE_MEMORY },
+    { DO_POINT, MODE_READY },
+    { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR },
+    { DO_PERCENT, MODE_READY }, { DO_SIGN, MODE_READY }, { DO_DIGIT, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_PUSH, MODE_OPERATOR },
+    { DO_ADD_TO_STATISTICS, MODE_READY }, { DO_NOTHING, MODE_READY },
+    { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR },
+    { DO_FUNCTION, MODE_READY }, { DO_DIGIT, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }
+  },
+  { // MODE_OPERATOR
+    { DO_NOTHING, MODE_READY }, { DO_CLEAR, MODE_CLEARED }, { DO_TOTAL, MODE_READY }, { DO_NOTHING, MODE_MEMORY },
+    { DO_POINT, MODE_READY },
+    { DO_REPLACE, MODE_OPERATOR }, { DO_REPLACE, MODE_OPERATOR }, { DO_REPLACE, MODE_OPERATOR }, { DO_REPLACE, MODE_OPERATOR },
+    { DO_PERCENT, MODE_READY }, { DO_SIGN, MODE_READY }, { DO_DIGIT, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_REPLACE, MODE_OPERATOR },
+    { DO_ADD_TO_STATISTICS, MODE_READY }, { DO_NOTHING, MODE_READY },
+    { DO_REPLACE, MODE_OPERATOR }, { DO_REPLACE, MODE_OPERATOR }, { DO_REPLACE, MODE_OPERATOR }, { DO_REPLACE, MODE_OPERATOR },
+    { DO_FUNCTION, MODE_READY }, { DO_DIGIT, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }
+  },
+  { // MODE_MEMORY: digits may be typed before the memory command, and M . opens the function keys.
+    // In programmer mode the operators arrive as the bitwise operators (^ as POWER.)
+    { DO_NOTHING, MODE_READY }, { DO_MEMORY_CLEAR, MODE_READY }, { DO_MEMORY_STORE, MODE_READY }, { DO_MEMORY_RECALL, MODE_READY },
+    { DO_NOTHING, MODE_FUNCTION },
+    { DO_MEMORY_OPERATION, MODE_READY }, { DO_MEMORY_OPERATION, MODE_READY }, { DO_MEMORY_OPERATION, MODE_READY }, { DO_MEMORY_OPERATION, MODE_READY },
+    { DO_MEMORY_OPERATION, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_DIGIT, MODE_MEMORY },
+    { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY },
+    { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY },
+    { DO_NOTHING, MODE_READY }, { DO_PUSH, MODE_OPERATOR },
+    { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY },
+    { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR }, { DO_PUSH, MODE_OPERATOR },
+    { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }
+  },
+  { // MODE_FUNCTION: the digits arrive as the functions, + as TOGGLE_STATISTICS, - as TOGGLE_PROGRAMMER and * as TOGGLE_GRAPH
+    // (see decode_key() in main.cpp.) In programmer mode 0 - 5 are the hex digits and ` is BIT_NOT.
+    // Any other key cancels.
+    { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY },
+    { DO_NOTHING, MODE_READY },
+    { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY },
+    { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY }, { DO_FUNCTION, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_PUSH, MODE_OPERATOR },
+    { DO_NOTHING, MODE_READY }, { DO_TOGGLE_STATISTICS, MODE_READY },
+    { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY }, { DO_NOTHING, MODE_READY },
+    { DO_FUNCTION, MODE_READY }, { DO_DIGIT, MODE_READY }, { DO_TOGGLE_PROGRAMMER, MODE_READY }, { DO_TOGGLE_GRAPH, MODE_READY }
+  }
+};
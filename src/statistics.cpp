@@ -0,0 +1,85 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Statistics: running totals for a batch of readings. See statistics.h.
+//
+#include "statistics.h"
+#include "scientific.h"
+
+
+static bool less_than(const Decimal& a, const Decimal& b) {
+  Decimal difference = decimal_subtract(a, b);
+  return difference.negative && 0 != difference.mantissa;
+}
+
+
+void statistics_clear(Statistics& s) {
+  Decimal zero = decimal_make(0, 0);
+  s.count = 0;
+  s.sum   = zero;
+  s.shift = zero;
+  s.mean  = zero;
+  s.m2    = zero;
+  s.min   = zero;
+  s.max   = zero;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Welford's update, on y = x - shift: with delta = y - old mean,
+//    mean = old mean + delta / count
+//    m2   = m2 + delta * (y - new mean)
+//
+void statistics_add(Statistics& s, const Decimal& x) {
+  if(decimal_is_error(x)) return;
+  if(0 == s.count) s.shift = x;
+  s.count++;
+  Decimal y     = decimal_subtract(x, s.shift);
+  Decimal delta = decimal_subtract(y, s.mean);
+  s.mean  = decimal_add(s.mean, decimal_divide(delta, decimal_make(s.count, 0)));
+  s.m2    = decimal_add(s.m2, decimal_multiply(delta, decimal_subtract(y, s.mean)));
+  s.sum   = decimal_add(s.sum, x);
+  if(1 == s.count || less_than(x, s.min)) s.min = x;
+  if(1 == s.count || less_than(s.max, x)) s.max = x;
+}
+
+
+Decimal statistics_mean(const Statistics& s) {
+  return decimal_add(s.shift, s.mean);
+}
+
+
+Decimal statistics_variance(const Statistics& s) {
+  if(s.count < 2) return decimal_make(0, 0);
+  return decimal_divide(s.m2, decimal_make(s.count - 1, 0));
+}
+
+
+Decimal statistics_deviation(const Statistics& s) {
+  return scientific_sqrt(statistics_variance(s));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Packed as count (4, little-endian), then sum, shift, mean, m2, min and max (decimal_pack).
+//
+void statistics_pack(uint8_t* p, const Statistics& s) {
+  for(uint8_t i = 0; i < 4; i++) *p++ = (uint8_t)(s.count >> (8 * i));
+  const Decimal* values[] = { &s.sum, &s.shift, &s.mean, &s.m2, &s.min, &s.max };
+  for(const Decimal* value : values) {
+    decimal_pack(p, *value);
+    p += DECIMAL_PACKED_SIZE;
+  }
+}
+
+
+void statistics_unpack(const uint8_t* p, Statistics& s) {
+  s.count = 0;
+  for(uint8_t i = 0; i < 4; i++) s.count |= (uint32_t)*p++ << (8 * i);
+  Decimal* values[] = { &s.sum, &s.shift, &s.mean, &s.m2, &s.min, &s.max };
+  for(Decimal* value : values) {
+    *value = decimal_unpack(p);
+    p += DECIMAL_PACKED_SIZE;
+  }
+}
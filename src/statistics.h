@@ -0,0 +1,46 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Statistics: count, sum, mean, variance, min and max of a batch of readings.
+//
+//  Each value is folded into running totals as it is entered, so a batch of any
+//  length takes the same few bytes and adding a value takes the same time.
+//  The mean and variance are kept by Welford's method: the mean is moved toward
+//  each new value, and the squared distances from it are summed. Unlike summing
+//  x and x^2 and subtracting at the end, this loses nothing when the readings
+//  are large and close together (1000000.1, 1000000.3, ...) The mean is kept
+//  relative to the first reading, so that its digits go on how far the readings
+//  spread and not on their size: otherwise, once a batch is long enough, a new
+//  reading moves the mean by less than its last digit.
+//
+//  In statistics mode (M . + on the keypad) the + key adds the accumulator to
+//  the batch, and the Info area shows the results.
+//
+#pragma once
+
+#include <stdint.h>
+#include "decimal.h"
+
+#define STATISTICS_PACKED_SIZE (4 + 6 * DECIMAL_PACKED_SIZE)  // Bytes written by statistics_pack()
+
+#define STATISTICS_ADD        '#'           // The + key in statistics mode: add the accumulator to the batch
+#define STATISTICS_MODE       '$'           // M . +: turn statistics mode on or off
+
+
+struct Statistics {
+  uint32_t  count;
+  Decimal   sum;
+  Decimal   shift;                          // The first value
+  Decimal   mean;                           // Mean of the values less shift
+  Decimal   m2;                             // Sum of the squared distances from the mean
+  Decimal   min;
+  Decimal   max;
+};
+
+
+void    statistics_clear(Statistics& s);
+void    statistics_add(Statistics& s, const Decimal& x);          // An error value is not added
+Decimal statistics_mean(const Statistics& s);
+Decimal statistics_variance(const Statistics& s);                 // Sample variance, m2 / (count - 1). Zero for fewer than 2 values.
+Decimal statistics_deviation(const Statistics& s);                // Sample standard deviation, to SCIENTIFIC_DIGITS
+void    statistics_pack(uint8_t* p, const Statistics& s);         // Store in STATISTICS_PACKED_SIZE bytes, for flash
+void    statistics_unpack(const uint8_t* p, Statistics& s);
@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Trace: recorder and reader. See trace.h.
+//
+#include "trace.h"
+#include <M5Stack.h>
+#include <SPIFFS.h>
+
+#define HEADER_SIZE           5
+#define EVENT_SIZE_MAX        6             // A 32-bit delay in 5 bytes, and the key
+
+static uint8_t    buffer[TRACE_BUFFER_SIZE];
+static uint8_t    used      = 0;            // Bytes waiting in buffer
+static uint32_t   written   = 0;            // Bytes in the trace, including those waiting
+static uint32_t   last_ms   = 0;            // millis() of the previous event
+static File       trace_file;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Keep the current trace as the old one, and start a new one with the snapshot.
+//  Without flash, events are still collected, and dropped.
+//
+void trace_begin(const uint8_t* snapshot, uint16_t size) {
+  trace_flush();
+  trace_file.close();
+  SPIFFS.remove(TRACE_OLD_PATH);
+  SPIFFS.rename(TRACE_PATH, TRACE_OLD_PATH);
+  trace_file = SPIFFS.open(TRACE_PATH, FILE_WRITE);
+
+  const uint8_t header[HEADER_SIZE] = { 'K', 'T', TRACE_VERSION, (uint8_t)size, (uint8_t)(size >> 8) };
+  if(trace_file) {
+    trace_file.write(header, HEADER_SIZE);
+    trace_file.write(snapshot, size);
+  }
+  written = HEADER_SIZE + size;
+  last_ms = millis();
+}
+
+
+void trace_event(char key) {
+  uint32_t now    = millis();
+  uint32_t delay  = now - last_ms;
+  last_ms = now;
+  if(used + EVENT_SIZE_MAX > TRACE_BUFFER_SIZE) trace_flush();
+
+  uint8_t start = used;
+  while(delay >= 0x80) {
+    buffer[used++] = (uint8_t)(delay | 0x80);
+    delay >>= 7;
+  }
+  buffer[used++] = (uint8_t)delay;
+  buffer[used++] = (uint8_t)key;
+  written += used - start;
+}
+
+
+bool trace_flush_due(uint32_t idle_ms) {
+  return used > 0 && idle_ms >= TRACE_FLUSH_IDLE_MS;
+}
+
+
+void trace_flush() {
+  if(0 == used) return;
+  if(trace_file) {
+    trace_file.write(buffer, used);
+    trace_file.flush();
+  }
+  used = 0;
+}
+
+
+bool trace_restart_due(uint32_t idle_ms) {
+  return written >= TRACE_LIMIT && idle_ms >= TRACE_FLUSH_IDLE_MS;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Reader
+//
+bool Trace_Reader::open(const uint8_t* trace, size_t trace_size) {
+  data  = trace;
+  size  = trace_size;
+  ms    = 0;
+  if(size < HEADER_SIZE || 'K' != data[0] || 'T' != data[1] || TRACE_VERSION != data[2]) return false;
+  snapshot_size = (uint16_t)(data[3] | data[4] << 8);
+  snapshot      = data + HEADER_SIZE;
+  offset        = HEADER_SIZE + snapshot_size;
+  return offset <= size;
+}
+
+
+bool Trace_Reader::next(Trace_Event& event) {
+  uint32_t  delay = 0;
+  uint8_t   shift = 0;
+  size_t    p     = offset;
+  while(p < size && (data[p] & 0x80) && shift < 28) {
+    delay |= (uint32_t)(data[p++] & 0x7F) << shift;
+    shift += 7;
+  }
+  if(p + 2 > size) return false;
+  delay |= (uint32_t)data[p++] << shift;
+  ms       += delay;
+  event.ms  = ms;
+  event.key = (char)data[p++];
+  offset    = p;
+  return true;
+}
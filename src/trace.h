@@ -0,0 +1,67 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Trace: a recording of every key and button the calculator handles, with times.
+//
+//  A trace starts with a snapshot of the calculator's state (opaque here: the
+//  caller packs and unpacks it), followed by one event per key in the order the
+//  keys were handled. Replaying the events into the snapshot on the host gives
+//  the same results the calculator showed, so a wrong answer can be reproduced.
+//
+//  Events are the keystroke script characters: Calculator FACE keys, and 'a', 'b',
+//  'c' for the front buttons. A serial e request (serial_batch.h) is 'e', then its
+//  expression a character at a time, then '='. Each event is stored after the
+//  milliseconds since the previous one, as a variable-length number, so most
+//  events take 2 or 3 bytes:
+//
+//    'K', 'T', TRACE_VERSION, snapshot size (2, low byte first), snapshot
+//    events: delay in ms (7 bits per byte, low bits first, high bit set on all
+//            but the last byte), then the event character (1)
+//
+//  Events are collected in RAM and appended to TRACE_PATH in flash when the
+//  buffer fills or the keyboard goes idle. Each trace_begin() keeps the last trace
+//  as TRACE_OLD_PATH and starts a new one, so the trace of the session before a
+//  restart survives it. A trace that has reached TRACE_LIMIT should be started
+//  again once the keyboard goes idle, as the files are renamed and opened then, so
+//  a burst of keys is never held up; until then the trace runs past the limit.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_PATH            "/trace.bin"
+#define TRACE_OLD_PATH        "/trace.old"
+#define TRACE_VERSION         5             // Change whenever the format changes
+#define TRACE_BUFFER_SIZE     128           // Bytes of events held in RAM before they are written
+#define TRACE_FLUSH_IDLE_MS   2000          // Events are written once the keyboard has been idle this long
+#define TRACE_LIMIT           16384         // Trace size (bytes) at which trace_restart_due() asks for a new trace
+
+
+struct Trace_Event {
+  uint32_t  ms;                             // Time since the start of the trace
+  char      key;                            // Script character
+};
+
+
+void  trace_begin(const uint8_t* snapshot, uint16_t size); // Start a new trace. Call after SPIFFS.begin().
+void  trace_event(char key);                // Record a key handled now
+bool  trace_flush_due(uint32_t idle_ms);    // True if events should be written, given the time since the last key
+void  trace_flush();                        // Write waiting events to flash
+bool  trace_restart_due(uint32_t idle_ms);  // True if the trace has reached TRACE_LIMIT and the keyboard has been idle TRACE_FLUSH_IDLE_MS
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Read a trace held in memory.
+//
+struct Trace_Reader {
+  const uint8_t*  data;
+  size_t          size;
+  size_t          offset;
+  uint32_t        ms;
+  const uint8_t*  snapshot;
+  uint16_t        snapshot_size;
+
+  bool  open(const uint8_t* trace, size_t trace_size);    // Return false if this is not a trace
+  bool  next(Trace_Event& event);                       // Return false at the end, or at a record torn by a power cut
+};
@@ -0,0 +1,43 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Undo: the calculator's recent states, to step back and forward through. See undo.h.
+//
+#include "undo.h"
+#include <utility>
+
+static Undo_Snapshot  ring[UNDO_DEPTH];
+static uint32_t       oldest  = 0;          // Index (before wrapping) of the oldest undo
+static uint32_t       cursor  = 0;          // Index of the oldest redo, one past the newest undo
+static uint32_t       newest  = 0;          // One past the newest redo
+
+static Undo_Snapshot& slot(uint32_t index) { return ring[index % UNDO_DEPTH]; }
+
+
+void undo_clear() {
+  oldest = cursor = newest = 0;
+}
+
+
+void undo_record(const Undo_Snapshot& before) {
+  slot(cursor) = before;
+  newest = ++cursor;
+  if(cursor - oldest > UNDO_DEPTH) oldest++;
+}
+
+
+bool undo_step(Undo_Snapshot& state) {
+  if(cursor == oldest) return false;
+  std::swap(state, slot(--cursor));         // The live state is now the oldest redo
+  return true;
+}
+
+
+bool redo_step(Undo_Snapshot& state) {
+  if(cursor == newest) return false;
+  std::swap(state, slot(cursor++));         // The live state is now the newest undo
+  return true;
+}
+
+
+uint8_t undo_count() { return (uint8_t)(cursor - oldest); }
+uint8_t redo_count() { return (uint8_t)(newest - cursor); }
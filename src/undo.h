@@ -0,0 +1,33 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Undo: the calculator's recent states, to step back and forward through.
+//
+//  A state is kept as a snapshot: the Saved_State (saved_state.h) and the mode,
+//  as a key trace starts with, but unpacked so taking one is a copy. Snapshots
+//  live in a fixed ring of UNDO_DEPTH slots with a cursor: those below it can be
+//  undone, those from it up redone. Undo and redo swap the live state's snapshot
+//  with the one next to the cursor and move the cursor, so each costs the same
+//  whatever the depth. Recording a new state drops the redos, and the oldest undo
+//  once the ring is full. Nothing is allocated.
+//
+#pragma once
+
+#include <stdint.h>
+#include "saved_state.h"
+
+#define UNDO_DEPTH            16            // States kept, undos and redos together
+
+
+struct Undo_Snapshot {
+  Saved_State state;
+  uint8_t     mode;                         // Calc_Mode (state_machine.h)
+  bool        valid;
+};
+
+
+void      undo_clear();
+void      undo_record(const Undo_Snapshot& before);   // A change was made to the state before: it becomes the newest undo, and the redos are dropped
+bool      undo_step(Undo_Snapshot& state);          // Swap the live state for the newest undo. Return false if there is none.
+bool      redo_step(Undo_Snapshot& state);          // Swap the live state for the oldest redo. Return false if there is none.
+uint8_t   undo_count();                             // Steps that can be undone
+uint8_t   redo_count();                             // Steps that can be redone
@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Workspace: the parked calculations. See workspace.h.
+//
+//  Packed, they are the workspace showing (1), then for each parked workspace in
+//  order its mode (1), the size of its state's record (1) and the record (saved_state_pack).
+//
+#include "workspace.h"
+#include "state_machine.h"
+#include <string.h>
+
+static Workspace  slot[WORKSPACES];         // slot[current] is unused: that workspace is live
+static uint8_t    current = 0;
+
+
+void workspace_clear() {
+  for(Workspace& w : slot) {
+    memset((void*)&w, 0, sizeof(w));       // Zeroed first, as undo snapshots are
+    w.state.accumulator.clear();
+    w.state.memory.clear();
+    expression_clear(w.state.expression);
+    w.state.status    = DECIMAL_OK;
+    w.state.restart   = true;
+    statistics_clear(w.state.statistics);
+    w.state.radix     = RADIX_DECIMAL;
+    programmer_clear(w.state.integer_expression);
+    w.mode            = MODE_READY;
+  }
+  current = 0;
+}
+
+
+uint8_t workspace_current() {
+  return current;
+}
+
+
+void workspace_switch(Workspace& live, uint8_t to) {
+  slot[current] = live;
+  live          = slot[to];
+  current       = to;
+}
+
+
+uint16_t workspace_pack(uint8_t* p) {
+  uint8_t* start = p;
+  *p++ = current;
+  for(uint8_t i = 0; i < WORKSPACES; i++) {
+    if(i == current) continue;
+    p[0]  = slot[i].mode;
+    p[1]  = saved_state_pack(p + 2, slot[i].state);
+    p    += 2 + p[1];
+  }
+  return (uint16_t)(p - start);
+}
+
+
+uint16_t workspace_unpack(const uint8_t* p, uint16_t size) {
+  const uint8_t*  start = p;
+  const uint8_t*  end   = p + size;
+  workspace_clear();
+  if(0 == size || p[0] >= WORKSPACES) return 0;
+  uint8_t showing = *p++;
+  for(uint8_t i = 0; i < WORKSPACES; i++) {
+    if(i == showing) continue;
+    if(end - p < 2 || p[0] >= MODE_COUNT || end - p - 2 < p[1] || !saved_state_unpack(p + 2, p[1], slot[i].state)) {
+      workspace_clear();
+      return 0;
+    }
+    slot[i].mode  = p[0];
+    p            += 2 + p[1];
+  }
+  current = showing;
+  return (uint16_t)(p - start);
+}
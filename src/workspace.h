@@ -0,0 +1,33 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Workspace: several calculations kept at once, one of them showing.
+//
+//  The calculation showing lives in the calculator's globals, where every action
+//  works on it. Each of the others is parked in a Workspace: the Saved_State
+//  (saved_state.h) and the mode, as an undo snapshot (undo.h) keeps them.
+//  Switching parks the live state in the slot of the workspace being left and
+//  takes the one switched to out of its own: two copies of a fixed size, so a
+//  switch costs the same whatever either workspace holds. Nothing is allocated.
+//  The parked workspaces, and which one is showing, are packed into the saved state
+//  in flash beside the live one, so they survive a restart.
+//
+#pragma once
+
+#include <stdint.h>
+#include "saved_state.h"
+
+#define WORKSPACES            3             // Calculations kept at once, the one showing included
+#define WORKSPACE_PACKED_SIZE (1 + (WORKSPACES - 1) * (2 + SAVED_STATE_SIZE))  // Most bytes written by workspace_pack()
+
+
+struct Workspace {
+  Saved_State state;
+  uint8_t     mode;                         // Calc_Mode (state_machine.h)
+};
+
+
+void      workspace_clear();                              // Every parked workspace cleared, and the first one showing
+uint8_t   workspace_current();                            // The workspace showing, from 0
+void      workspace_switch(Workspace& live, uint8_t to);  // Park the live state, and replace it with workspace to's
+uint16_t  workspace_pack(uint8_t* p);                     // Store which workspace is showing and the parked ones. Return the bytes written.
+uint16_t  workspace_unpack(const uint8_t* p, uint16_t size);  // Restore what workspace_pack() stored. Return the bytes used, or 0 (and clear) if they aren't valid.